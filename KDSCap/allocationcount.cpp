@@ -0,0 +1,158 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#include "allocationcount.h"
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> avBufferRefs(0);
+
+static void* alignedAlloc(size_t size, std::align_val_t alignment)
+{
+    if (size == 0)
+        size = 1;
+#ifdef _MSC_VER
+    return _aligned_malloc(size, ( size_t) alignment);
+#else
+    void* p;
+    size_t align = ( size_t) alignment < sizeof(void*) ? sizeof(void*) : ( size_t) alignment;
+    return posix_memalign(&p, align, size) == 0 ? p : NULL;
+#endif
+}
+
+static void alignedFree(void* p)
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// Every form of new is replaced, so none of them can allocate uncounted
+void* operator new(size_t size)
+{
+    ++allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    ++allocations;
+    void* p = alignedAlloc(size, alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    ++allocations;
+    return alignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    alignedFree(p);
+}
+
+uint64_t allocationCount()
+{
+    return allocations;
+}
+
+void countAvBufferRef()
+{
+    avBufferRefs.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t avBufferRefCount()
+{
+    return avBufferRefs;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Number of times operator new, in any of its forms, has been called in this
+// process, for checking that the capture pipeline doesn't allocate per frame
+uint64_t allocationCount();
+
+// libav allocates buffer references with av_malloc, which can't be hooked, so
+// code that makes them per frame counts them here instead
+void countAvBufferRef();
+uint64_t avBufferRefCount();
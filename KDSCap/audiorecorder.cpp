@@ -1,8 +1,11 @@
 #include <memory.h>
 #include <stdexcept>
 #include "audiorecorder.h"
+#include "threadpolicy.h"
 
-AudioRecorder::AudioRecorder()
+// filename may be NULL to only encode until openOutput is called. Without a
+// capture device, samples are fed through recordingCallback by the caller.
+AudioRecorder::AudioRecorder(const char* filename, bool openDevice)
 {
     codec = avcodec_find_encoder(AV_CODEC_ID_MP3);
     if (!codec)
@@ -19,6 +22,7 @@ AudioRecorder::AudioRecorder()
     context->bit_rate = 128000;
     context->sample_fmt = AV_SAMPLE_FMT_FLTP;
     context->sample_rate = 44100;
+    context->time_base = {1, context->sample_rate};
     context->channel_layout = AV_CH_LAYOUT_STEREO;
     context->channels = av_get_channel_layout_nb_channels(context->channel_layout);
 
@@ -29,8 +33,8 @@ AudioRecorder::AudioRecorder()
         throw std::runtime_error("Could not open codec");
     }
 
-    auto error = fopen_s(&output, "audio.mp3", "wb");
-    if (error != 0)
+    output = NULL;
+    if (filename && !openOutput(filename))
     {
         throw std::runtime_error("Could not open file");
     }
@@ -48,6 +52,16 @@ AudioRecorder::AudioRecorder()
 
     initSwrContext();
 
+    device = 0;
+    if (openDevice)
+    {
+        openCaptureDevice();
+    }
+}
+
+// Opens the recording device. SDL's audio subsystem has to be initialized first.
+void AudioRecorder::openCaptureDevice()
+{
     SDL_AudioSpec want;
     SDL_zero(want);
     want.freq = context->sample_rate;
@@ -55,7 +69,7 @@ AudioRecorder::AudioRecorder()
     want.channels = context->channels;
     want.samples = context->frame_size;
     want.callback = [](void* userdata, uint8_t* stream, int len) -> void {
-        (( AudioRecorder*) userdata)->recordingCallback(stream, len);
+        (( AudioRecorder*) userdata)->deviceCallback(stream, len);
     };
     want.userdata = this;
     
@@ -82,16 +96,21 @@ AudioRecorder::~AudioRecorder()
     av_packet_free(&packet);
     avcodec_free_context(&context);
     swr_free(&swrContext);
-    fclose(output);
+    if (output)
+    {
+        fclose(output);
+    }
 }
 
 void AudioRecorder::start()
 {
+    if (device == 0) return;
     SDL_PauseAudioDevice(device, 0);
 }
 
 void AudioRecorder::stop()
 {
+    if (device == 0) return;
     SDL_PauseAudioDevice(device, 1);
 }
 
@@ -118,9 +137,79 @@ void AudioRecorder::recordingCallback(uint8_t* stream, int len)
         printError(av_error);
     }
 
+    frame->pts = nextPts;
+    nextPts += frame->nb_samples;
     encode(frame);
 }
 
+// Called on SDL's audio thread. A callback that comes later than one buffer
+// after the last counts as a scheduling delay, and one that is a whole buffer
+// later than that as an overrun.
+void AudioRecorder::deviceCallback(uint8_t* stream, int len)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (lastCallback == 0)
+    {
+        configureThread(ThreadAudio, "audio");
+    }
+    else
+    {
+        double intervalMs = (now - lastCallback) * 1000.0 / SDL_GetPerformanceFrequency();
+        double bufferMs = recordingFormat.samples * 1000.0 / recordingFormat.freq;
+        recordWakeDelay(intervalMs - bufferMs);
+        if (intervalMs > bufferMs * 2)
+            deviceOverruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    lastCallback = now;
+
+    recordingCallback(stream, len);
+}
+
+// Starts writing encoded audio to filename, replacing any file being written.
+// Safe to call while the device is recording. Files are opened and closed
+// outside the lock, so the audio callback only ever waits for a pointer swap.
+bool AudioRecorder::openOutput(const char* filename)
+{
+    FILE* file;
+    if (fopen_s(&file, filename, "wb") != 0)
+    {
+        closeOutput();
+        return false;
+    }
+    swapOutput(file);
+    return true;
+}
+
+void AudioRecorder::closeOutput()
+{
+    swapOutput(NULL);
+}
+
+void AudioRecorder::swapOutput(FILE* file)
+{
+    FILE* previous;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        previous = output;
+        output = file;
+    }
+    if (previous)
+    {
+        fclose(previous);
+    }
+}
+
+// Also sends every encoded packet to sink, e.g. for live streaming
+void AudioRecorder::setPacketSink(PacketSink* sink)
+{
+    packetSink = sink;
+}
+
+const AVCodecContext* AudioRecorder::codecContext()
+{
+    return context;
+}
+
 void AudioRecorder::encode(AVFrame* frame)
 {
     int ret;
@@ -133,7 +222,18 @@ void AudioRecorder::encode(AVFrame* frame)
         else if (ret < 0)
             throw std::runtime_error("Error encoding audio frame");
         
-        fwrite(packet->data, 1, packet->size, output);
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (output)
+            {
+                fwrite(packet->data, 1, packet->size, output);
+                outputBytes.fetch_add(packet->size, std::memory_order_relaxed);
+            }
+        }
+        if (packetSink)
+        {
+            packetSink->writePacket(context, packet);
+        }
         av_packet_unref(packet);
     }
 }
@@ -1,6 +1,9 @@
 #pragma once
+#include <atomic>
 #include <cstdio>
+#include <mutex>
 #include <SDL.h>
+#include "packetsink.h"
 
 extern "C"
 {
@@ -11,13 +14,22 @@ extern "C"
 class AudioRecorder
 {
 public:
-    AudioRecorder();
+    AudioRecorder(const char* filename = "audio.mp3", bool openDevice = true);
     ~AudioRecorder();
 
+    void openCaptureDevice();
     void start();
     void stop();
+
+    bool openOutput(const char* filename);
+    void closeOutput();
     
     void recordingCallback(uint8_t* stream, int len);
+    void setPacketSink(PacketSink* sink);
+    const AVCodecContext* codecContext();
+
+    uint64_t overruns() { return deviceOverruns; }
+    uint64_t bytesWritten() { return outputBytes; }
 
 private:
     SDL_AudioDeviceID device;
@@ -28,12 +40,20 @@ private:
     AVFrame* frame, *tempFrame;
     AVPacket* packet;
 
-    SwrContext* swrContext;
+    SwrContext* swrContext = NULL;
 
     FILE* output;
+    std::mutex outputMutex; // The output is opened and closed while the device is recording
+    PacketSink* packetSink = NULL;
+    int64_t nextPts = 0;
+    uint64_t lastCallback = 0;
+    std::atomic<uint64_t> deviceOverruns = {0}; // Callbacks so late the device's buffer must have overflowed
+    std::atomic<uint64_t> outputBytes = {0};    // Encoded bytes written to the output file
 
     AVFrame* createFrame(int samples, int format, uint64_t channels);
     void initSwrContext();
+    void deviceCallback(uint8_t* stream, int len);
+    void swapOutput(FILE* file);
 
     void encode(AVFrame* frame);
     void printError(int code);
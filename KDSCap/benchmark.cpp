@@ -0,0 +1,980 @@
+// winsock2.h has to come before anything that pulls in Windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <Windows.h>
+#include <io.h>
+#include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "allocationcount.h"
+#include "audiorecorder.h"
+#include "benchmark.h"
+#include "benchmarkstages.h"
+#include "cpuload.h"
+#include "frameanalyzer.h"
+#include "framebus.h"
+#include "framepool.h"
+#include "framesharepublisher.h"
+#include "framesharereader.h"
+#include "kdscap.h"
+#include "livestream.h"
+#include "metricsserver.h"
+#include "pipeoutput.h"
+#include "pixelconvert.h"
+#include "renditions.h"
+#include "screenmodes.h"
+#include "screenshotter.h"
+#include "syntheticsource.h"
+#include "videoencoder.h"
+#include "win_dscapture.h"
+
+#define BENCH_LIVE_SUBSCRIBERS 4
+#define BENCH_LIVE_PORT 27441
+#define BENCH_LIVE_TIMEOUT_MS 5000
+#define BENCH_METRICS_PORT 27442
+#define BENCH_METRICS_SCRAPES 4
+#define BENCH_ADAPTIVE_DROP_BUDGET 0.05 // Share of frames the starved adaptive encoder may drop
+#define BENCH_RECOVERY_LOAD 4           // Busy threads per core while the recovering encoder is starved
+#define BENCH_RECOVERY_PHASE_FRAMES (QUALITY_WINDOW_FRAMES * (QUALITY_CALM_WINDOWS + 4))
+#define BENCH_SCREENSHOT_BURST 60   // Frames in a burst, the --burst-frames default
+#define BENCH_SCREENSHOT_MIN_FPS 60 // A burst has to be saved at least as fast as it was captured
+
+// Archive at constant quality, then streams at falling bitrates, in kbps
+static const int renditionBitRates[MAX_RENDITIONS] = {0, 4000, 2500, 1000};
+
+static const char* pipeVariants[] = {"write", "rgb565", "y4m"};
+#define NUM_PIPE_VARIANTS 3
+
+// RGB565 to YUV for the encoder
+static BenchmarkResult benchConvertYUV(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"convert", "yuv420p", frames};
+    std::vector<uint8_t> output(DS_WIDTH * DS_HEIGHT * 2 * 3 / 2);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        if (SDL_ConvertPixels(DS_WIDTH, DS_HEIGHT * 2, SDL_PIXELFORMAT_RGB565, scene.frame(i), DS_WIDTH * sizeof(uint16_t),
+                              SDL_PIXELFORMAT_IYUV, &output[0], DS_WIDTH) < 0)
+        {
+            throw std::runtime_error("Could not convert frame");
+        }
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// Lag frame analysis on one thread, timeline included. Written to NUL, so
+// only the formatting is timed, not the disk.
+static BenchmarkResult benchAnalyze(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"analyze", "", frames};
+    FrameAnalyzer analyzer("NUL");
+    DSFrameInfo info = {};
+    uint64_t ticksPerFrame = ( uint64_t) (SDL_GetPerformanceFrequency() / DS_FRAME_RATE);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        info.captureTime = i * ticksPerFrame;
+        memcpy(info.lineMask, scene.info(i), DS_LINE_MASK_SIZE);
+        analyzer.analyze(scene.frame(i), i > 0 ? scene.frame(i - 1) : NULL, info, i);
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// Streams frames into an anonymous pipe drained by another thread, as an
+// external reader would. "write" is plain stdio, copying every frame into its
+// buffer first; the others go through PipeOutput, which writes RGB565 frames
+// straight from pooled frame memory.
+static BenchmarkResult benchPipe(const SceneFrames& scene, const char* variant, int frames)
+{
+    BenchmarkResult result = {"pipe", variant, frames};
+    HANDLE readEnd, writeEnd;
+    if (!CreatePipe(&readEnd, &writeEnd, NULL, PIPE_NAMED_BUFFER))
+        throw std::runtime_error("Could not create a pipe");
+
+    std::thread reader([readEnd]() {
+        std::vector<uint8_t> buffer(PIPE_NAMED_BUFFER);
+        DWORD read;
+        while (ReadFile(readEnd, &buffer[0], ( DWORD) buffer.size(), &read, NULL) && read > 0)
+        {
+        }
+    });
+
+    int fd = _open_osfhandle(( intptr_t) writeEnd, 0);
+    BenchmarkTimer timer;
+    if (strcmp(variant, "write") == 0)
+    {
+        FILE* file = _fdopen(fd, "wb");
+        timer.start();
+        for (int i = 0; i < frames; ++i)
+        {
+            fwrite(scene.frame(i), sizeof(uint16_t), DS_WIDTH * DS_HEIGHT * 2, file);
+        }
+        fclose(file);
+    }
+    else
+    {
+        pipe_format format;
+        PipeOutput::parseFormat(variant, &format);
+        char target[32];
+        snprintf(target, sizeof(target), "fd:%d", fd);
+        PipeOutput* output = new PipeOutput(target, format);
+        _close(fd);
+
+        // Published frames, as the capture loop leaves them
+        FramePool pool(BENCH_SOURCE_FRAMES);
+        std::vector<FrameRef> published;
+        for (int i = 0; i < BENCH_SOURCE_FRAMES; ++i)
+        {
+            Frame* frame = pool.acquire();
+            memcpy(frame->pixels, scene.frame(i), DS_WIDTH * DS_HEIGHT * 2 * sizeof(uint16_t));
+            published.push_back(FrameRef(frame));
+        }
+
+        timer.start();
+        for (int i = 0; i < frames; ++i)
+        {
+            output->consumeFrame(published[i % BENCH_SOURCE_FRAMES]);
+        }
+        delete output;
+    }
+    reader.join();
+    timer.stop(&result);
+    CloseHandle(readEnd);
+    return result;
+}
+
+static BenchmarkResult benchEncodeSplit(const SceneFrames& scene, const char* preset, int frames)
+{
+    BenchmarkResult result = {"split", preset, frames};
+    BenchmarkTimer timer;
+
+    timer.start();
+    {
+        VideoEncoder top(preset, NULL, EncodeTopScreen);
+        VideoEncoder bottom(preset, NULL, EncodeBottomScreen);
+        std::thread bottomThread([&]()
+        {
+            for (int i = 0; i < frames; ++i)
+            {
+                bottom.sendFrame(scene.frame(i), i);
+            }
+        });
+        for (int i = 0; i < frames; ++i)
+        {
+            top.sendFrame(scene.frame(i), i);
+        }
+        bottomThread.join();
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// One sink of a synthetic pipeline, as given to FrameBus::addSink
+struct PipelineSink
+{
+    const char* name;
+    FrameSink* sink;
+    int queueDepth;
+    drop_policy policy;
+    thread_role role;
+};
+
+// Captures frames of a synthetic scene into a frame pool and publishes them on
+// a frame bus to the sinks, timing from starting capture to stopping the bus.
+// Paced, the scene is captured like the device and sinks that fall behind
+// drop frames; otherwise it runs as fast as the sinks take frames, waiting
+// for them rather than dropping. With warmupFrames, allocations and libav
+// buffer references are counted from that frame until every frame has been
+// handed back. onFrame, if set, is called before each frame is captured.
+// metrics, if set, watches the capture and the bus while they run.
+static BenchmarkResult runSyntheticPipeline(const std::vector<PipelineSink>& sinks, int frames, synthetic_scene scene,
+                                            bool paced, int poolFrames, int warmupFrames = -1,
+                                            const std::function<void(int)>& onFrame = NULL,
+                                            MetricsServer* metrics = NULL)
+{
+    BenchmarkResult result = {"", "", frames};
+    uint64_t warmAllocations = 0;
+    uint64_t warmAvBufferRefs = 0;
+    BenchmarkTimer timer;
+
+    timer.start();
+    {
+        DSCapture capture(scene, paced);
+        FramePool pool(poolFrames);
+        FrameBus bus;
+        for (const PipelineSink& sink : sinks)
+        {
+            bus.addSink(sink.name, sink.sink, sink.queueDepth, sink.policy, sink.role);
+        }
+
+        bus.start();
+        if (metrics)
+        {
+            metrics->watchCapture(&capture);
+            metrics->watchFrameBus(&bus);
+            metrics->start();
+        }
+        capture.startCapture();
+        int lastFrame = -1;
+        for (int i = 0; i < frames;)
+        {
+            if (i != lastFrame)
+            {
+                lastFrame = i;
+                if (i == warmupFrames)
+                {
+                    warmAllocations = allocationCount();
+                    warmAvBufferRefs = avBufferRefCount();
+                }
+                if (onFrame)
+                    onFrame(i);
+            }
+
+            Frame* frame = pool.acquire();
+            if (!frame)
+            {
+                // A sink is behind; wait for it rather than dropping
+                std::this_thread::yield();
+                continue;
+            }
+
+            FrameRef ref(frame);
+            if (capture.grabFrame(frame->pixels, &frame->info))
+            {
+                frame->number = i++;
+                bus.publish(ref);
+            }
+            else if (paced)
+            {
+                SDL_Delay(1);
+            }
+        }
+        if (warmupFrames >= 0)
+        {
+            while (pool.available() < poolFrames)
+            {
+                std::this_thread::yield();
+            }
+            result.allocations = ( int64_t) (allocationCount() - warmAllocations);
+            result.avBufferRefs = ( int64_t) (avBufferRefCount() - warmAvBufferRefs);
+        }
+
+        if (metrics)
+        {
+            metrics->stop();
+        }
+        capture.endCapture();
+        bus.stop();
+        result.dropped = 0;
+        for (int i = 0; i < bus.sinkCount(); ++i)
+        {
+            result.dropped += ( int64_t) bus.sinkStats(i).dropped;
+        }
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// Capture thread, frame pool, frame bus and the default encoder, as fast as they
+// will go. Allocations are counted once the pipeline has warmed up.
+static BenchmarkResult benchPipeline(synthetic_scene scene, int frames)
+{
+    const int poolFrames = 32;
+    const int warmupFrames = frames / 4;
+    VideoEncoder encoder("ultrafast", NULL);
+
+    // The encoder's queue is never full, the pool runs out first
+    BenchmarkResult result = runSyntheticPipeline({{"encoder", &encoder, poolFrames, DropNewest, ThreadEncoder}},
+                                                  frames, scene, false, poolFrames, warmupFrames);
+    result.stage = "pipeline";
+    result.dropped = -1;
+
+    // Pooled buffers are lent to libav without making a reference, so any is
+    // a regression. The reference avcodec_send_frame itself takes is made with
+    // av_malloc inside libav and can't be counted.
+    if (result.avBufferRefs != 0)
+        result.failure = "made " + std::to_string(result.avBufferRefs) + " libav buffer references for " +
+                         std::to_string(frames - warmupFrames) + " frames, expected none";
+    return result;
+}
+
+// The full-motion scene, paced like the device, through an encoder that adapts
+// its quality. Starved, every core is kept busy by other threads as well, and
+// the encoder must step down far enough to drop no more than the budget.
+// Recovering, the cores are starved for the first half and then freed, and the
+// encoder must step down and then back up again.
+static BenchmarkResult benchAdaptive(int frames, const char* variant)
+{
+    const int poolFrames = 64;
+    bool recovering = strcmp(variant, "recovering") == 0;
+    int busyThreads = ( int) std::thread::hardware_concurrency();
+    if (recovering)
+    {
+        // Long enough for the controller to step down, then hold calm for long enough to step up
+        frames = std::max(frames, 2 * BENCH_RECOVERY_PHASE_FRAMES);
+        busyThreads *= BENCH_RECOVERY_LOAD;
+    }
+
+    CpuLoad* load = new CpuLoad(strcmp(variant, "idle") == 0 ? 0 : busyThreads);
+    VideoEncoder encoder("ultrafast", NULL);
+    encoder.enableAdaptiveQuality(variant);
+    BenchmarkResult result = runSyntheticPipeline({{"encoder", &encoder, 16, DropOldest, ThreadEncoder}}, frames,
+                                                  SceneFullMotion, true, poolFrames, -1, [&](int frame) {
+                                                      if (recovering && frame == frames / 2)
+                                                      {
+                                                          delete load;
+                                                          load = NULL;
+                                                      }
+                                                  });
+    delete load;
+    result.stage = "adaptive";
+    result.variant = variant;
+    encoder.reportQuality();
+
+    QualityController* quality = encoder.qualityController();
+    if (strcmp(variant, "starved") == 0 && result.dropped > frames * BENCH_ADAPTIVE_DROP_BUDGET)
+        result.failure = "dropped " + std::to_string(result.dropped) + " of " + std::to_string(frames) + " frames";
+    else if (recovering && quality->lowestLevelIndex() == QUALITY_START_LEVEL)
+        result.failure = "never stepped down while starved";
+    else if (recovering && quality->levelIndex() == quality->lowestLevelIndex())
+        result.failure = "never stepped back up once the load was removed";
+    return result;
+}
+
+// The full-motion scene, paced like the device, encoded at 1 to MAX_RENDITIONS
+// bitrates. Shared converts each frame once for every encoder through a
+// RenditionSet; separate is one ordinary encoder per bitrate, each converting
+// for itself. CPU per frame shows what every added rendition costs.
+static BenchmarkResult benchRenditions(int count, bool shared, int frames)
+{
+    const int poolFrames = 64;
+    RenditionSet renditions;
+    std::vector<VideoEncoder*> encoders;
+    std::vector<PipelineSink> sinks;
+    for (int i = 0; i < count; ++i)
+    {
+        if (shared)
+        {
+            RenditionSettings settings;
+            settings.bitRate = renditionBitRates[i] * 1000;
+            renditions.addRendition(settings);
+        }
+        else
+        {
+            EncoderFormat format;
+            format.bitRate = renditionBitRates[i] * 1000;
+            encoders.push_back(new VideoEncoder("ultrafast", NULL, EncodeBothScreens, false, format));
+            sinks.push_back({"encoder", encoders.back(), 16, DropOldest, ThreadEncoder});
+        }
+    }
+    if (shared)
+    {
+        renditions.start();
+        sinks.push_back({"renditions", &renditions, 4, DropOldest, ThreadWorker});
+    }
+
+    BenchmarkResult result = runSyntheticPipeline(sinks, frames, SceneFullMotion, true, poolFrames);
+    result.stage = "renditions";
+    result.variant = (shared ? "shared/" : "separate/") + std::to_string(count);
+    if (shared)
+    {
+        // A frame the renditions sink dropped is lost to every rendition
+        renditions.stop();
+        result.dropped = result.dropped * count + ( int64_t) renditions.droppedFrames();
+    }
+    for (VideoEncoder* encoder : encoders)
+    {
+        delete encoder;
+    }
+    return result;
+}
+
+// Fetches GET /metrics from a MetricsServer over loopback
+static bool scrapeMetrics(int port, std::string* body)
+{
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(( u_short) port);
+    if (s == INVALID_SOCKET || connect(s, ( sockaddr*) &address, sizeof(address)) == SOCKET_ERROR)
+    {
+        if (s != INVALID_SOCKET)
+            closesocket(s);
+        return false;
+    }
+
+    const char* request = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(s, request, ( int) strlen(request), 0);
+    std::string response;
+    char buffer[4096];
+    int received;
+    while ((received = recv(s, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, received);
+    }
+    closesocket(s);
+
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (response.compare(0, 12, "HTTP/1.0 200") != 0 || headerEnd == std::string::npos)
+        return false;
+    *body = response.substr(headerEnd + 4);
+    return true;
+}
+
+// The value of one sample, e.g. kdscap_encoded_frames_total{encoder="bench"}
+static bool metricValue(const std::string& body, const char* sample, double* value)
+{
+    std::string line = "\n" + std::string(sample) + " ";
+    size_t at = body.find(line);
+    if (at == std::string::npos)
+        return false;
+    *value = strtod(body.c_str() + at + line.size(), NULL);
+    return true;
+}
+
+// The full-motion scene, paced like the device, through an encoder while a
+// MetricsServer watches, scraped over loopback a few times along the way.
+// Fails unless every scrape succeeds and the capture, sink and encoder
+// counters are there and go up between scrapes. Latency is the scrape time.
+static BenchmarkResult benchMetrics(int frames)
+{
+    static const char* samples[] = {
+        "kdscap_frames_captured_total",
+        "kdscap_capture_bytes_read_total",
+        "kdscap_usb_transfer_seconds_count",
+        "kdscap_sink_delivered_frames_total{sink=\"encoder\"}",
+        "kdscap_encoded_frames_total{encoder=\"bench\"}",
+        "kdscap_encoded_bytes_total{encoder=\"bench\"}",
+    };
+    const int numSamples = sizeof(samples) / sizeof(samples[0]);
+
+    VideoEncoder encoder("ultrafast", NULL);
+    MetricsServer server(BENCH_METRICS_PORT);
+    server.watchEncoder("bench", encoder.metrics());
+
+    std::string failure;
+    double last[numSamples] = {};
+    double totalMs = 0.0, maxMs = 0.0;
+    int scrapes = 0;
+    int interval = std::max(frames / BENCH_METRICS_SCRAPES, 1);
+    auto scrape = [&](int frame) {
+        if (frame == 0 || frame % interval != 0 || !failure.empty())
+            return;
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        std::string body;
+        if (!scrapeMetrics(BENCH_METRICS_PORT, &body))
+        {
+            failure = "could not scrape /metrics";
+            return;
+        }
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            double value;
+            if (!metricValue(body, samples[i], &value))
+                failure = std::string(samples[i]) + " is missing";
+            else if (scrapes > 0 && value <= last[i])
+                failure = std::string(samples[i]) + " didn't go up between scrapes";
+            else
+                last[i] = value;
+        }
+        ++scrapes;
+    };
+
+    BenchmarkResult result = runSyntheticPipeline({{"encoder", &encoder, 16, DropOldest, ThreadEncoder}}, frames,
+                                                  SceneFullMotion, true, 64, -1, scrape, &server);
+    result.stage = "metrics";
+    result.variant = "scrape";
+    result.failure = failure;
+    if (failure.empty() && scrapes < 2)
+        result.failure = "only scraped " + std::to_string(scrapes) + " times";
+    result.latencyMs = scrapes ? totalMs / scrapes : 0.0;
+    result.maxLatencyMs = maxMs;
+    return result;
+}
+
+// What a live stream subscriber made of the stream
+struct LiveSubscription
+{
+    bool opened = false;
+    bool hasVideo = false;
+    int framesDecoded = 0;
+    int decodeErrors = 0;
+};
+
+// Reads the live stream the way ffplay would, demuxing it and decoding the
+// video until the stream is closed
+static void subscribeLive(int port, LiveSubscription* subscription)
+{
+    std::string url = "tcp://127.0.0.1:" + std::to_string(port);
+    AVDictionary* options = NULL;
+    av_dict_set(&options, "rw_timeout", std::to_string(BENCH_LIVE_TIMEOUT_MS * 1000).c_str(), 0);
+    AVFormatContext* formatContext = NULL;
+    int result = avformat_open_input(&formatContext, url.c_str(), NULL, &options);
+    av_dict_free(&options);
+    if (result < 0)
+        return;
+    subscription->opened = true;
+
+    const AVCodec* codec = NULL;
+    AVCodecContext* codecContext = NULL;
+    int videoStream = -1;
+    if (avformat_find_stream_info(formatContext, NULL) >= 0)
+        videoStream = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (videoStream >= 0)
+    {
+        codecContext = avcodec_alloc_context3(codec);
+        subscription->hasVideo = codecContext
+            && avcodec_parameters_to_context(codecContext, formatContext->streams[videoStream]->codecpar) >= 0
+            && avcodec_open2(codecContext, codec, NULL) >= 0;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    bool reading = subscription->hasVideo;
+    while (reading)
+    {
+        // At the end a NULL packet drains the decoder
+        reading = av_read_frame(formatContext, packet) >= 0;
+        if (reading && packet->stream_index != videoStream)
+        {
+            av_packet_unref(packet);
+            continue;
+        }
+        if (avcodec_send_packet(codecContext, reading ? packet : NULL) < 0)
+            ++subscription->decodeErrors;
+        av_packet_unref(packet);
+
+        while (true)
+        {
+            int received = avcodec_receive_frame(codecContext, frame);
+            if (received < 0)
+            {
+                if (received != AVERROR(EAGAIN) && received != AVERROR_EOF)
+                    ++subscription->decodeErrors;
+                break;
+            }
+            ++subscription->framesDecoded;
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+}
+
+// The full-motion scene and a tone, encoded in real time and streamed over
+// loopback to several subscribers that each demux and decode it. Fails unless
+// every subscriber gets a stream it can decode. Dropped is the most frames any
+// one of them missed, e.g. by being skipped ahead to a keyframe.
+static BenchmarkResult benchLive(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"live", std::to_string(BENCH_LIVE_SUBSCRIBERS) + " subscribers", frames};
+    LiveSubscription subscriptions[BENCH_LIVE_SUBSCRIBERS];
+    std::vector<std::thread> subscribers;
+    BenchmarkTimer timer;
+
+    avformat_network_init();
+    timer.start();
+    {
+        VideoEncoder* encoder = new VideoEncoder("ultrafast", NULL);
+        AudioRecorder* audio = new AudioRecorder(NULL, false);
+        LiveStream* live = new LiveStream(BENCH_LIVE_PORT, NULL, encoder->codecContext(), audio->codecContext());
+        encoder->setPacketSink(live);
+        audio->setPacketSink(live);
+
+        for (int i = 0; i < BENCH_LIVE_SUBSCRIBERS; ++i)
+        {
+            subscribers.emplace_back(subscribeLive, BENCH_LIVE_PORT, &subscriptions[i]);
+        }
+        uint32_t waitStart = SDL_GetTicks();
+        while (live->subscriberCount() < BENCH_LIVE_SUBSCRIBERS && SDL_GetTicks() - waitStart < BENCH_LIVE_TIMEOUT_MS)
+        {
+            SDL_Delay(1);
+        }
+
+        int samplesPerCallback = audio->codecContext()->frame_size;
+        std::vector<float> stream(samplesPerCallback * 2);
+        int64_t samples = 0;
+        for (int i = 0; i < frames; ++i)
+        {
+            encoder->sendFrame(scene.frame(i), i);
+            while (samples < (i + 1) * BENCH_AUDIO_RATE / DS_FRAME_RATE)
+            {
+                for (int s = 0; s < samplesPerCallback; ++s, ++samples)
+                {
+                    stream[s * 2] = stream[s * 2 + 1] = ( float) sin(samples * 2.0 * 3.14159265358979 * 440.0 / BENCH_AUDIO_RATE) * 0.5f;
+                }
+                audio->recordingCallback(( uint8_t*) &stream[0], ( int) (stream.size() * sizeof(float)));
+            }
+            SDL_Delay(( uint32_t) (1000 / DS_FRAME_RATE));
+        }
+
+        // Flushing the encoders ends the stream, and closing it disconnects the subscribers
+        delete encoder;
+        delete audio;
+        delete live;
+    }
+    for (std::thread& subscriber : subscribers)
+    {
+        subscriber.join();
+    }
+    timer.stop(&result);
+
+    char failure[128] = "";
+    result.dropped = 0;
+    for (int i = 0; i < BENCH_LIVE_SUBSCRIBERS && !failure[0]; ++i)
+    {
+        const LiveSubscription& subscription = subscriptions[i];
+        if (!subscription.opened)
+            snprintf(failure, sizeof(failure), "subscriber %d could not open the stream", i);
+        else if (!subscription.hasVideo)
+            snprintf(failure, sizeof(failure), "subscriber %d found no video it could decode", i);
+        else if (subscription.decodeErrors > 0)
+            snprintf(failure, sizeof(failure), "subscriber %d had %d decode errors", i, subscription.decodeErrors);
+        else if (subscription.framesDecoded < frames / 2)
+            snprintf(failure, sizeof(failure), "subscriber %d decoded only %d of %d frames", i, subscription.framesDecoded, frames);
+
+        if (frames - subscription.framesDecoded > result.dropped)
+            result.dropped = frames - subscription.framesDecoded;
+    }
+    result.failure = failure;
+    return result;
+}
+
+// How long after capture a shared memory reader got each frame
+struct FrameShareLatency
+{
+    int framesRead = 0;
+    uint64_t framesMissed = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+};
+
+static void readFrameShare(FrameShareReader* reader, int frames, FrameShareLatency* latency)
+{
+    FrameShareFrame* frame = new FrameShareFrame;
+    while (latency->framesRead + latency->framesMissed < ( uint64_t) frames && reader->waitForFrame(frame, 1000))
+    {
+        ++latency->framesRead;
+        latency->framesMissed += frame->framesMissed;
+        latency->totalMs += frame->latencyMs;
+        if (frame->latencyMs > latency->maxMs)
+            latency->maxMs = frame->latencyMs;
+    }
+    delete frame;
+}
+
+// The full-motion scene published to shared memory. Publish is unpaced with
+// nobody reading, and times the publish itself. Read is paced like the device
+// with a reader waiting on another thread, and measures how long after
+// capture the reader has its copy; dropped is frames it never saw.
+static BenchmarkResult benchFrameShare(const SceneFrames& scene, bool reading, int frames)
+{
+    BenchmarkResult result = {"frameshare", reading ? "read" : "publish", frames};
+    FrameShareLatency latency;
+    DSFrameInfo info = {};
+    memset(info.lineMask, 0xff, sizeof(info.lineMask));
+    BenchmarkTimer timer;
+
+    FrameSharePublisher publisher;
+    FrameShareReader reader;
+    std::thread readerThread;
+    if (reading)
+    {
+        if (!reader.open())
+            throw std::runtime_error("Could not open shared frame memory");
+        readerThread = std::thread(readFrameShare, &reader, frames, &latency);
+    }
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        info.captureTime = SDL_GetPerformanceCounter();
+        publisher.publish(scene.frame(i), info);
+        if (reading)
+            SDL_Delay(( uint32_t) (1000 / DS_FRAME_RATE));
+    }
+    if (reading)
+        readerThread.join();
+    timer.stop(&result);
+
+    if (reading)
+    {
+        result.dropped = ( int64_t) latency.framesMissed;
+        result.latencyMs = latency.framesRead ? latency.totalMs / latency.framesRead : 0.0;
+        result.maxLatencyMs = latency.maxMs;
+    }
+    return result;
+}
+
+// A burst of the full-motion scene saved as PNGs into a scratch directory,
+// from when it's asked for until the last file is written. Fails if the
+// workers save it slower than the device captured it.
+static BenchmarkResult benchScreenshots(const SceneFrames& scene)
+{
+    BenchmarkResult result = {"screenshot", "burst", BENCH_SCREENSHOT_BURST};
+    char tempPath[MAX_PATH];
+    DWORD length = GetTempPath(MAX_PATH, tempPath);
+    if (length == 0 || length > MAX_PATH)
+        throw std::runtime_error("Could not find the temporary directory");
+    std::string directory = std::string(tempPath) + "kdscap-bench-screenshots";
+    CreateDirectory(directory.c_str(), NULL);
+
+    BenchmarkTimer timer;
+    unsigned int saved;
+    {
+        FramePool pool(BENCH_SCREENSHOT_BURST); // Outlives the screenshotter's references into it
+        Screenshotter screenshotter(BENCH_SCREENSHOT_BURST, directory.c_str());
+        for (int i = 0; i < BENCH_SCREENSHOT_BURST; ++i)
+        {
+            Frame* frame = pool.acquire();
+            memcpy(frame->pixels, scene.frame(i), DS_WIDTH * DS_HEIGHT * 2 * sizeof(uint16_t));
+            screenshotter.consumeFrame(FrameRef(frame));
+        }
+
+        timer.start();
+        screenshotter.burst();
+        screenshotter.waitForJobs();
+        timer.stop(&result);
+        saved = screenshotter.savedCount();
+    }
+
+    std::string pattern = directory + "\\*.png";
+    WIN32_FIND_DATA found;
+    HANDLE search = FindFirstFile(pattern.c_str(), &found);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            DeleteFile((directory + "\\" + found.cFileName).c_str());
+        } while (FindNextFile(search, &found));
+        FindClose(search);
+    }
+    RemoveDirectory(directory.c_str());
+
+    double fps = BENCH_SCREENSHOT_BURST / result.wallSeconds;
+    if (saved != BENCH_SCREENSHOT_BURST)
+        result.failure = "saved " + std::to_string(saved) + " of " + std::to_string(BENCH_SCREENSHOT_BURST) + " frames";
+    else if (fps < BENCH_SCREENSHOT_MIN_FPS)
+        result.failure = "saved a burst at " + std::to_string(( int) fps) + " fps, below " + std::to_string(BENCH_SCREENSHOT_MIN_FPS);
+    return result;
+}
+
+// Frames from the unpaced full-motion scene taken straight from DSCapture,
+// then through the library's C API by waiting for them and by callback.
+// Shows what the API costs on top of de-swizzling.
+struct DeliveryCount
+{
+    std::atomic<int> frames;
+    int warmupFrames;
+    uint64_t warmAllocations;
+};
+
+static void countDelivery(const kdscap_frame* frame, void* user)
+{
+    DeliveryCount* count = ( DeliveryCount*) user;
+    if (count->frames == count->warmupFrames)
+        count->warmAllocations = allocationCount();
+    ++count->frames;
+}
+
+static BenchmarkResult benchDelivery(const char* variant, int frames)
+{
+    BenchmarkResult result = {"delivery", variant, frames};
+    const int warmupFrames = frames / 4;
+    uint64_t warmAllocations = 0;
+    BenchmarkTimer timer;
+
+    if (strcmp(variant, "direct") == 0)
+    {
+        DSCapture capture(SceneFullMotion, false);
+        FrameSlab memory(FrameSlab::align(DS_LCD_WIDTH * DS_LCD_HEIGHT * 2 * sizeof(uint16_t)));
+        DSFrameInfo info;
+
+        timer.start();
+        capture.startCapture();
+        for (int i = 0; i < frames;)
+        {
+            if (i == warmupFrames)
+                warmAllocations = allocationCount();
+            if (capture.waitForFrame(1000) && capture.grabFrame(( uint16_t*) memory.data(), &info))
+                ++i;
+        }
+        result.allocations = ( int64_t) (allocationCount() - warmAllocations);
+        capture.endCapture();
+        timer.stop(&result);
+        return result;
+    }
+
+    kdscap_capture* capture = kdscap_open_synthetic("fullmotion", 0);
+    if (!capture)
+        throw std::runtime_error(kdscap_last_error());
+
+    if (strcmp(variant, "pull") == 0)
+    {
+        kdscap_frame frame;
+        timer.start();
+        kdscap_start(capture);
+        for (int i = 0; i < frames;)
+        {
+            if (i == warmupFrames)
+                warmAllocations = allocationCount();
+            if (kdscap_wait_frame(capture, 1000, &frame) > 0)
+                ++i;
+        }
+        result.allocations = ( int64_t) (allocationCount() - warmAllocations);
+    }
+    else
+    {
+        DeliveryCount count;
+        count.frames = 0;
+        count.warmupFrames = warmupFrames;
+        count.warmAllocations = 0;
+        kdscap_set_frame_callback(capture, countDelivery, &count);
+
+        timer.start();
+        kdscap_start(capture);
+        while (count.frames < frames)
+        {
+            std::this_thread::yield();
+        }
+        result.allocations = ( int64_t) (allocationCount() - count.warmAllocations);
+    }
+
+    kdscap_stop(capture);
+    timer.stop(&result);
+    kdscap_close(capture);
+    return result;
+}
+
+int runBenchmark(const char* outputPath, int frames)
+{
+    std::vector<BenchmarkResult> results;
+
+    for (int s = 0; s < NUM_SYNTHETIC_SCENES; ++s)
+    {
+        synthetic_scene scene = ( synthetic_scene) s;
+        std::string name = SyntheticSource::sceneName(scene);
+        SceneFrames sceneFrames;
+        generateScene(scene, &sceneFrames);
+
+        printf("Benchmarking %s scene\n", name.c_str());
+
+        results.push_back(benchDeswizzle(sceneFrames, frames));
+        results.back().variant = name;
+        results.push_back(benchRecover(sceneFrames, frames));
+        results.back().variant = name;
+
+        results.push_back(benchConvertYUV(sceneFrames, frames));
+        results.back().variant += "/" + name;
+        results.push_back(benchConvertRGB(sceneFrames, frames));
+        results.back().variant += "/" + name;
+        results.push_back(benchAnalyze(sceneFrames, frames));
+        results.back().variant = name;
+        for (int v = 0; v < NUM_PIPE_VARIANTS; ++v)
+        {
+            results.push_back(benchPipe(sceneFrames, pipeVariants[v], frames));
+            results.back().variant += "/" + name;
+        }
+
+        for (int p = 0; p < NUM_ENCODER_PRESETS; ++p)
+        {
+            results.push_back(benchEncode(sceneFrames, encoderPresets[p], frames));
+            results.back().variant += "/" + name;
+            results.push_back(benchEncodeSplit(sceneFrames, encoderPresets[p], frames));
+            results.back().variant += "/" + name;
+        }
+
+        results.push_back(benchPipeline(scene, frames));
+        results.back().variant = name;
+    }
+
+    printf("Benchmarking audio\n");
+    results.push_back(benchAudio(frames));
+
+    printf("Benchmarking adaptive quality, in real time\n");
+    results.push_back(benchAdaptive(frames, "idle"));
+    results.push_back(benchAdaptive(frames, "starved"));
+    results.push_back(benchAdaptive(frames, "recovering"));
+
+    printf("Benchmarking renditions, in real time\n");
+    for (int count = 1; count <= MAX_RENDITIONS; ++count)
+    {
+        results.push_back(benchRenditions(count, true, frames));
+        results.push_back(benchRenditions(count, false, frames));
+    }
+
+    printf("Benchmarking live streaming, in real time\n");
+    {
+        SceneFrames sceneFrames;
+        generateScene(SceneFullMotion, &sceneFrames);
+        results.push_back(benchLive(sceneFrames, frames));
+
+        printf("Benchmarking shared memory frames\n");
+        results.push_back(benchFrameShare(sceneFrames, false, frames));
+        results.push_back(benchFrameShare(sceneFrames, true, frames));
+
+        printf("Benchmarking screenshot bursts\n");
+        results.push_back(benchScreenshots(sceneFrames));
+    }
+
+    printf("Benchmarking metrics scrapes, in real time\n");
+    results.push_back(benchMetrics(frames));
+
+    printf("Benchmarking frame delivery\n");
+    results.push_back(benchDelivery("direct", frames));
+    results.push_back(benchDelivery("pull", frames));
+    results.push_back(benchDelivery("callback", frames));
+
+    printResults(results);
+
+    FILE* file;
+    if (fopen_s(&file, outputPath, "w") != 0)
+    {
+        printf("Could not open %s\n", outputPath);
+        return 1;
+    }
+    writeResults(file, frames, results);
+    fclose(file);
+
+    printf("Wrote benchmark results to %s\n", outputPath);
+
+    printf("Buffer references are only counted outside libav; avcodec_send_frame still allocates one per frame itself\n");
+
+    int exitCode = 0;
+    for (const BenchmarkResult& r : results)
+    {
+        if (r.allocations > 0)
+        {
+            printf("%s/%s made %lld allocations once warmed up, expected none\n", r.stage.c_str(), r.variant.c_str(), ( long long) r.allocations);
+            exitCode = 1;
+        }
+        if (!r.failure.empty())
+        {
+            printf("%s/%s failed: %s\n", r.stage.c_str(), r.variant.c_str(), r.failure.c_str());
+            exitCode = 1;
+        }
+    }
+    return exitCode;
+}
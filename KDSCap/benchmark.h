@@ -0,0 +1,6 @@
+#pragma once
+
+// Runs every stage of the capture pipeline against synthetic frames and
+// writes the results as JSON to outputPath.
+// Returns the process exit code.
+int runBenchmark(const char* outputPath, int frames);
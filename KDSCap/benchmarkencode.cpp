@@ -0,0 +1,48 @@
+#include <cmath>
+#include "audiorecorder.h"
+#include "benchmarkstages.h"
+#include "videoencoder.h"
+
+// Includes flushing the encoder, so lookahead and B-frames are paid for
+BenchmarkResult benchEncode(const SceneFrames& scene, const char* preset, int frames)
+{
+    BenchmarkResult result = {"encode", preset, frames};
+    BenchmarkTimer timer;
+
+    timer.start();
+    {
+        VideoEncoder encoder(preset, NULL);
+        for (int i = 0; i < frames; ++i)
+        {
+            encoder.sendFrame(scene.frame(i), i);
+        }
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// Encodes as much audio as plays during the given number of video frames
+BenchmarkResult benchAudio(int frames)
+{
+    BenchmarkResult result = {"audio", "mp3", frames};
+    BenchmarkTimer timer;
+
+    timer.start();
+    {
+        AudioRecorder recorder(NULL, false);
+        int samplesPerCallback = recorder.codecContext()->frame_size;
+        int callbacks = ( int) ceil(frames * BENCH_AUDIO_RATE / DS_FRAME_RATE / samplesPerCallback);
+        std::vector<float> stream(samplesPerCallback * 2);
+
+        for (int i = 0, t = 0; i < callbacks; ++i)
+        {
+            for (int s = 0; s < samplesPerCallback; ++s, ++t)
+            {
+                stream[s * 2] = stream[s * 2 + 1] = ( float) sin(t * 2.0 * 3.14159265358979 * 440.0 / BENCH_AUDIO_RATE) * 0.5f;
+            }
+            recorder.recordingCallback(( uint8_t*) &stream[0], ( int) (stream.size() * sizeof(float)));
+        }
+    }
+    timer.stop(&result);
+    return result;
+}
@@ -0,0 +1,145 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+#include <chrono>
+#include "benchmarkstages.h"
+#include "pixelconvert.h"
+
+const char* encoderPresets[NUM_ENCODER_PRESETS] = {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium"};
+
+void BenchmarkTimer::start()
+{
+    startCpu = processCpuSeconds();
+    startWall = wallSeconds();
+}
+
+void BenchmarkTimer::stop(BenchmarkResult* result)
+{
+    result->wallSeconds = wallSeconds() - startWall;
+    result->cpuSeconds = processCpuSeconds() - startCpu;
+}
+
+double BenchmarkTimer::wallSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double BenchmarkTimer::processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0.0;
+
+    // FILETIMEs count 100 ns intervals
+    uint64_t k = (( uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = (( uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) / 1e7;
+#else
+    timespec cpu;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu) != 0)
+        return 0.0;
+    return cpu.tv_sec + cpu.tv_nsec / 1e9;
+#endif
+}
+
+void generateScene(synthetic_scene scene, SceneFrames* frames)
+{
+    SyntheticSource source(scene);
+    frames->payloads.resize(DS_FRAME_SIZE * BENCH_SOURCE_FRAMES);
+    frames->infos.resize(DS_INFO_SIZE * BENCH_SOURCE_FRAMES);
+    frames->pixels.resize(BENCH_FRAME_PIXELS * BENCH_SOURCE_FRAMES);
+
+    for (int i = 0; i < BENCH_SOURCE_FRAMES; ++i)
+    {
+        source.generate(&frames->payloads[i * DS_FRAME_SIZE], &frames->infos[i * DS_INFO_SIZE]);
+        deswizzleFrame(frames->payload(i), frames->info(i), ( uint16_t*) frames->frame(i));
+    }
+}
+
+BenchmarkResult benchDeswizzle(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"deswizzle", "", frames};
+    std::vector<uint16_t> output(BENCH_FRAME_PIXELS);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        deswizzleFrame(scene.payload(i), scene.info(i), &output[0]);
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// Every frame cut off halfway and patched from the previous one
+BenchmarkResult benchRecover(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"recover", "", frames};
+    std::vector<uint16_t> output(BENCH_FRAME_PIXELS);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        deswizzlePartialFrame(scene.payload(i), expectedPayloadBytes(scene.info(i)) / 2, scene.info(i),
+                              scene.frame(i + BENCH_SOURCE_FRAMES - 1), &output[0]);
+    }
+    timer.stop(&result);
+    return result;
+}
+
+// RGB565 to RGB24, as for screenshots
+BenchmarkResult benchConvertRGB(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"convert", "rgb24", frames};
+    std::vector<uint8_t> output(BENCH_FRAME_PIXELS * 3);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        convertRGB565ToRGB24(scene.frame(i), &output[0], BENCH_FRAME_PIXELS);
+    }
+    timer.stop(&result);
+    return result;
+}
+
+void printResults(const std::vector<BenchmarkResult>& results)
+{
+    printf("%-10s %-22s %10s %10s\n", "stage", "variant", "fps", "cpu ms");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& r = results[i];
+        printf("%-10s %-22s %10.1f %10.3f\n", r.stage.c_str(), r.variant.c_str(), r.frames / r.wallSeconds, r.cpuSeconds * 1000.0 / r.frames);
+    }
+}
+
+void writeResults(FILE* file, int frames, const std::vector<BenchmarkResult>& results)
+{
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frames\": %d,\n", frames);
+    fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& r = results[i];
+        fprintf(file, "    {\"stage\": \"%s\", \"variant\": \"%s\", \"frames\": %d, \"fps\": %.2f, \"wall_ms_per_frame\": %.4f, \"cpu_ms_per_frame\": %.4f",
+                r.stage.c_str(), r.variant.c_str(), r.frames, r.frames / r.wallSeconds,
+                r.wallSeconds * 1000.0 / r.frames, r.cpuSeconds * 1000.0 / r.frames);
+        if (r.allocations >= 0)
+            fprintf(file, ", \"steady_state_allocations\": %lld", ( long long) r.allocations);
+        if (r.avBufferRefs >= 0)
+            fprintf(file, ", \"steady_state_av_buffer_refs\": %lld", ( long long) r.avBufferRefs);
+        if (r.dropped >= 0)
+            fprintf(file, ", \"dropped_frames\": %lld", ( long long) r.dropped);
+        if (r.latencyMs >= 0.0)
+            fprintf(file, ", \"latency_ms\": %.4f, \"max_latency_ms\": %.4f", r.latencyMs, r.maxLatencyMs);
+        if (!r.failure.empty())
+            fprintf(file, ", \"failure\": \"%s\"", r.failure.c_str());
+        fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
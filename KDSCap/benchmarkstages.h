@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "dsframe.h"
+#include "syntheticsource.h"
+
+// The benchmark stages KDSCap --benchmark and the portable kdscap_bench in
+// bench/ have in common, so the two time the same code and write the same
+// JSON. The encode stages are in benchmarkencode.cpp, as they need SDL2 and
+// FFmpeg, which kdscap_bench can be built without.
+
+#define BENCH_SOURCE_FRAMES 8
+#define BENCH_AUDIO_RATE 44100
+#define BENCH_FRAME_PIXELS (DS_LCD_WIDTH * DS_LCD_HEIGHT * 2)
+
+#define NUM_ENCODER_PRESETS 6
+extern const char* encoderPresets[NUM_ENCODER_PRESETS];
+
+struct BenchmarkResult
+{
+    BenchmarkResult(const std::string& stage, const std::string& variant, int frames) :
+        stage(stage),
+        variant(variant),
+        frames(frames)
+    {
+    }
+
+    std::string stage;
+    std::string variant;
+    int frames;
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    int64_t allocations = -1;  // Made once warmed up, for stages that count them
+    int64_t avBufferRefs = -1; // libav buffer references made once warmed up, for the same stages
+    int64_t dropped = -1;      // Frames a sink had to drop, for stages paced like a real device
+    std::string failure;       // Why a stage that checks its own output failed
+    double latencyMs = -1.0;   // Mean and worst delay from capture, for stages that measure it
+    double maxLatencyMs = -1.0;
+};
+
+// Measures wall clock and process CPU time between start() and stop().
+// CPU time includes every thread, e.g. the encoder's worker threads.
+class BenchmarkTimer
+{
+public:
+    void start();
+    void stop(BenchmarkResult* result);
+
+private:
+    double startWall;
+    double startCpu;
+
+    static double wallSeconds();
+    static double processCpuSeconds();
+};
+
+// A few consecutive frames of a scene, both as the device sends them and deswizzled
+struct SceneFrames
+{
+    std::vector<uint8_t> payloads;
+    std::vector<uint8_t> infos;
+    std::vector<uint16_t> pixels;
+
+    const uint16_t* payload(int i) const { return ( const uint16_t*) &payloads[(i % BENCH_SOURCE_FRAMES) * DS_FRAME_SIZE]; }
+    const uint8_t* info(int i) const { return &infos[(i % BENCH_SOURCE_FRAMES) * DS_INFO_SIZE]; }
+    const uint16_t* frame(int i) const { return &pixels[(i % BENCH_SOURCE_FRAMES) * BENCH_FRAME_PIXELS]; }
+};
+
+void generateScene(synthetic_scene scene, SceneFrames* frames);
+
+BenchmarkResult benchDeswizzle(const SceneFrames& scene, int frames);
+BenchmarkResult benchRecover(const SceneFrames& scene, int frames);
+BenchmarkResult benchConvertRGB(const SceneFrames& scene, int frames);
+BenchmarkResult benchEncode(const SceneFrames& scene, const char* preset, int frames);
+BenchmarkResult benchAudio(int frames);
+
+void printResults(const std::vector<BenchmarkResult>& results);
+void writeResults(FILE* file, int frames, const std::vector<BenchmarkResult>& results);
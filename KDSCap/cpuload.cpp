@@ -0,0 +1,27 @@
+#include "cpuload.h"
+#include "threadpolicy.h"
+
+CpuLoad::CpuLoad(int threadCount) :
+    running(true)
+{
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.push_back(std::thread([this]() {
+            configureThread(ThreadWorker, "cpu load");
+            volatile uint64_t spins = 0;
+            while (running)
+            {
+                ++spins;
+            }
+        }));
+    }
+}
+
+CpuLoad::~CpuLoad()
+{
+    running = false;
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
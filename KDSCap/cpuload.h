@@ -0,0 +1,17 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Keeps the given number of threads spinning at normal priority until
+// destroyed, to see how capture and encoding hold up on a busy machine
+class CpuLoad
+{
+public:
+    CpuLoad(int threads);
+    ~CpuLoad();
+
+private:
+    std::vector<std::thread> threads;
+    std::atomic<bool> running;
+};
@@ -0,0 +1,135 @@
+#include <SDL.h>
+#include <cmath>
+#include <stdexcept>
+#include "frameanalyzer.h"
+#include "pixelconvert.h"
+
+static const char* kindNames[NUM_FRAME_KINDS] = {"changed", "lag", "duplicate", "partial"};
+
+FrameAnalyzer::FrameAnalyzer(const char* path) :
+    first(true),
+    firstCaptureTime(0),
+    previousCaptureTime(0),
+    previousNumber(0),
+    kindCounts(),
+    framesDropped(0),
+    framesMissed(0),
+    lagRun(0),
+    longestLagRun(0),
+    framesAnalyzed(0),
+    totalAnalysisMs(0.0),
+    maxAnalysisMs(0.0)
+{
+    if (fopen_s(&output, path, "w") != 0)
+    {
+        throw std::runtime_error("Could not open the frame analysis file");
+    }
+    fileBuffer = new char[ANALYSIS_FILE_BUFFER];
+    setvbuf(output, fileBuffer, _IOFBF, ANALYSIS_FILE_BUFFER);
+    ticksToMs = 1000.0 / SDL_GetPerformanceFrequency();
+
+    fprintf(output, "frame,capture_ms,interval_ms,dropped,missed,top_sad,bottom_sad,lines_sent,recovered_lines,kind\n");
+}
+
+FrameAnalyzer::~FrameAnalyzer()
+{
+    fclose(output);
+    delete[] fileBuffer;
+}
+
+void FrameAnalyzer::consumeFrame(const FrameRef& frame)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    analyze(frame->pixels, previousFrame ? previousFrame->pixels : NULL, frame->info, frame->number);
+    previousFrame = frame;
+
+    double ms = (SDL_GetPerformanceCounter() - start) * ticksToMs;
+    ++framesAnalyzed;
+    totalAnalysisMs += ms;
+    if (ms > maxAnalysisMs)
+        maxAnalysisMs = ms;
+}
+
+// Classifies one frame against the one before it and appends it to the
+// timeline. previous is NULL for the first frame, which counts as changed.
+frame_kind FrameAnalyzer::analyze(const uint16_t* pixels, const uint16_t* previous, const DSFrameInfo& info, uint64_t number)
+{
+    const int screenPixels = DS_LCD_WIDTH * DS_LCD_HEIGHT;
+    const double frameMs = 1000.0 / DS_FRAME_RATE;
+
+    uint64_t topSad = 0, bottomSad = 0;
+    double intervalMs = 0.0;
+    uint64_t dropped = 0, missed = 0;
+    if (first)
+    {
+        firstCaptureTime = info.captureTime;
+        first = false;
+    }
+    else
+    {
+        intervalMs = (info.captureTime - previousCaptureTime) * ticksToMs;
+        dropped = number > previousNumber + 1 ? number - previousNumber - 1 : 0;
+
+        // Frame times the capture didn't account for, beyond frames it did capture but dropped
+        uint64_t elapsedFrames = ( uint64_t) llround(intervalMs / frameMs);
+        missed = elapsedFrames > dropped + 1 ? elapsedFrames - dropped - 1 : 0;
+    }
+    if (previous)
+    {
+        topSad = sumAbsDifference(pixels, previous, screenPixels);
+        bottomSad = sumAbsDifference(pixels + screenPixels, previous + screenPixels, screenPixels);
+    }
+
+    int linesSent = 0;
+    for (int i = 0; i < DS_LINE_MASK_SIZE; ++i)
+    {
+        for (uint8_t bits = info.lineMask[i]; bits; bits &= bits - 1)
+            ++linesSent;
+    }
+
+    frame_kind kind = FrameChanged;
+    if (previous && topSad == 0 && bottomSad == 0)
+    {
+        if (info.recoveredLines > 0)
+            kind = FramePartial;
+        else if (intervalMs < frameMs / 2 && dropped == 0)
+            kind = FrameDuplicate;
+        else
+            kind = FrameLag;
+    }
+
+    ++kindCounts[kind];
+    framesDropped += dropped;
+    framesMissed += missed;
+    if (kind == FrameLag)
+    {
+        if (++lagRun > longestLagRun)
+            longestLagRun = lagRun;
+    }
+    else
+    {
+        lagRun = 0;
+    }
+
+    fprintf(output, "%llu,%.3f,%.3f,%llu,%llu,%llu,%llu,%d,%u,%s\n", ( unsigned long long) number,
+            (info.captureTime - firstCaptureTime) * ticksToMs, intervalMs, ( unsigned long long) dropped,
+            ( unsigned long long) missed, ( unsigned long long) topSad, ( unsigned long long) bottomSad,
+            linesSent, ( unsigned int) info.recoveredLines, kindNames[kind]);
+
+    previousCaptureTime = info.captureTime;
+    previousNumber = number;
+    return kind;
+}
+
+void FrameAnalyzer::report()
+{
+    printf("Frame analysis: %llu changed, %llu lag (longest run %u), %llu duplicate, %llu partial, %llu dropped, %llu missed\n",
+           ( unsigned long long) kindCounts[FrameChanged], ( unsigned long long) kindCounts[FrameLag], longestLagRun,
+           ( unsigned long long) kindCounts[FrameDuplicate], ( unsigned long long) kindCounts[FramePartial],
+           ( unsigned long long) framesDropped, ( unsigned long long) framesMissed);
+    if (framesAnalyzed > 0)
+    {
+        printf("  analysis took %.3f ms per frame on average, %.3f ms at most\n",
+               totalAnalysisMs / framesAnalyzed, maxAnalysisMs);
+    }
+}
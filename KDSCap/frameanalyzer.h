@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include "framebus.h"
+
+#define ANALYSIS_FILE_BUFFER (1024 * 1024)
+
+typedef enum
+{
+    FrameChanged = 0, // Either screen differs from the previous frame
+    FrameLag,         // Neither screen changed; the game didn't draw a new frame
+    FrameDuplicate,   // Neither screen changed and it arrived well inside a frame time, so capture saw the same frame twice
+    FramePartial      // Neither screen changed, but lines were patched from the previous frame so it can't be told apart from lag
+} frame_kind;
+#define NUM_FRAME_KINDS 4
+
+// Writes a CSV timeline saying, for every captured frame, whether each screen
+// changed and whether it was a lag or duplicate frame, for checking speedruns
+// without exporting video. Change is the SIMD sum of absolute differences
+// against the previous frame, which is held by reference rather than copied.
+// Each row also has the half-lines the device sent per the frame's line mask,
+// and the lines patched in from the previous frame, which can hide a change.
+// Gaps in the frame numbers or capture times show up as dropped and missed
+// frames. Cheap enough to leave on during live capture.
+class FrameAnalyzer : public FrameSink
+{
+public:
+    FrameAnalyzer(const char* path);
+    ~FrameAnalyzer();
+
+    void consumeFrame(const FrameRef& frame) override;
+    frame_kind analyze(const uint16_t* pixels, const uint16_t* previous, const DSFrameInfo& info, uint64_t number);
+    void report();
+
+private:
+    FILE* output;
+    char* fileBuffer;
+    FrameRef previousFrame;
+
+    bool first;
+    uint64_t firstCaptureTime;
+    uint64_t previousCaptureTime;
+    uint64_t previousNumber;
+    double ticksToMs;
+
+    uint64_t kindCounts[NUM_FRAME_KINDS];
+    uint64_t framesDropped;
+    uint64_t framesMissed;
+    unsigned int lagRun;
+    unsigned int longestLagRun;
+    uint64_t framesAnalyzed;
+    double totalAnalysisMs;
+    double maxAnalysisMs;
+};
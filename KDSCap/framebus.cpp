@@ -0,0 +1,199 @@
+#include <SDL.h>
+#include <cstdio>
+#include "framebus.h"
+
+struct FrameBusSink
+{
+    std::string name;
+    FrameSink* sink;
+    drop_policy policy;
+    stop_policy stopPolicy;
+    thread_role role;
+    std::thread thread;
+
+    // Ring of queued frames, sized once in addSink
+    std::vector<FrameRef> queue;
+    int head = 0;
+    int count = 0;
+    bool stopping = false;
+    uint64_t readyTime = 0; // When a frame was queued for the idle sink
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> lastFrame{0};
+    std::atomic<uint64_t> maxLag{0}; // Only written by publish
+};
+
+FrameBus::FrameBus() :
+    framesPublished(0),
+    poolDrops(0),
+    latestFrame(0),
+    accepting(false),
+    running(false)
+{
+}
+
+FrameBus::~FrameBus()
+{
+    stop();
+    for (FrameBusSink* sink : sinks)
+    {
+        delete sink;
+    }
+}
+
+// Registers a sink. Must be called before start.
+// Its thread is scheduled by role's policy (see threadpolicy.h).
+void FrameBus::addSink(const char* name, FrameSink* sink, int queueDepth, drop_policy policy, thread_role role,
+                       stop_policy stopPolicy)
+{
+    FrameBusSink* busSink = new FrameBusSink();
+    busSink->name = name;
+    busSink->sink = sink;
+    busSink->policy = policy;
+    busSink->stopPolicy = stopPolicy;
+    busSink->role = role;
+    busSink->queue.resize(queueDepth);
+    sinks.push_back(busSink);
+}
+
+void FrameBus::start()
+{
+    running = true;
+    for (FrameBusSink* sink : sinks)
+    {
+        sink->stopping = false;
+        sink->thread = std::thread(&FrameBus::runSink, this, sink);
+    }
+    accepting = true;
+}
+
+// Stops taking frames, then stops the sink threads. Sinks added with
+// StopDrain consume what they have queued first, all at the same time;
+// anything still queued for the others is discarded.
+void FrameBus::stop()
+{
+    if (!running)
+        return;
+
+    accepting = false;
+    for (FrameBusSink* sink : sinks)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            sink->stopping = true;
+        }
+        sink->condition.notify_one();
+    }
+
+    for (FrameBusSink* sink : sinks)
+    {
+        sink->thread.join();
+
+        for (FrameRef& frame : sink->queue)
+        {
+            frame.reset();
+        }
+        sink->head = sink->count = 0;
+    }
+    running = false;
+}
+
+// Queues the frame for every sink. Never waits for a sink to catch up.
+void FrameBus::publish(const FrameRef& frame)
+{
+    if (!accepting)
+        return;
+
+    ++framesPublished;
+    latestFrame = frame->number;
+
+    for (FrameBusSink* sink : sinks)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            int depth = ( int) sink->queue.size();
+
+            if (sink->count == depth)
+            {
+                ++sink->dropped;
+                if (sink->policy == DropNewest)
+                    continue;
+
+                sink->queue[sink->head].reset();
+                sink->head = (sink->head + 1) % depth;
+                --sink->count;
+            }
+
+            if (sink->count == 0)
+                sink->readyTime = SDL_GetPerformanceCounter();
+            sink->queue[(sink->head + sink->count) % depth] = frame;
+            ++sink->count;
+
+            uint64_t lag = frame->number - sink->lastFrame;
+            if (lag > sink->maxLag.load(std::memory_order_relaxed))
+                sink->maxLag.store(lag, std::memory_order_relaxed);
+        }
+        sink->condition.notify_one();
+    }
+}
+
+void FrameBus::runSink(FrameBusSink* sink)
+{
+    configureThread(sink->role, sink->name.c_str());
+    double ticksToMs = 1000.0 / SDL_GetPerformanceFrequency();
+
+    while (true)
+    {
+        FrameRef frame;
+        {
+            std::unique_lock<std::mutex> lock(sink->mutex);
+            bool idle = sink->count == 0;
+            sink->condition.wait(lock, [sink]() { return sink->stopping || sink->count > 0; });
+            if (sink->stopping && (sink->count == 0 || sink->stopPolicy == StopDiscard))
+                break;
+            if (idle)
+                recordWakeDelay((SDL_GetPerformanceCounter() - sink->readyTime) * ticksToMs);
+
+            frame = std::move(sink->queue[sink->head]);
+            sink->head = (sink->head + 1) % ( int) sink->queue.size();
+            --sink->count;
+            sink->sink->queuedFrames = sink->count;
+        }
+
+        sink->sink->consumeFrame(frame);
+        sink->lastFrame = frame->number;
+        ++sink->delivered;
+    }
+}
+
+int FrameBus::sinkCount()
+{
+    return ( int) sinks.size();
+}
+
+// Only reads counters, so a metrics scrape never holds up the sink or publish
+FrameSinkStats FrameBus::sinkStats(int index)
+{
+    FrameBusSink* sink = sinks[index];
+    FrameSinkStats stats;
+    stats.name = sink->name.c_str();
+    stats.delivered = sink->delivered;
+    stats.dropped = sink->dropped;
+    stats.lag = sink->delivered ? latestFrame - sink->lastFrame : latestFrame + 1;
+    stats.maxLag = sink->maxLag.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void FrameBus::report()
+{
+    printf("Frame bus: %llu frames captured, %llu dropped with the frame pool exhausted\n",
+           ( unsigned long long) framesPublished, ( unsigned long long) poolDrops);
+    for (FrameBusSink* sink : sinks)
+    {
+        printf("  %-12s delivered %llu, dropped %llu, max lag %llu frames\n", sink->name.c_str(),
+               ( unsigned long long) sink->delivered, ( unsigned long long) sink->dropped, ( unsigned long long) sink->maxLag.load());
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "framepool.h"
+#include "threadpolicy.h"
+
+typedef enum
+{
+    DropOldest = 0, // Make room by discarding the oldest queued frame
+    DropNewest      // Discard the incoming frame while the queue is full
+} drop_policy;
+
+typedef enum
+{
+    StopDiscard = 0, // Frames still queued when the bus stops are dropped
+    StopDrain        // The sink consumes every queued frame before it stops, e.g. an encoder
+} stop_policy;
+
+// Something that consumes captured frames, e.g. the presenter or an encoder.
+// Called on the sink's own thread; it may keep the FrameRef around.
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+    virtual void consumeFrame(const FrameRef& frame) = 0;
+
+    int queuedFrames = 0; // Frames waiting behind the one being consumed, set by the frame bus
+};
+
+struct FrameBusSink;
+
+struct FrameSinkStats
+{
+    const char* name;
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t lag;    // Frames between the newest capture and the last one the sink finished
+    uint64_t maxLag;
+};
+
+// Delivers every captured frame to each registered sink on the sink's own
+// thread. Each sink has its own bounded queue and drop policy, so a slow
+// sink only ever falls behind or drops frames itself.
+class FrameBus
+{
+public:
+    FrameBus();
+    ~FrameBus();
+
+    void addSink(const char* name, FrameSink* sink, int queueDepth, drop_policy policy, thread_role role = ThreadWorker,
+                 stop_policy stopPolicy = StopDiscard);
+    void start();
+    void stop();
+
+    void publish(const FrameRef& frame);
+    void countPoolDrop() { ++poolDrops; }
+    uint64_t poolDroppedFrames() { return poolDrops; }
+    int sinkCount();
+    FrameSinkStats sinkStats(int index);
+    void report();
+
+private:
+    std::vector<FrameBusSink*> sinks;
+    std::atomic<uint64_t> framesPublished;
+    std::atomic<uint64_t> poolDrops; // Captured while every pooled frame was still held, so never published
+    std::atomic<uint64_t> latestFrame;
+    std::atomic_bool accepting; // Publishes are ignored once stopping starts
+    bool running;
+
+    void runSink(FrameBusSink* sink);
+};
@@ -0,0 +1,105 @@
+#include "framepool.h"
+#include "screenmodes.h"
+
+FrameRef::FrameRef(Frame* frame) :
+    frame(frame)
+{
+}
+
+FrameRef::FrameRef(const FrameRef& other) :
+    frame(other.frame)
+{
+    if (frame)
+        ++frame->refCount;
+}
+
+FrameRef::FrameRef(FrameRef&& other) :
+    frame(other.frame)
+{
+    other.frame = NULL;
+}
+
+FrameRef::~FrameRef()
+{
+    reset();
+}
+
+FrameRef& FrameRef::operator=(const FrameRef& other)
+{
+    if (other.frame)
+        ++other.frame->refCount;
+    reset();
+    frame = other.frame;
+    return *this;
+}
+
+FrameRef& FrameRef::operator=(FrameRef&& other)
+{
+    if (this != &other)
+    {
+        reset();
+        frame = other.frame;
+        other.frame = NULL;
+    }
+    return *this;
+}
+
+void FrameRef::reset()
+{
+    if (frame && --frame->refCount == 0)
+    {
+        frame->pool->release(frame);
+    }
+    frame = NULL;
+}
+
+FramePool::FramePool(int frames)
+{
+    size_t frameBytes = FrameSlab::align(DS_WIDTH * DS_HEIGHT * 2 * sizeof(uint16_t));
+    slab = new FrameSlab(frameBytes * frames);
+
+    for (int i = 0; i < frames; ++i)
+    {
+        Frame* frame = new Frame();
+        frame->pixels = ( uint16_t*) (slab->data() + frameBytes * i);
+        frame->pool = this;
+        allFrames.push_back(frame);
+    }
+    freeFrames = allFrames;
+}
+
+FramePool::~FramePool()
+{
+    for (Frame* frame : allFrames)
+    {
+        delete frame;
+    }
+    delete slab;
+}
+
+// Takes a frame out of the pool with a reference count of one, for the
+// caller to fill in and wrap in a FrameRef.
+// Returns NULL if every frame is in use.
+Frame* FramePool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeFrames.empty())
+        return NULL;
+
+    Frame* frame = freeFrames.back();
+    freeFrames.pop_back();
+    frame->refCount = 1;
+    return frame;
+}
+
+void FramePool::release(Frame* frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freeFrames.push_back(frame);
+}
+
+int FramePool::available()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ( int) freeFrames.size();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "dsframe.h"
+#include "framememory.h"
+
+class FramePool;
+
+// A captured frame. Never modified once it has been published.
+struct Frame
+{
+    uint16_t* pixels; // FRAME_ALIGNMENT aligned
+    DSFrameInfo info;
+    uint64_t number; // Frames captured before this one
+
+    std::atomic_int refCount;
+    FramePool* pool;
+};
+
+// Reference-counted handle to a pooled frame. The frame goes back to its
+// pool when the last handle is released. No allocations are made when
+// handles are copied.
+class FrameRef
+{
+public:
+    FrameRef() : frame(NULL) {}
+    explicit FrameRef(Frame* frame); // Takes over the reference returned by FramePool::acquire
+    FrameRef(const FrameRef& other);
+    FrameRef(FrameRef&& other);
+    ~FrameRef();
+
+    FrameRef& operator=(const FrameRef& other);
+    FrameRef& operator=(FrameRef&& other);
+
+    const Frame* operator->() const { return frame; }
+    const Frame& operator*() const { return *frame; }
+    explicit operator bool() const { return frame != NULL; }
+    void reset();
+
+private:
+    Frame* frame;
+};
+
+// Fixed set of frames allocated up front and recycled between captures.
+// Every frame's pixels live in one slab shared by the whole pool.
+class FramePool
+{
+public:
+    FramePool(int frames);
+    ~FramePool();
+
+    Frame* acquire();
+    void release(Frame* frame);
+    int available();
+
+private:
+    std::vector<Frame*> allFrames;
+    std::vector<Frame*> freeFrames;
+    std::mutex mutex;
+    FrameSlab* slab;
+};
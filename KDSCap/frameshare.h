@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Layout of the shared memory that KDSCap publishes raw frames into. Shared
+// by the publisher and the reader, so changing it means bumping the version.
+//
+// Each slot is guarded by a seqlock: the sequence is odd while the publisher
+// is writing the slot, and a reader retries if the sequence changed while it
+// was copying. Readers never block the publisher.
+//
+// Readers that want to sleep until frame n is published wait on ready event
+// n % 2. Publishing frame n sets that event and resets the other one, which
+// frame n + 1 will set, so a waiting reader never sees a stale signal.
+
+#define FRAMESHARE_MAPPING_NAME "Local\\KDSCapFrames"
+#define FRAMESHARE_EVENT_NAME "Local\\KDSCapFrameReady%d"
+#define FRAMESHARE_MAGIC 0x5046534b // "KSFP"
+#define FRAMESHARE_VERSION 1
+#define FRAMESHARE_SLOTS 4
+#define FRAMESHARE_WIDTH 256
+#define FRAMESHARE_HEIGHT 384
+#define FRAMESHARE_LINE_MASK_SIZE 48
+
+struct alignas(64) FrameShareSlot
+{
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    uint64_t frameNumber;
+    uint64_t timestamp; // Performance counter ticks when the bulk read completed
+    uint8_t lineMask[FRAMESHARE_LINE_MASK_SIZE];
+    uint16_t pixels[FRAMESHARE_WIDTH * FRAMESHARE_HEIGHT]; // RGB565, top screen above bottom
+};
+
+struct alignas(64) FrameShareHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint64_t timestampFrequency;
+    std::atomic<uint64_t> framesPublished; // The newest frame is in slot (framesPublished - 1) % slotCount
+};
+
+struct FrameShareMemory
+{
+    FrameShareHeader header;
+    FrameShareSlot slots[FRAMESHARE_SLOTS];
+};
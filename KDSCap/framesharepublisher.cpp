@@ -0,0 +1,102 @@
+#include <stdexcept>
+#include <SDL_timer.h>
+#include "framesharepublisher.h"
+
+FrameSharePublisher::FrameSharePublisher() :
+    publishTicks(0),
+    maxPublishTicks(0)
+{
+    static_assert(FRAMESHARE_LINE_MASK_SIZE == DS_LINE_MASK_SIZE, "Line mask size mismatch");
+    static_assert(FRAMESHARE_WIDTH * FRAMESHARE_HEIGHT * sizeof(uint16_t) == DS_FRAME_SIZE, "Frame size mismatch");
+
+    mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(FrameShareMemory), FRAMESHARE_MAPPING_NAME);
+    if (mapping == NULL)
+    {
+        printf("Could not create shared frame memory: %d\n", GetLastError());
+        throw std::runtime_error("Could not create shared frame memory");
+    }
+
+    memory = ( FrameShareMemory*) MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(FrameShareMemory));
+    if (memory == NULL)
+    {
+        CloseHandle(mapping);
+        throw std::runtime_error("Could not map shared frame memory");
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), FRAMESHARE_EVENT_NAME, i);
+        readyEvents[i] = CreateEvent(NULL, TRUE, FALSE, name);
+        if (readyEvents[i] == NULL)
+        {
+            throw std::runtime_error("Could not create frame ready event");
+        }
+        ResetEvent(readyEvents[i]);
+    }
+
+    memory->header.magic = FRAMESHARE_MAGIC;
+    memory->header.version = FRAMESHARE_VERSION;
+    memory->header.slotCount = FRAMESHARE_SLOTS;
+    memory->header.slotSize = sizeof(FrameShareSlot);
+    memory->header.timestampFrequency = SDL_GetPerformanceFrequency();
+    memory->header.framesPublished = 0;
+    for (int i = 0; i < FRAMESHARE_SLOTS; ++i)
+    {
+        memory->slots[i].sequence = 0;
+    }
+
+    printf("Publishing frames to shared memory %s\n", FRAMESHARE_MAPPING_NAME);
+}
+
+FrameSharePublisher::~FrameSharePublisher()
+{
+    UnmapViewOfFile(memory);
+    CloseHandle(mapping);
+    CloseHandle(readyEvents[0]);
+    CloseHandle(readyEvents[1]);
+}
+
+void FrameSharePublisher::publish(const uint16_t* pixels, const DSFrameInfo& info)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    uint64_t frameNumber = memory->header.framesPublished;
+    FrameShareSlot& slot = memory->slots[frameNumber % FRAMESHARE_SLOTS];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frameNumber = frameNumber;
+    slot.timestamp = info.captureTime;
+    memcpy(slot.lineMask, info.lineMask, sizeof(slot.lineMask));
+    memcpy(slot.pixels, pixels, sizeof(slot.pixels));
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    memory->header.framesPublished.store(frameNumber + 1, std::memory_order_release);
+
+    ResetEvent(readyEvents[(frameNumber + 1) % 2]);
+    SetEvent(readyEvents[frameNumber % 2]);
+
+    uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+    publishTicks += elapsed;
+    if (elapsed > maxPublishTicks)
+        maxPublishTicks = elapsed;
+}
+
+void FrameSharePublisher::consumeFrame(const FrameRef& frame)
+{
+    publish(frame->pixels, frame->info);
+}
+
+void FrameSharePublisher::report()
+{
+    uint64_t frames = memory->header.framesPublished;
+    if (frames == 0)
+        return;
+
+    double ticksToUs = 1000000.0 / SDL_GetPerformanceFrequency();
+    printf("Shared memory: published %llu frames, %.1f us average, %.1f us max\n",
+           ( unsigned long long) frames, publishTicks * ticksToUs / frames, maxPublishTicks * ticksToUs);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <Windows.h>
+#include "framebus.h"
+#include "frameshare.h"
+#include "win_dscapture.h"
+
+// Publishes every grabbed frame into shared memory for other processes on
+// the same machine. See framesharereader.h for the other side.
+class FrameSharePublisher : public FrameSink
+{
+public:
+    FrameSharePublisher();
+    ~FrameSharePublisher();
+
+    void publish(const uint16_t* pixels, const DSFrameInfo& info);
+    void consumeFrame(const FrameRef& frame) override;
+    void report();
+
+private:
+    HANDLE mapping;
+    HANDLE readyEvents[2];
+    FrameShareMemory* memory;
+
+    uint64_t publishTicks;
+    uint64_t maxPublishTicks;
+};
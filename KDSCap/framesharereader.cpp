@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <cstring>
+#include "framesharereader.h"
+
+FrameShareReader::FrameShareReader() :
+    mapping(NULL),
+    readyEvents(),
+    memory(NULL),
+    nextFrame(0)
+{
+}
+
+FrameShareReader::~FrameShareReader()
+{
+    if (memory)
+        UnmapViewOfFile(memory);
+    if (mapping)
+        CloseHandle(mapping);
+    for (int i = 0; i < 2; ++i)
+    {
+        if (readyEvents[i])
+            CloseHandle(readyEvents[i]);
+    }
+}
+
+// Attaches to a running KDSCap.
+// Returns false if it isn't publishing frames or the layout doesn't match.
+bool FrameShareReader::open()
+{
+    mapping = OpenFileMapping(FILE_MAP_READ, FALSE, FRAMESHARE_MAPPING_NAME);
+    if (mapping == NULL)
+        return false;
+
+    memory = ( const FrameShareMemory*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(FrameShareMemory));
+    if (memory == NULL)
+        return false;
+
+    if (memory->header.magic != FRAMESHARE_MAGIC || memory->header.version != FRAMESHARE_VERSION ||
+        memory->header.slotSize != sizeof(FrameShareSlot))
+        return false;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), FRAMESHARE_EVENT_NAME, i);
+        readyEvents[i] = OpenEvent(SYNCHRONIZE, FALSE, name);
+        if (readyEvents[i] == NULL)
+            return false;
+    }
+
+    nextFrame = memory->header.framesPublished;
+    return true;
+}
+
+// Copies the newest frame without waiting.
+// Returns false if there is no frame newer than the last one read.
+bool FrameShareReader::readLatest(FrameShareFrame* frame)
+{
+    while (true)
+    {
+        uint64_t published = memory->header.framesPublished.load(std::memory_order_acquire);
+        if (published == 0 || published <= nextFrame)
+            return false;
+
+        const FrameShareSlot& slot = memory->slots[(published - 1) % FRAMESHARE_SLOTS];
+        uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue; // Publisher is lapping us, go again
+
+        frame->frameNumber = slot.frameNumber;
+        frame->timestamp = slot.timestamp;
+        memcpy(frame->lineMask, slot.lineMask, sizeof(frame->lineMask));
+        memcpy(frame->pixels, slot.pixels, sizeof(frame->pixels));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+            continue; // Overwritten while copying
+
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        frame->latencyMs = (now.QuadPart - frame->timestamp) * 1000.0 / memory->header.timestampFrequency;
+        frame->framesMissed = frame->frameNumber - nextFrame;
+        nextFrame = frame->frameNumber + 1;
+        return true;
+    }
+}
+
+// Copies the next new frame, sleeping until one is published.
+// Returns false on timeout.
+bool FrameShareReader::waitForFrame(FrameShareFrame* frame, DWORD timeoutMs)
+{
+    DWORD start = GetTickCount();
+    while (true)
+    {
+        // Frame n sets ready event n % 2, so the event to wait on is the one
+        // for the generation seen before looking, not whatever is newest after
+        uint64_t published = memory->header.framesPublished.load(std::memory_order_acquire);
+        if (readLatest(frame))
+            return true;
+
+        DWORD elapsed = GetTickCount() - start;
+        if (elapsed >= timeoutMs)
+            return false;
+
+        DWORD remaining = timeoutMs - elapsed;
+        WaitForSingleObject(readyEvents[published % 2], remaining < FRAMESHARE_WAIT_SLICE_MS ? remaining : FRAMESHARE_WAIT_SLICE_MS);
+    }
+}
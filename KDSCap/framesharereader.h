@@ -0,0 +1,40 @@
+#pragma once
+#include <Windows.h>
+#include "frameshare.h"
+
+// A reader waiting for a frame wakes at least this often to look for one, in
+// case the publisher lapped its ready event before it went to sleep
+#define FRAMESHARE_WAIT_SLICE_MS 16
+
+// Reads the raw frames KDSCap publishes to shared memory. Only depends on
+// frameshare.h, so it can be copied into other tools as is.
+//
+//     FrameShareReader reader;
+//     FrameShareFrame* frame = new FrameShareFrame;
+//     while (reader.waitForFrame(frame, 100)) { ... }
+struct FrameShareFrame
+{
+    uint64_t frameNumber;
+    uint64_t timestamp;
+    uint8_t lineMask[FRAMESHARE_LINE_MASK_SIZE];
+    uint16_t pixels[FRAMESHARE_WIDTH * FRAMESHARE_HEIGHT];
+    double latencyMs;   // From bulk read completion to this copy finishing
+    uint64_t framesMissed; // Frames published since the previous read that were never seen
+};
+
+class FrameShareReader
+{
+public:
+    FrameShareReader();
+    ~FrameShareReader();
+
+    bool open();
+    bool readLatest(FrameShareFrame* frame);
+    bool waitForFrame(FrameShareFrame* frame, DWORD timeoutMs);
+
+private:
+    HANDLE mapping;
+    HANDLE readyEvents[2];
+    const FrameShareMemory* memory;
+    uint64_t nextFrame;
+};
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cstdio>
+#include <SDL_timer.h>
+#include "latencystats.h"
+
+static const char* spanNames[NUM_LATENCY_SPANS] = {
+    "capture -> grab",
+    "grab -> upload",
+    "upload -> present",
+    "end-to-end"
+};
+
+LatencyStats::LatencyStats()
+{
+    ticksToMs = 1000.0 / SDL_GetPerformanceFrequency();
+
+    // Enough for ten minutes of frames before the vectors have to grow
+    for (int i = 0; i < NUM_LATENCY_SPANS; ++i)
+    {
+        samples[i].reserve(60 * 60 * 10);
+    }
+}
+
+void LatencyStats::record(uint64_t captureTime, uint64_t grabTime, uint64_t uploadTime, uint64_t presentTime)
+{
+    samples[LatencyCaptureToGrab].push_back(( float) ((grabTime - captureTime) * ticksToMs));
+    samples[LatencyGrabToUpload].push_back(( float) ((uploadTime - grabTime) * ticksToMs));
+    samples[LatencyUploadToPresent].push_back(( float) ((presentTime - uploadTime) * ticksToMs));
+    samples[LatencyEndToEnd].push_back(( float) ((presentTime - captureTime) * ticksToMs));
+}
+
+// Returns the p-th percentile (0-100) of a span in milliseconds, using the
+// nearest-rank method. Returns 0 if nothing was recorded.
+double LatencyStats::percentile(latency_span span, double p)
+{
+    std::vector<float> sorted = samples[span];
+    if (sorted.empty())
+        return 0.0;
+
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = ( size_t) (p / 100.0 * sorted.size() + 0.5);
+    rank = std::min(std::max(rank, ( size_t) 1), sorted.size());
+    return sorted[rank - 1];
+}
+
+void LatencyStats::report()
+{
+    printf("Latency over %zu frames (ms):\n", samples[LatencyEndToEnd].size());
+    printf("%-20s %8s %8s %8s\n", "", "p50", "p95", "p99");
+    for (int i = 0; i < NUM_LATENCY_SPANS; ++i)
+    {
+        latency_span span = static_cast<latency_span>(i);
+        printf("%-20s %8.2f %8.2f %8.2f\n", spanNames[i], percentile(span, 50), percentile(span, 95), percentile(span, 99));
+    }
+}
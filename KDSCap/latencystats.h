@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+typedef enum
+{
+    LatencyCaptureToGrab = 0,
+    LatencyGrabToUpload,
+    LatencyUploadToPresent,
+    LatencyEndToEnd
+} latency_span;
+#define NUM_LATENCY_SPANS 4
+
+// Collects capture-to-photon timings for every displayed frame.
+// Timestamps are SDL performance counter values.
+class LatencyStats
+{
+public:
+    LatencyStats();
+
+    void record(uint64_t captureTime, uint64_t grabTime, uint64_t uploadTime, uint64_t presentTime);
+    double percentile(latency_span span, double p);
+    void report();
+
+private:
+    std::vector<float> samples[NUM_LATENCY_SPANS];
+    double ticksToMs;
+};
@@ -0,0 +1,387 @@
+// winsock2.h has to come before anything that pulls in Windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include "livestream.h"
+#include "socketaccept.h"
+#include "threadpolicy.h"
+
+#define LIVE_IO_BUFFER_SIZE (188 * 64)
+#define LIVE_SEND_TIMEOUT_MS 2000
+#define LIVE_UDP_PAYLOAD (188 * 7) // Seven TS packets per datagram, as every MPEG-TS over UDP receiver expects
+
+struct LiveSubscriber
+{
+    SOCKET socket;
+    bool datagram = false;
+    std::thread sendThread;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<LiveChunk> queue;
+    bool waitingForKeyframe = true;
+    bool closed = false;
+    std::atomic_bool finished{false};
+    unsigned int chunksSkipped = 0;
+    unsigned int overflows = 0;
+    unsigned int sendErrors = 0;
+};
+
+// Sends queued chunks until the subscriber is closed. A TCP subscriber that
+// fails a send is finished; UDP has no one to disconnect, so a failed
+// datagram, e.g. nobody listening yet, is only counted.
+static void sendChunks(LiveSubscriber* subscriber)
+{
+    configureThread(ThreadWorker, "live send");
+    while (true)
+    {
+        LiveChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(subscriber->queueMutex);
+            subscriber->queueCondition.wait(lock, [subscriber]() {
+                return subscriber->closed || !subscriber->queue.empty();
+            });
+            if (subscriber->closed)
+                break;
+            chunk = subscriber->queue.front();
+            subscriber->queue.pop_front();
+        }
+
+        const char* data = ( const char*) chunk.data->data();
+        int remaining = ( int) chunk.data->size();
+        while (remaining > 0)
+        {
+            int bytes = subscriber->datagram && remaining > LIVE_UDP_PAYLOAD ? LIVE_UDP_PAYLOAD : remaining;
+            int sent = send(subscriber->socket, data, bytes, 0);
+            if (sent == SOCKET_ERROR)
+            {
+                if (!subscriber->datagram)
+                {
+                    subscriber->finished = true; // Disconnected or stopped reading
+                    return;
+                }
+                ++subscriber->sendErrors;
+                sent = bytes;
+            }
+            data += sent;
+            remaining -= sent;
+        }
+    }
+    subscriber->finished = true;
+}
+
+LiveStream::LiveStream(int port, const char* udpTarget, const AVCodecContext* videoContext, const AVCodecContext* audioContext) :
+    formatContext(NULL),
+    listenSocket(INVALID_SOCKET),
+    running(false)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        throw std::runtime_error("Could not initialize winsock");
+    }
+
+    if (avformat_alloc_output_context2(&formatContext, NULL, "mpegts", NULL) < 0)
+    {
+        throw std::runtime_error("Could not allocate MPEG-TS muxer");
+    }
+
+    uint8_t* ioBuffer = ( uint8_t*) av_malloc(LIVE_IO_BUFFER_SIZE);
+    formatContext->pb = avio_alloc_context(ioBuffer, LIVE_IO_BUFFER_SIZE, 1, this, NULL, &LiveStream::writeCallback, NULL);
+    if (!formatContext->pb)
+    {
+        throw std::runtime_error("Could not allocate live stream IO context");
+    }
+
+    streamContexts[0] = videoContext;
+    streamContexts[1] = audioContext;
+    addStream(videoContext);
+    addStream(audioContext);
+
+    if (avformat_write_header(formatContext, NULL) < 0)
+    {
+        throw std::runtime_error("Could not write MPEG-TS header");
+    }
+    avio_flush(formatContext->pb);
+    pendingData.clear(); // PAT/PMT are repeated before every keyframe anyway
+
+    packet = av_packet_alloc();
+    if (!packet)
+    {
+        throw std::runtime_error("Could not allocate live stream packet");
+    }
+
+    if (port)
+    {
+        SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == INVALID_SOCKET)
+        {
+            throw std::runtime_error("Could not create live stream socket");
+        }
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(( u_short) port);
+        if (bind(s, ( sockaddr*) &address, sizeof(address)) == SOCKET_ERROR || listen(s, SOMAXCONN) == SOCKET_ERROR)
+        {
+            printf("Could not listen on port %d: %d\n", port, WSAGetLastError());
+            closesocket(s);
+            throw std::runtime_error("Could not listen for live stream subscribers");
+        }
+        listenSocket = s;
+    }
+
+    if (udpTarget)
+    {
+        try
+        {
+            openUdpTarget(udpTarget);
+        }
+        catch (...)
+        {
+            if (listenSocket != INVALID_SOCKET)
+                closesocket(( SOCKET) listenSocket);
+            throw;
+        }
+    }
+
+    if (port)
+    {
+        running = true;
+        acceptThread = std::thread(&LiveStream::acceptSubscribers, this);
+        printf("Live MPEG-TS stream on tcp://127.0.0.1:%d\n", port);
+    }
+}
+
+LiveStream::~LiveStream()
+{
+    if (listenSocket != INVALID_SOCKET)
+    {
+        running = false;
+        closesocket(( SOCKET) listenSocket); // Wakes up accept()
+        acceptThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        for (LiveSubscriber* subscriber : subscribers)
+        {
+            removeSubscriber(subscriber);
+        }
+        subscribers.clear();
+    }
+
+    av_write_trailer(formatContext);
+    av_packet_free(&packet);
+    av_freep(&formatContext->pb->buffer);
+    avio_context_free(&formatContext->pb);
+    avformat_free_context(formatContext);
+    WSACleanup();
+}
+
+void LiveStream::addStream(const AVCodecContext* context)
+{
+    AVStream* stream = avformat_new_stream(formatContext, NULL);
+    if (!stream)
+    {
+        throw std::runtime_error("Could not create live stream");
+    }
+
+    if (avcodec_parameters_from_context(stream->codecpar, context) < 0)
+    {
+        throw std::runtime_error("Could not copy codec parameters");
+    }
+    stream->time_base = context->time_base;
+}
+
+// Muxes one encoded packet and queues the resulting TS packets for every subscriber
+void LiveStream::writePacket(const AVCodecContext* context, AVPacket* encoded)
+{
+    int streamIndex = context == streamContexts[0] ? 0 : 1;
+    LiveChunk chunk;
+
+    {
+        std::lock_guard<std::mutex> lock(muxMutex);
+
+        // Reference the encoder's data rather than copying it
+        if (av_packet_ref(packet, encoded) < 0)
+            return;
+
+        packet->stream_index = streamIndex;
+        av_packet_rescale_ts(packet, context->time_base, formatContext->streams[streamIndex]->time_base);
+
+        int ret = av_write_frame(formatContext, packet);
+        av_packet_unref(packet);
+        if (ret < 0)
+            return;
+
+        avio_flush(formatContext->pb);
+        if (pendingData.empty())
+            return;
+
+        chunk.data = std::make_shared<const std::vector<uint8_t>>(std::move(pendingData));
+        chunk.keyframe = streamIndex == 0 && (encoded->flags & AV_PKT_FLAG_KEY);
+        pendingData.clear();
+    }
+
+    fanOut(chunk);
+}
+
+int LiveStream::writeCallback(void* opaque, uint8_t* buf, int size)
+{
+    LiveStream* stream = ( LiveStream*) opaque;
+    stream->pendingData.insert(stream->pendingData.end(), buf, buf + size);
+    return size;
+}
+
+void LiveStream::fanOut(const LiveChunk& chunk)
+{
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+
+    for (auto it = subscribers.begin(); it != subscribers.end();)
+    {
+        LiveSubscriber* subscriber = *it;
+        if (subscriber->finished)
+        {
+            removeSubscriber(subscriber);
+            it = subscribers.erase(it);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> queueLock(subscriber->queueMutex);
+            if (subscriber->queue.size() >= LIVE_MAX_QUEUED_CHUNKS)
+            {
+                // Too far behind, throw away the backlog and resync on a keyframe
+                subscriber->chunksSkipped += ( unsigned int) subscriber->queue.size();
+                subscriber->queue.clear();
+                subscriber->waitingForKeyframe = true;
+                ++subscriber->overflows;
+            }
+
+            if (subscriber->waitingForKeyframe && !chunk.keyframe)
+            {
+                ++subscriber->chunksSkipped;
+            }
+            else
+            {
+                subscriber->waitingForKeyframe = false;
+                subscriber->queue.push_back(chunk);
+            }
+        }
+        subscriber->queueCondition.notify_one();
+        ++it;
+    }
+}
+
+void LiveStream::acceptSubscribers()
+{
+    configureThread(ThreadWorker, "live accept");
+
+    while (true)
+    {
+        SOCKET s = ( SOCKET) acceptConnection(listenSocket, running);
+        if (s == INVALID_SOCKET)
+            break;
+
+        DWORD timeout = LIVE_SEND_TIMEOUT_MS;
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, ( const char*) &timeout, sizeof(timeout));
+        BOOL noDelay = TRUE;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, ( const char*) &noDelay, sizeof(noDelay));
+
+        startSubscriber(s, false);
+    }
+}
+
+// Sends the stream to a host:port over UDP, e.g. 127.0.0.1:1234 or a
+// multicast group such as 239.0.0.1:1234
+void LiveStream::openUdpTarget(const char* target)
+{
+    const char* colon = strrchr(target, ':');
+    if (!colon || colon == target || !colon[1])
+    {
+        printf("Expected host:port for the UDP live stream, got %s\n", target);
+        throw std::runtime_error("Invalid UDP live stream target");
+    }
+    std::string host(target, colon - target);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    addrinfo* result = NULL;
+    int error = getaddrinfo(host.c_str(), colon + 1, &hints, &result);
+    if (error != 0)
+    {
+        printf("Could not resolve UDP live stream target %s: %d\n", target, error);
+        throw std::runtime_error("Could not resolve UDP live stream target");
+    }
+
+    // Connected, so the send thread can use send() just as it does for TCP
+    SOCKET s = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (s == INVALID_SOCKET || connect(s, result->ai_addr, ( int) result->ai_addrlen) == SOCKET_ERROR)
+    {
+        printf("Could not open UDP live stream to %s: %d\n", target, WSAGetLastError());
+        if (s != INVALID_SOCKET)
+            closesocket(s);
+        freeaddrinfo(result);
+        throw std::runtime_error("Could not open UDP live stream");
+    }
+    freeaddrinfo(result);
+
+    DWORD timeout = LIVE_SEND_TIMEOUT_MS;
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, ( const char*) &timeout, sizeof(timeout));
+
+    startSubscriber(s, true);
+    printf("Live MPEG-TS stream to udp://%s\n", target);
+}
+
+void LiveStream::startSubscriber(uintptr_t socket, bool datagram)
+{
+    LiveSubscriber* subscriber = new LiveSubscriber();
+    subscriber->socket = ( SOCKET) socket;
+    subscriber->datagram = datagram;
+    subscriber->sendThread = std::thread(sendChunks, subscriber);
+
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    subscribers.push_back(subscriber);
+    if (!datagram)
+    {
+        printf("Live stream subscriber connected (%zu total)\n", subscribers.size());
+    }
+}
+
+int LiveStream::subscriberCount()
+{
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    return ( int) subscribers.size();
+}
+
+// Closes the connection and frees the subscriber. The caller must hold subscribersMutex.
+void LiveStream::removeSubscriber(LiveSubscriber* subscriber)
+{
+    {
+        std::lock_guard<std::mutex> lock(subscriber->queueMutex);
+        subscriber->closed = true;
+    }
+    subscriber->queueCondition.notify_one();
+    shutdown(subscriber->socket, SD_BOTH);
+    subscriber->sendThread.join();
+    closesocket(subscriber->socket);
+
+    if (subscriber->datagram)
+    {
+        printf("UDP live stream stopped, skipped %u chunks in %u overflows, %u failed sends\n",
+               subscriber->chunksSkipped, subscriber->overflows, subscriber->sendErrors);
+    }
+    else
+    {
+        printf("Live stream subscriber disconnected, skipped %u chunks in %u overflows\n",
+               subscriber->chunksSkipped, subscriber->overflows);
+    }
+    delete subscriber;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "packetsink.h"
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+}
+
+#define LIVE_MAX_QUEUED_CHUNKS 120
+
+// A piece of the MPEG-TS stream produced by muxing one packet. The data is
+// shared by every subscriber instead of being copied for each of them.
+struct LiveChunk
+{
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    bool keyframe;
+};
+
+struct LiveSubscriber;
+
+// Muxes encoded video and audio packets into MPEG-TS and fans the stream out
+// to any number of TCP clients on localhost, e.g. ffplay tcp://127.0.0.1:port,
+// and/or pushes it over UDP to one host:port, e.g. ffplay udp://@:port or a
+// multicast group. A subscriber that can't keep up is skipped ahead to the
+// next keyframe, and a TCP one that stops reading altogether is disconnected;
+// the encoders never wait. Pass a port of 0 or a NULL UDP target to leave
+// either out.
+class LiveStream : public PacketSink
+{
+public:
+    LiveStream(int port, const char* udpTarget, const AVCodecContext* videoContext, const AVCodecContext* audioContext);
+    ~LiveStream();
+
+    void writePacket(const AVCodecContext* context, AVPacket* packet) override;
+    int subscriberCount();
+
+private:
+    AVFormatContext* formatContext;
+    AVPacket* packet;
+    const AVCodecContext* streamContexts[2];
+    std::vector<uint8_t> pendingData;
+    std::mutex muxMutex;
+
+    uintptr_t listenSocket; // SOCKET, kept opaque so winsock stays out of the header
+    std::thread acceptThread;
+    std::atomic_bool running;
+
+    std::vector<LiveSubscriber*> subscribers;
+    std::mutex subscribersMutex;
+
+    void addStream(const AVCodecContext* context);
+    void acceptSubscribers();
+    void openUdpTarget(const char* target);
+    void startSubscriber(uintptr_t socket, bool datagram);
+    void fanOut(const LiveChunk& chunk);
+    void removeSubscriber(LiveSubscriber* subscriber);
+
+    static int writeCallback(void* opaque, uint8_t* buf, int size);
+};
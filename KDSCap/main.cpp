@@ -1,8 +1,29 @@
 #include <SDL.h>
+#include <chrono>
 #include <cstdio>
+#include <future>
 #include <stdexcept>
 #include <mutex>
+#include <thread>
 #include "audiorecorder.h"
+#include "benchmark.h"
+#include "cpuload.h"
+#include "frameanalyzer.h"
+#include "framebus.h"
+#include "framesharepublisher.h"
+#include "latencystats.h"
+#include "livestream.h"
+#include "metricsserver.h"
+#include "muxer.h"
+#include "options.h"
+#include "pipeoutput.h"
+#include "presenter.h"
+#include "rawrecorder.h"
+#include "recordingcontrol.h"
+#include "renditions.h"
+#include "screenshotter.h"
+#include "threadpolicy.h"
+#include "transcoder.h"
 #include "videoencoder.h"
 #include "win_dscapture.h"
 #include "screenmodes.h"
@@ -10,210 +31,607 @@
 const int SCREEN_WIDTH = DS_WIDTH;
 const int SCREEN_HEIGHT = DS_HEIGHT * 2;
 
-bool init(SDL_Window** window, SDL_Renderer** renderer, SDL_Texture** texture);
-void captureFrame(DSCapture& capture, VideoEncoder& encoder, uint16_t* dsFrameBuffer, SDL_Texture* texture);
-void destroyAll(SDL_Window* window, SDL_Renderer* renderer, SDL_Texture* texture);
-void resizeWindow(SDL_Window* window, int scale, screen_mode mode);
-void setWindowTitle(SDL_Window* window, screen_mode mode, unsigned int framerate);
+bool init(SDL_Window** window);
+bool captureFrame(DSCapture& capture, FramePool& pool, FrameBus& bus, uint64_t& frameNumber);
+int runHeadless(const Options& options, LatencyStats& latencyStats);
+int checkLatency(const Options& options, LatencyStats& latencyStats);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
 
 int main(int argc, char* argv[])
 {
+    auto launchTime = std::chrono::steady_clock::now();
     SDL_Window* window = NULL;
-    SDL_Renderer* renderer = NULL;
-    SDL_Texture* texture = NULL;
     SDL_Event event;
-    uint16_t* dsFrameBuffer = new uint16_t[DS_WIDTH * DS_HEIGHT * 2];
     bool quit = false;
-    int scale = 1;
-    screen_mode screenMode = Vertical;
-    unsigned int frameCounter = 0;
-    unsigned int lastTime = 0;
-    unsigned int currentTime;
-    
-    DSCapture dscapture;
+    bool firstFrameShown = false;
+    Options options;
+    LatencyStats latencyStats;
+    uint64_t frameNumber = 0;
 
-    if (!init(&window, &renderer, &texture))
+    if (!parseOptions(argc, argv, &options))
     {
+        printUsage();
         return 1;
     }
 
-    VideoEncoder videoEncoder;
-    AudioRecorder audioRecorder;
-    audioRecorder.start();
+    FrameSlab::setFlags(options.frameMemoryFlags);
 
-    dscapture.startCapture();
+    setThreadPolicies(options.threadPolicies);
+    if (options.processPriority && !setProcessPriority(options.processPriority))
+    {
+        return 1;
+    }
+    configureThread(ThreadRender, "main");
+
+    if (options.benchmarkPath)
+    {
+        return runBenchmark(options.benchmarkPath, options.benchmarkFrames);
+    }
+
+    if (options.transcodeInput)
+    {
+        return transcodeRaw(options.transcodeInput, options.transcodeOutput, options.transcodePreset);
+    }
+
+    if (options.controlPort)
+    {
+        return sendControlCommand(options.controlPort, options.controlCommand);
+    }
+
+    if (options.headless)
+    {
+        return runHeadless(options, latencyStats);
+    }
+
+    // Opened first, so when frames go to stdout nothing else has been printed there
+    PipeOutput* pipeOutput = options.pipeTarget ? new PipeOutput(options.pipeTarget, options.pipeFormat) : NULL;
+
+    // Enough frames for the screenshot history, a burst being saved and every sink queue
+    FramePool framePool(options.burstFrames * 2 + 64);
+    FrameBus frameBus;
+
+    RawRecorder* rawRecorder = NULL;
+    if (options.rawPath)
+    {
+        rawRecorder = new RawRecorder(options.rawPath, options.compressRaw);
+    }
+    if (options.splitPath && rawRecorder)
+    {
+        printf("--split-screens can't be used with --record-raw, ignoring it\n");
+        options.splitPath = NULL;
+    }
+
+    // Opening the device, initializing SDL and opening the encoders are
+    // independent, so they run at the same time. SDL stays on this thread.
+    double deviceMs = 0.0, encodersMs = 0.0;
+    std::future<DSCapture*> captureOpened = std::async(std::launch::async, [&options, &deviceMs]() {
+        auto start = std::chrono::steady_clock::now();
+        DSCapture* capture;
+        if (options.replayPath)
+            capture = new DSCapture(options.replayPath);
+        else if (options.useSynthetic)
+            capture = new DSCapture(options.syntheticScene);
+        else
+            capture = new DSCapture();
+        deviceMs = millisecondsSince(start);
+        return capture;
+    });
+
+    AudioRecorder* audioRecorder = NULL;
+    RecordingControl* recording = NULL;
+    VideoEncoder* videoEncoder = NULL;
+    Muxer* screenMuxer = NULL;
+    VideoEncoder* screenEncoders[2] = {NULL, NULL};
+    RenditionSet* renditions = NULL;
+    std::future<void> encodersOpened = std::async(std::launch::async, [&]() {
+        auto start = std::chrono::steady_clock::now();
+
+        // Raw and split screen recordings run for the whole session. Otherwise
+        // recording is started and stopped with a hotkey.
+        bool toggledRecording = !rawRecorder && !options.splitPath;
+        audioRecorder = new AudioRecorder(toggledRecording ? NULL : "audio.mp3", false);
+        if (toggledRecording)
+        {
+            recording = new RecordingControl(audioRecorder, options.adaptiveQuality);
+        }
+
+        // Each screen gets its own encoder, both muxed into one file as separate tracks
+        if (options.splitPath)
+        {
+            screenMuxer = new Muxer(options.splitPath);
+            screenEncoders[0] = new VideoEncoder("ultrafast", NULL, EncodeTopScreen, screenMuxer->needsGlobalHeader());
+            screenEncoders[1] = new VideoEncoder("ultrafast", NULL, EncodeBottomScreen, screenMuxer->needsGlobalHeader());
+            for (int i = 0; i < 2; ++i)
+            {
+                screenMuxer->addStream(screenEncoders[i]->codecContext());
+                screenEncoders[i]->setPacketSink(screenMuxer);
+            }
+            screenMuxer->start();
+        }
+
+        // Renditions share one conversion of each frame between their encoders
+        if (options.renditionCount > 0)
+        {
+            renditions = new RenditionSet();
+            for (int i = 0; i < options.renditionCount; ++i)
+            {
+                renditions->addRendition(options.renditions[i]);
+            }
+        }
+
+        // The live stream has its own encoder, so it runs whether or not anything is recorded
+        if (options.livePort || options.liveUdp)
+        {
+            videoEncoder = new VideoEncoder("ultrafast", NULL);
+            if (options.adaptiveQuality)
+                videoEncoder->enableAdaptiveQuality("live");
+        }
+        encodersMs = millisecondsSince(start);
+    });
+
+    // If starting up fails, waits for whichever of the two is still opening,
+    // then frees everything that did open
+    DSCapture* dscapture = NULL;
+    auto abandonStartup = [&]() {
+        if (captureOpened.valid())
+        {
+            try
+            {
+                dscapture = captureOpened.get();
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+        if (encodersOpened.valid())
+        {
+            try
+            {
+                encodersOpened.get();
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        delete dscapture;
+        delete videoEncoder;
+        delete recording;
+        delete screenEncoders[0]; // Before the muxer they flush into
+        delete screenEncoders[1];
+        delete screenMuxer;
+        delete renditions;
+        delete audioRecorder;
+        delete rawRecorder;
+        delete pipeOutput;
+        if (window)
+            SDL_DestroyWindow(window);
+        SDL_Quit();
+    };
+
+    auto windowStart = std::chrono::steady_clock::now();
+    if (!init(&window))
+    {
+        abandonStartup();
+        return 1;
+    }
+
+    Presenter presenter(window, options.measureLatency ? &latencyStats : NULL);
+    if (!presenter.start())
+    {
+        abandonStartup();
+        return 1;
+    }
+    double windowMs = millisecondsSince(windowStart);
+
+    // Either may have failed, e.g. no device is plugged in
+    try
+    {
+        encodersOpened.get();
+        dscapture = captureOpened.get();
+    }
+    catch (const std::exception& e)
+    {
+        printf("Could not start capturing: %s\n", e.what());
+        presenter.stop(); // Its renderer goes before the window does
+        abandonStartup();
+        return 1;
+    }
+    audioRecorder->openCaptureDevice();
+
+    if (options.truncatePercent > 0)
+    {
+        if (options.replayPath || options.useSynthetic)
+            dscapture->setSourceTruncation(options.truncatePercent);
+        else
+            printf("--truncate-frames only applies to --replay and --synthetic\n");
+    }
+    if (rawRecorder)
+    {
+        dscapture->setRawRecorder(rawRecorder);
+    }
+
+    LiveStream* liveStream = NULL;
+    if (options.livePort || options.liveUdp)
+    {
+        liveStream = new LiveStream(options.livePort, options.liveUdp, videoEncoder->codecContext(), audioRecorder->codecContext());
+        videoEncoder->setPacketSink(liveStream);
+        audioRecorder->setPacketSink(liveStream);
+    }
+
+    FrameSharePublisher* frameShare = options.shareFrames ? new FrameSharePublisher() : NULL;
+    FrameAnalyzer* frameAnalyzer = options.analysisPath ? new FrameAnalyzer(options.analysisPath) : NULL;
+    Screenshotter screenshotter(options.burstFrames);
+
+    frameBus.addSink("presenter", &presenter, 2, DropOldest, ThreadRender);
+    if (recording)
+    {
+        frameBus.addSink("recording", recording, 16, DropOldest, ThreadEncoder, StopDrain);
+    }
+    if (videoEncoder)
+    {
+        frameBus.addSink("live encoder", videoEncoder, 16, DropOldest, ThreadEncoder, StopDrain);
+    }
+    if (screenMuxer)
+    {
+        // Separate sinks, so each screen is encoded on its own thread. Both use the frame number as pts.
+        frameBus.addSink("top encoder", screenEncoders[0], 16, DropOldest, ThreadEncoder, StopDrain);
+        frameBus.addSink("bottom encoder", screenEncoders[1], 16, DropOldest, ThreadEncoder, StopDrain);
+    }
+    if (renditions)
+    {
+        renditions->start();
+        frameBus.addSink("renditions", renditions, 4, DropOldest, ThreadWorker, StopDrain);
+    }
+    frameBus.addSink("screenshots", &screenshotter, 4, DropOldest);
+    if (frameShare)
+    {
+        frameBus.addSink("shared memory", frameShare, 2, DropOldest);
+    }
+    if (frameAnalyzer)
+    {
+        // Deep enough that only a stall drops frames, which the timeline shows as gaps
+        frameBus.addSink("frame analysis", frameAnalyzer, 16, DropOldest);
+    }
+    if (pipeOutput)
+    {
+        // A reader that falls behind skips frames, counted as drops for this sink
+        frameBus.addSink("frame stream", pipeOutput, 8, DropNewest);
+    }
+    frameBus.start();
+
+    MetricsServer* metricsServer = NULL;
+    if (options.metricsPort)
+    {
+        metricsServer = new MetricsServer(options.metricsPort);
+        metricsServer->watchCapture(dscapture);
+        metricsServer->watchFrameBus(&frameBus);
+        metricsServer->watchAudio(audioRecorder);
+        if (recording)
+        {
+            metricsServer->watchEncoder("recording", recording->metrics());
+            metricsServer->setRecordingControl(recording);
+        }
+        if (videoEncoder)
+        {
+            metricsServer->watchEncoder("live", videoEncoder->metrics());
+        }
+        if (screenMuxer)
+        {
+            metricsServer->watchEncoder("top", screenEncoders[0]->metrics());
+            metricsServer->watchEncoder("bottom", screenEncoders[1]->metrics());
+        }
+        if (renditions)
+        {
+            for (int i = 0; i < renditions->renditionCount(); ++i)
+                metricsServer->watchEncoder(renditions->renditionName(i), renditions->metrics(i));
+        }
+        if (rawRecorder)
+        {
+            metricsServer->watchRawRecorder(rawRecorder);
+        }
+        metricsServer->start();
+    }
+
+    audioRecorder->start();
+
+    CpuLoad* cpuLoad = options.cpuLoadThreads ? new CpuLoad(options.cpuLoadThreads) : NULL;
+    dscapture->startCapture();
+    printf("Started in %.0f ms: device %.0f ms, window %.0f ms and encoders %.0f ms in parallel\n",
+           millisecondsSince(launchTime), deviceMs, windowMs, encodersMs);
+    if (recording)
+    {
+        if (options.recordAtStart)
+            recording->toggle();
+        else
+            printf("Press R to start recording\n");
+    }
+
+    // Frames are grabbed and published on their own thread, so a window being
+    // moved or resized, which holds this thread in SDL's event loop, never
+    // holds up capture
+    std::atomic_bool publishing(true);
+    std::thread publishThread([&]() {
+        configureThread(ThreadCapture, "publisher");
+        while (publishing)
+        {
+            if (captureFrame(*dscapture, framePool, frameBus, frameNumber))
+                continue;
+
+            if (!dscapture->isCapturing())
+            {
+                // Replay finished
+                SDL_Event quitEvent = {};
+                quitEvent.type = SDL_QUIT;
+                SDL_PushEvent(&quitEvent);
+                break;
+            }
+            dscapture->waitForFrame(100);
+        }
+    });
 
     while (!quit)
     {
-        while (SDL_PollEvent(&event))
+        // Wakes for input, a window change from the presenter or the end of a replay
+        bool pending = SDL_WaitEventTimeout(&event, 100) != 0;
+        while (pending)
         {
             if (event.type == SDL_QUIT)
             {
                 quit = true;
             }
-            else if (event.type == SDL_KEYDOWN)
+            else if (!presenter.handleWindowEvent(event) && event.type == SDL_KEYDOWN && !event.key.repeat)
             {
-                if (event.key.repeat) continue;
-
                 switch (event.key.keysym.sym)
                 {
                     case SDLK_1:
-                        scale = 1;
-                        resizeWindow(window, scale, screenMode);
+                        presenter.sendCommand(PresentSetScale, 1);
                         break;
                     case SDLK_2:
-                        scale = 2;
-                        resizeWindow(window, scale, screenMode);
+                        presenter.sendCommand(PresentSetScale, 2);
                         break;
                     case SDLK_3:
-                        scale = 3;
-                        resizeWindow(window, scale, screenMode);
+                        presenter.sendCommand(PresentSetScale, 3);
                         break;
                     case SDLK_4:
-                        scale = 4;
-                        resizeWindow(window, scale, screenMode);
+                        presenter.sendCommand(PresentSetScale, 4);
                         break;
                     case SDLK_m:
-                        screenMode = static_cast<screen_mode>((screenMode + 1) % NUM_SCREEN_MODES);
-                        resizeWindow(window, scale, screenMode);
+                        presenter.sendCommand(PresentNextMode);
+                        break;
+                    case SDLK_s:
+                        screenshotter.snapshot();
+                        break;
+                    case SDLK_b:
+                        screenshotter.burst();
+                        break;
+                    case SDLK_r:
+                        if (recording)
+                            recording->toggle();
                         break;
                 }
             }
+            pending = SDL_PollEvent(&event) != 0;
         }
 
-        captureFrame(dscapture, videoEncoder, dsFrameBuffer, texture);
-
-        SDL_Rect src = getSrcRectForMode(screenMode);
-        if (screenMode == Horizontal)
-        {
-            SDL_Rect dest;
-            dest.x = dest.y = 0;
-            dest.w = DS_WIDTH * scale;
-            dest.h = DS_HEIGHT * scale;
-            SDL_RenderCopy(renderer, texture, &src, &dest);
-            src.y += DS_HEIGHT;
-            dest.x += DS_WIDTH * scale;
-            SDL_RenderCopy(renderer, texture, &src, &dest);
-        }
-        else
+        if (!firstFrameShown && presenter.framesPresented() > 0)
         {
-            SDL_RenderCopy(renderer, texture, &src, NULL);
+            printf("First frame shown %.0f ms after launch\n", millisecondsSince(launchTime));
+            firstFrameShown = true;
         }
-        SDL_RenderPresent(renderer);
+    }
 
-        ++frameCounter;
-        currentTime = SDL_GetTicks();
-        if (currentTime - lastTime >= 1000)
-        {
-            setWindowTitle(window, screenMode, frameCounter);
-            frameCounter = 0;
-            lastTime = currentTime;
-        }
+    publishing = false;
+    publishThread.join();
+
+    delete metricsServer; // Before anything it watches goes away
+    audioRecorder->stop();
+    dscapture->endCapture();
+    delete cpuLoad;
+    if (pipeOutput)
+    {
+        pipeOutput->finish(); // So a stalled reader can't hold up stopping the bus
     }
+    frameBus.stop();
+    presenter.stop();
 
-    audioRecorder.stop();
-    dscapture.endCapture();
+    if (videoEncoder)
+    {
+        videoEncoder->setPacketSink(NULL);
+    }
+    audioRecorder->setPacketSink(NULL);
+    delete liveStream;
+    if (videoEncoder)
+    {
+        videoEncoder->reportQuality();
+    }
+    delete videoEncoder;
 
-    destroyAll(window, renderer, texture);
+    if (recording)
+    {
+        recording->report();
+        delete recording; // Waits for the last recording to be flushed
+    }
 
-    delete [] dsFrameBuffer;
+    if (screenMuxer)
+    {
+        // The encoders flush into the muxer as they are deleted
+        delete screenEncoders[0];
+        delete screenEncoders[1];
+        screenMuxer->finish();
+        delete screenMuxer;
+    }
 
-    SDL_Quit();
-    return 0;
-}
+    if (renditions)
+    {
+        renditions->stop(); // Flushes each encoder into its file
+        renditions->report();
+        delete renditions;
+    }
 
-// Initializes SDL and DS capture device.
-// Returns false if an error occurred.
-bool init(SDL_Window ** window, SDL_Renderer ** renderer, SDL_Texture ** texture)
-{
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+    delete audioRecorder;
+
+    if (rawRecorder)
     {
-        printf("Could not initialize SDL: %s\n", SDL_GetError());
-        return false;
+        rawRecorder->stop();
+        rawRecorder->report();
+        delete rawRecorder;
     }
 
-    *window = SDL_CreateWindow("KDSCap - Vertical DS", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (*window == NULL)
+    if (frameShare)
     {
-        printf("Could not create window: %s\n", SDL_GetError());
-        return false;
+        frameShare->report();
+        delete frameShare;
     }
 
-    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED);
-    if (*renderer == NULL)
+    if (frameAnalyzer)
     {
-        printf("Could not create renderer: %s\n", SDL_GetError());
-        return false;
+        frameAnalyzer->report();
+        delete frameAnalyzer;
     }
 
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
-    *texture = SDL_CreateTexture(*renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING, DS_WIDTH, DS_HEIGHT * 2);
-    if (*texture == NULL)
+    if (pipeOutput)
     {
-        printf("Could not create texture: %s\n", SDL_GetError());
-        return false;
+        pipeOutput->report();
+        delete pipeOutput;
     }
 
-    return true;
+    frameBus.report();
+    dscapture->reportCompleteness();
+    printf("Presented %u frames\n", presenter.framesPresented());
+    reportSchedulingLatency();
+
+    SDL_DestroyWindow(window);
+    delete dscapture;
+
+    SDL_Quit();
+
+    return checkLatency(options, latencyStats);
 }
 
-void captureFrame(DSCapture& capture, VideoEncoder& encoder, uint16_t* dsFrameBuffer, SDL_Texture* texture)
+// Plays a replay through the frame bus to a presenter rendering offscreen,
+// with no window, audio or output files, so latency can be checked in CI.
+// Returns the exit code.
+int runHeadless(const Options& options, LatencyStats& latencyStats)
 {
-    static void* pixels;
-    static int pitch;
+    if (!options.replayPath)
+    {
+        printf("--headless needs --replay\n");
+        return 1;
+    }
+    if (SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        printf("Could not initialize SDL: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    int result = 1;
+    try
+    {
+        DSCapture capture(options.replayPath);
+        if (options.truncatePercent > 0)
+            capture.setSourceTruncation(options.truncatePercent);
 
-    capture.grabFrame(dsFrameBuffer);
-    encoder.sendFrame(dsFrameBuffer);
+        FramePool framePool(64);
+        FrameBus frameBus;
+        Presenter presenter(NULL, &latencyStats);
+        if (presenter.start())
+        {
+            frameBus.addSink("presenter", &presenter, 2, DropOldest, ThreadRender);
+            frameBus.start();
+
+            uint64_t frameNumber = 0;
+            capture.startCapture();
+            while (true)
+            {
+                if (captureFrame(capture, framePool, frameBus, frameNumber))
+                    continue;
+                if (!capture.isCapturing())
+                    break; // Replay finished
+                SDL_Delay(1);
+            }
+            capture.endCapture();
+            frameBus.stop();
+            presenter.stop();
 
-    SDL_LockTexture(texture, NULL, &pixels, &pitch);
-    memcpy(pixels, dsFrameBuffer, DS_WIDTH * DS_HEIGHT * 2 * 2);
-    SDL_UnlockTexture(texture);
+            frameBus.report();
+            capture.reportCompleteness();
+            printf("Presented %u frames\n", presenter.framesPresented());
+            result = checkLatency(options, latencyStats);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        printf("%s\n", e.what());
+    }
+
+    SDL_Quit();
+    return result;
 }
 
-// Destroys SDL objects
-void destroyAll(SDL_Window* window, SDL_Renderer* renderer, SDL_Texture* texture)
+// Reports latency if it was measured.
+// Returns the exit code: 1 if p99 end-to-end latency is over the budget.
+int checkLatency(const Options& options, LatencyStats& latencyStats)
 {
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (options.measureLatency)
+    {
+        latencyStats.report();
+        if (options.latencyBudget > 0.0 && latencyStats.percentile(LatencyEndToEnd, 99) > options.latencyBudget)
+        {
+            printf("p99 end-to-end latency is over the %.2f ms budget\n", options.latencyBudget);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Initializes SDL and creates the window. The renderer is created by the presenter.
+// Returns false if an error occurred.
+bool init(SDL_Window ** window)
+{
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
+    {
+        printf("Could not initialize SDL: %s\n", SDL_GetError());
+        return false;
+    }
+
+    *window = SDL_CreateWindow("KDSCap - Vertical DS", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    if (*window == NULL)
+    {
+        printf("Could not create window: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
 }
 
-void resizeWindow(SDL_Window* window, int scale, screen_mode mode)
+// Grabs the next frame from the capture device into a pooled frame and
+// hands it to every sink on the frame bus.
+// Returns false if no new frame was available.
+bool captureFrame(DSCapture& capture, FramePool& pool, FrameBus& bus, uint64_t& frameNumber)
 {
-    switch (mode)
-    {
-        case Vertical:
-            SDL_SetWindowSize(window, SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale);
-            break;
-        case Horizontal:
-            SDL_SetWindowSize(window, DS_WIDTH * 2 * scale, DS_HEIGHT * scale);
-            break;
-        case GBABottom:
-            SDL_SetWindowSize(window, GBA_WIDTH * scale, GBA_HEIGHT * scale);
-            break;
-        case GBATop:
-            SDL_SetWindowSize(window, GBA_WIDTH * scale, GBA_HEIGHT * scale);
-            break;
+    Frame* frame = pool.acquire();
+    if (!frame)
+    {
+        // Every pooled frame is still held by a sink. Drop this one rather than stall the device.
+        static uint16_t discard[DS_WIDTH * DS_HEIGHT * 2];
+        if (!capture.grabFrame(discard))
+            return false;
+        bus.countPoolDrop(); // Reported with the sink stats, never per frame on the capture thread
+        ++frameNumber;
+        return true;
     }
+
+    FrameRef ref(frame);
+    if (!capture.grabFrame(frame->pixels, &frame->info))
+        return false;
+
+    frame->number = frameNumber++;
+    bus.publish(ref);
+    return true;
 }
 
-void setWindowTitle(SDL_Window* window, screen_mode mode, unsigned int framerate)
+double millisecondsSince(std::chrono::steady_clock::time_point start)
 {
-    char buffer[80];
-    switch (mode)
-    {
-        case Vertical:
-            snprintf(buffer, 80, "KDSCap - Vertical DS - %d fps", framerate);
-            break;
-        case Horizontal:
-            snprintf(buffer, 80, "KDSCap - Horizontal DS - %d fps", framerate);
-            break;
-        case GBABottom:
-            snprintf(buffer, 80, "KDSCap - GBA Bottom - %d fps", framerate);
-            break;
-        case GBATop:
-            snprintf(buffer, 80, "KDSCap - GBA Top - %d fps", framerate);
-            break;
-    }
-    SDL_SetWindowTitle(window, buffer);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
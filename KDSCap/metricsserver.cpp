@@ -0,0 +1,384 @@
+// winsock2.h has to come before anything that pulls in Windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "metricsserver.h"
+#include "socketaccept.h"
+#include "threadpolicy.h"
+
+MetricsServer::MetricsServer(int port) :
+    port(port),
+    listenSocket(INVALID_SOCKET),
+    running(false),
+    capture(NULL),
+    frameBus(NULL),
+    audio(NULL),
+    rawRecorder(NULL),
+    recording(NULL),
+    lastScrapeTime(0),
+    lastScrapeFrames(0),
+    scrapes(0),
+    commands(0)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        throw std::runtime_error("Could not initialize winsock");
+    }
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET)
+    {
+        throw std::runtime_error("Could not create metrics socket");
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(( u_short) port);
+    if (bind(s, ( sockaddr*) &address, sizeof(address)) == SOCKET_ERROR || listen(s, SOMAXCONN) == SOCKET_ERROR)
+    {
+        printf("Could not listen on port %d: %d\n", port, WSAGetLastError());
+        closesocket(s);
+        throw std::runtime_error("Could not listen for metrics scrapes");
+    }
+    listenSocket = s;
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+    WSACleanup();
+}
+
+void MetricsServer::watchCapture(DSCapture* capture)
+{
+    this->capture = capture;
+}
+
+void MetricsServer::watchFrameBus(FrameBus* bus)
+{
+    frameBus = bus;
+}
+
+void MetricsServer::watchEncoder(const char* name, EncoderMetrics* metrics)
+{
+    encoders.push_back(std::make_pair(std::string(name), metrics));
+}
+
+void MetricsServer::watchAudio(AudioRecorder* audio)
+{
+    this->audio = audio;
+}
+
+void MetricsServer::watchRawRecorder(RawRecorder* recorder)
+{
+    rawRecorder = recorder;
+}
+
+// Without one, start, stop and segment are refused
+void MetricsServer::setRecordingControl(RecordingControl* recording)
+{
+    this->recording = recording;
+}
+
+void MetricsServer::start()
+{
+    lastScrapeTime = SDL_GetPerformanceCounter();
+    running = true;
+    serverThread = std::thread(&MetricsServer::serve, this);
+    printf("Metrics on http://127.0.0.1:%d/metrics\n", port);
+}
+
+void MetricsServer::stop()
+{
+    if (listenSocket == INVALID_SOCKET)
+        return;
+
+    running = false;
+    closesocket(( SOCKET) listenSocket); // Wakes up accept()
+    listenSocket = INVALID_SOCKET;
+    if (serverThread.joinable())
+    {
+        serverThread.join();
+        printf("Metrics: %u scrapes, %u commands\n", scrapes, commands);
+    }
+}
+
+// Connections are handled one at a time; scrapes and commands are rare and quick
+void MetricsServer::serve()
+{
+    configureThread(ThreadWorker, "metrics");
+    uintptr_t listening = listenSocket; // stop() clears listenSocket once it has closed it
+
+    while (true)
+    {
+        SOCKET s = ( SOCKET) acceptConnection(listening, running);
+        if (s == INVALID_SOCKET)
+            break;
+
+        DWORD timeout = METRICS_REQUEST_TIMEOUT_MS;
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, ( const char*) &timeout, sizeof(timeout));
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, ( const char*) &timeout, sizeof(timeout));
+        handleConnection(s);
+        shutdown(s, SD_BOTH);
+        closesocket(s);
+    }
+}
+
+void MetricsServer::handleConnection(uintptr_t client)
+{
+    SOCKET s = ( SOCKET) client;
+
+    // An HTTP request is read up to the end of its headers, a command up to its newline
+    char request[METRICS_MAX_REQUEST];
+    int length = 0;
+    while (length < METRICS_MAX_REQUEST - 1)
+    {
+        int received = recv(s, request + length, METRICS_MAX_REQUEST - 1 - length, 0);
+        if (received <= 0)
+            break;
+        length += received;
+        request[length] = '\0';
+
+        bool http = strncmp(request, "GET ", 4) == 0;
+        if (http ? strstr(request, "\r\n\r\n") != NULL : strchr(request, '\n') != NULL)
+            break;
+    }
+    request[length] = '\0';
+    if (length == 0)
+        return;
+
+    std::string response;
+    if (strncmp(request, "GET ", 4) == 0)
+    {
+        const char* path = request + 4;
+        bool found = strncmp(path, "/metrics ", 9) == 0 || strncmp(path, "/ ", 2) == 0;
+        std::string body = found ? renderMetrics() : "Not found\n";
+
+        char header[256];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                 found ? "200 OK" : "404 Not Found", body.size());
+        response = header + body;
+    }
+    else
+    {
+        std::string command(request, strcspn(request, "\r\n"));
+        response = runCommand(command);
+    }
+
+    const char* data = response.data();
+    int remaining = ( int) response.size();
+    while (remaining > 0)
+    {
+        int sent = send(s, data, remaining, 0);
+        if (sent == SOCKET_ERROR)
+            return;
+        data += sent;
+        remaining -= sent;
+    }
+}
+
+std::string MetricsServer::runCommand(const std::string& command)
+{
+    if (command == "metrics")
+        return renderMetrics();
+
+    if (command != "start" && command != "stop" && command != "segment")
+        return "error: unknown command, expected metrics, start, stop or segment\n";
+    if (!recording)
+        return "error: recording can't be controlled in this session\n";
+
+    ++commands;
+    printf("Control command: %s\n", command.c_str());
+    if (command == "start")
+    {
+        recording->setRecording(true);
+    }
+    else if (command == "stop")
+    {
+        recording->setRecording(false);
+    }
+    else if (!recording->splitSegment())
+    {
+        return "error: not recording\n";
+    }
+    return "ok\n";
+}
+
+std::string MetricsServer::renderMetrics()
+{
+    std::string out;
+    char labels[128];
+    ++scrapes;
+
+    if (capture)
+    {
+        const CaptureMetrics& metrics = capture->metrics();
+        uint64_t frames = metrics.frames.load(std::memory_order_relaxed);
+        uint64_t now = SDL_GetPerformanceCounter();
+        double seconds = ( double) (now - lastScrapeTime) / SDL_GetPerformanceFrequency();
+        double fps = seconds > 0.0 ? (frames - lastScrapeFrames) / seconds : 0.0;
+        lastScrapeTime = now;
+        lastScrapeFrames = frames;
+
+        writeMetricHeader(out, "counter", "kdscap_frames_captured_total", "Frames read from the capture source");
+        writeMetricSample(out, "kdscap_frames_captured_total", ( double) frames);
+        writeMetricHeader(out, "gauge", "kdscap_capture_fps", "Frames captured per second since the previous scrape");
+        writeMetricSample(out, "kdscap_capture_fps", fps);
+        writeMetricHeader(out, "counter", "kdscap_frames_lost_total", "Frames that never arrived from the device");
+        writeMetricSample(out, "kdscap_frames_lost_total", ( double) capture->framesLost());
+        writeMetricHeader(out, "gauge", "kdscap_capture_ring_frames", "Captured frames waiting to be grabbed");
+        writeMetricSample(out, "kdscap_capture_ring_frames", capture->framesQueued());
+        writeMetricHeader(out, "gauge", "kdscap_capture_ring_size", "Frames the capture ring holds");
+        writeMetricSample(out, "kdscap_capture_ring_size", DS_BUFFER_SIZE);
+        writeMetricHeader(out, "counter", "kdscap_capture_bytes_read_total", "Frame payload bytes read from the capture source");
+        writeMetricSample(out, "kdscap_capture_bytes_read_total", ( double) metrics.bytesRead.load(std::memory_order_relaxed));
+        writeMetricHeader(out, "histogram", "kdscap_usb_transfer_seconds", "Time from requesting a frame until it had arrived");
+        metrics.transferTime.write(out, "kdscap_usb_transfer_seconds");
+    }
+
+    if (frameBus)
+    {
+        int sinks = frameBus->sinkCount();
+        FrameSinkStats stats[16];
+        if (sinks > 16)
+            sinks = 16;
+        for (int i = 0; i < sinks; ++i)
+            stats[i] = frameBus->sinkStats(i);
+
+        writeMetricHeader(out, "counter", "kdscap_pool_dropped_frames_total", "Frames dropped because every pooled frame was still held by a sink");
+        writeMetricSample(out, "kdscap_pool_dropped_frames_total", ( double) frameBus->poolDroppedFrames());
+        writeMetricHeader(out, "counter", "kdscap_sink_delivered_frames_total", "Frames a sink has consumed");
+        for (int i = 0; i < sinks; ++i)
+        {
+            snprintf(labels, sizeof(labels), "sink=\"%s\"", stats[i].name);
+            writeMetricSample(out, "kdscap_sink_delivered_frames_total", ( double) stats[i].delivered, labels);
+        }
+        writeMetricHeader(out, "counter", "kdscap_sink_dropped_frames_total", "Frames a sink's queue had to drop");
+        for (int i = 0; i < sinks; ++i)
+        {
+            snprintf(labels, sizeof(labels), "sink=\"%s\"", stats[i].name);
+            writeMetricSample(out, "kdscap_sink_dropped_frames_total", ( double) stats[i].dropped, labels);
+        }
+        writeMetricHeader(out, "gauge", "kdscap_sink_lag_frames", "Frames between the newest capture and the last one a sink finished");
+        for (int i = 0; i < sinks; ++i)
+        {
+            snprintf(labels, sizeof(labels), "sink=\"%s\"", stats[i].name);
+            writeMetricSample(out, "kdscap_sink_lag_frames", ( double) stats[i].lag, labels);
+        }
+    }
+
+    if (!encoders.empty())
+    {
+        writeMetricHeader(out, "counter", "kdscap_encoded_frames_total", "Frames sent to the video encoder");
+        for (auto& encoder : encoders)
+        {
+            snprintf(labels, sizeof(labels), "encoder=\"%s\"", encoder.first.c_str());
+            writeMetricSample(out, "kdscap_encoded_frames_total", ( double) encoder.second->frames.load(std::memory_order_relaxed), labels);
+        }
+        writeMetricHeader(out, "counter", "kdscap_encoded_bytes_total", "Encoded video bytes written");
+        for (auto& encoder : encoders)
+        {
+            snprintf(labels, sizeof(labels), "encoder=\"%s\"", encoder.first.c_str());
+            writeMetricSample(out, "kdscap_encoded_bytes_total", ( double) encoder.second->bytes.load(std::memory_order_relaxed), labels);
+        }
+        writeMetricHeader(out, "counter", "kdscap_encoder_dropped_frames_total", "Frames skipped because the codec still held every buffer");
+        for (auto& encoder : encoders)
+        {
+            snprintf(labels, sizeof(labels), "encoder=\"%s\"", encoder.first.c_str());
+            writeMetricSample(out, "kdscap_encoder_dropped_frames_total", ( double) encoder.second->dropped.load(std::memory_order_relaxed), labels);
+        }
+        writeMetricHeader(out, "histogram", "kdscap_encode_seconds", "Time to encode one frame");
+        for (auto& encoder : encoders)
+        {
+            snprintf(labels, sizeof(labels), "encoder=\"%s\"", encoder.first.c_str());
+            encoder.second->encodeTime.write(out, "kdscap_encode_seconds", labels);
+        }
+    }
+
+    if (audio)
+    {
+        writeMetricHeader(out, "counter", "kdscap_audio_overruns_total", "Audio callbacks so late the device's buffer overflowed");
+        writeMetricSample(out, "kdscap_audio_overruns_total", ( double) audio->overruns());
+        writeMetricHeader(out, "counter", "kdscap_audio_bytes_written_total", "Encoded audio bytes written to disk");
+        writeMetricSample(out, "kdscap_audio_bytes_written_total", ( double) audio->bytesWritten());
+    }
+
+    if (rawRecorder)
+    {
+        writeMetricHeader(out, "counter", "kdscap_raw_bytes_written_total", "Raw recording bytes written to disk");
+        writeMetricSample(out, "kdscap_raw_bytes_written_total", ( double) rawRecorder->bytesWritten());
+        writeMetricHeader(out, "counter", "kdscap_raw_dropped_frames_total", "Frames the raw recorder dropped because the disk fell behind or a write failed");
+        writeMetricSample(out, "kdscap_raw_dropped_frames_total", ( double) rawRecorder->droppedFrames());
+        writeMetricHeader(out, "gauge", "kdscap_raw_write_failed", "1 once a raw recording write has failed and the recording stopped");
+        writeMetricSample(out, "kdscap_raw_write_failed", rawRecorder->failed() ? 1 : 0);
+    }
+
+    if (recording)
+    {
+        writeMetricHeader(out, "gauge", "kdscap_recording", "1 while recording");
+        writeMetricSample(out, "kdscap_recording", recording->isRecording() ? 1 : 0);
+    }
+
+    return out;
+}
+
+int sendControlCommand(int port, const char* command)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        printf("Could not initialize winsock\n");
+        return 1;
+    }
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(( u_short) port);
+    if (s == INVALID_SOCKET || connect(s, ( sockaddr*) &address, sizeof(address)) == SOCKET_ERROR)
+    {
+        printf("Could not connect to port %d: %d\n", port, WSAGetLastError());
+        if (s != INVALID_SOCKET)
+            closesocket(s);
+        WSACleanup();
+        return 1;
+    }
+
+    std::string line = std::string(command) + "\n";
+    send(s, line.data(), ( int) line.size(), 0);
+    shutdown(s, SD_SEND);
+
+    std::string response;
+    char buffer[4096];
+    int received;
+    while ((received = recv(s, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, received);
+    }
+    closesocket(s);
+    WSACleanup();
+
+    printf("%s", response.c_str());
+    if (response.empty() || response.compare(0, 6, "error:") == 0)
+        return 1;
+
+    // A scrape only passes once the instance has actually captured something
+    if (strcmp(command, "metrics") == 0)
+    {
+        size_t at = response.find("\nkdscap_frames_captured_total ");
+        if (at == std::string::npos || strtoull(response.c_str() + at + 30, NULL, 10) == 0)
+        {
+            printf("No frames captured yet\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "audiorecorder.h"
+#include "framebus.h"
+#include "rawrecorder.h"
+#include "recordingcontrol.h"
+#include "videoencoder.h"
+#include "win_dscapture.h"
+
+#define METRICS_REQUEST_TIMEOUT_MS 2000 // A client that sends nothing for this long is hung up on
+#define METRICS_MAX_REQUEST 4096
+
+// Serves the pipeline's counters and histograms as Prometheus text on a
+// localhost port, and takes recording commands on the same port. Scrape with
+// GET /metrics over HTTP, or connect and send one command on a line:
+// metrics, start, stop or segment.
+// Everything is read from lock-free counters the pipeline keeps as it runs,
+// so a scrape never blocks capture or encoding. Whatever is watched has to be
+// registered before start() and outlive stop().
+class MetricsServer
+{
+public:
+    MetricsServer(int port);
+    ~MetricsServer();
+
+    void watchCapture(DSCapture* capture);
+    void watchFrameBus(FrameBus* bus);
+    void watchEncoder(const char* name, EncoderMetrics* metrics);
+    void watchAudio(AudioRecorder* audio);
+    void watchRawRecorder(RawRecorder* recorder);
+    void setRecordingControl(RecordingControl* recording);
+
+    void start();
+    void stop();
+
+private:
+    int port;
+    uintptr_t listenSocket; // SOCKET, kept opaque so winsock stays out of the header
+    std::thread serverThread;
+    std::atomic_bool running;
+
+    DSCapture* capture;
+    FrameBus* frameBus;
+    std::vector<std::pair<std::string, EncoderMetrics*>> encoders;
+    AudioRecorder* audio;
+    RawRecorder* rawRecorder;
+    RecordingControl* recording;
+
+    // Only touched on the server thread
+    uint64_t lastScrapeTime;
+    uint64_t lastScrapeFrames;
+    unsigned int scrapes;
+    unsigned int commands;
+
+    void serve();
+    void handleConnection(uintptr_t client);
+    std::string runCommand(const std::string& command);
+    std::string renderMetrics();
+};
+
+// Sends one command to a running instance's metrics port and prints the reply.
+// Returns the process exit code.
+int sendControlCommand(int port, const char* command);
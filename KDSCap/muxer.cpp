@@ -0,0 +1,100 @@
+#include <stdexcept>
+#include "muxer.h"
+
+Muxer::Muxer(const char* filename) :
+    formatContext(NULL),
+    started(false),
+    finished(false)
+{
+    if (avformat_alloc_output_context2(&formatContext, NULL, NULL, filename) < 0)
+    {
+        printf("Could not find an output format for %s\n", filename);
+        throw std::runtime_error("Could not allocate muxer");
+    }
+
+    if (avio_open(&formatContext->pb, filename, AVIO_FLAG_WRITE) < 0)
+    {
+        avformat_free_context(formatContext);
+        throw std::runtime_error("Could not open file");
+    }
+
+    packet = av_packet_alloc();
+    if (!packet)
+    {
+        throw std::runtime_error("Could not allocate muxer packet");
+    }
+}
+
+Muxer::~Muxer()
+{
+    finish();
+    av_packet_free(&packet);
+    avio_closep(&formatContext->pb);
+    avformat_free_context(formatContext);
+}
+
+// True if encoders feeding this muxer have to be opened with AV_CODEC_FLAG_GLOBAL_HEADER
+bool Muxer::needsGlobalHeader()
+{
+    return (formatContext->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+}
+
+// Adds a track for an opened encoder. Must be called before start.
+void Muxer::addStream(const AVCodecContext* context)
+{
+    AVStream* stream = avformat_new_stream(formatContext, NULL);
+    if (!stream)
+    {
+        throw std::runtime_error("Could not create stream");
+    }
+
+    if (avcodec_parameters_from_context(stream->codecpar, context) < 0)
+    {
+        throw std::runtime_error("Could not copy codec parameters");
+    }
+    stream->time_base = context->time_base;
+    streamContexts.push_back(context);
+}
+
+void Muxer::start()
+{
+    if (avformat_write_header(formatContext, NULL) < 0)
+    {
+        throw std::runtime_error("Could not write file header");
+    }
+    started = true;
+}
+
+// Writes the trailer. Every encoder has to have been flushed first.
+void Muxer::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!started || finished)
+        return;
+
+    av_write_trailer(formatContext);
+    finished = true;
+}
+
+void Muxer::writePacket(const AVCodecContext* context, AVPacket* encoded)
+{
+    int streamIndex = -1;
+    for (size_t i = 0; i < streamContexts.size(); ++i)
+    {
+        if (streamContexts[i] == context)
+            streamIndex = ( int) i;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (streamIndex < 0 || !started || finished)
+        return;
+
+    // Reference the encoder's data rather than copying it
+    if (av_packet_ref(packet, encoded) < 0)
+        return;
+
+    packet->stream_index = streamIndex;
+    av_packet_rescale_ts(packet, context->time_base, formatContext->streams[streamIndex]->time_base);
+    av_interleaved_write_frame(formatContext, packet);
+    av_packet_unref(packet);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "packetsink.h"
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+}
+
+// Muxes packets from any number of encoders into one file, one track per
+// encoder. The container follows the file's extension, e.g. .mkv or .mp4.
+// Packets may arrive from several encoder threads at once.
+class Muxer : public PacketSink
+{
+public:
+    Muxer(const char* filename);
+    ~Muxer();
+
+    bool needsGlobalHeader();
+    void addStream(const AVCodecContext* context);
+    void start();
+    void finish();
+
+    void writePacket(const AVCodecContext* context, AVPacket* packet) override;
+
+private:
+    AVFormatContext* formatContext;
+    AVPacket* packet;
+    std::vector<const AVCodecContext*> streamContexts;
+    std::mutex mutex;
+    bool started;
+    bool finished;
+};
@@ -0,0 +1,208 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "options.h"
+
+// Parses the command line into options.
+// Returns false if an argument was not recognized.
+bool parseOptions(int argc, char* argv[], Options* options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--replay") == 0 && hasValue)
+        {
+            options->replayPath = argv[++i];
+        }
+        else if (strcmp(arg, "--latency") == 0)
+        {
+            options->measureLatency = true;
+        }
+        else if (strcmp(arg, "--headless") == 0)
+        {
+            options->headless = true;
+            options->measureLatency = true;
+        }
+        else if (strcmp(arg, "--latency-budget") == 0 && hasValue)
+        {
+            options->measureLatency = true;
+            options->latencyBudget = atof(argv[++i]);
+        }
+        else if (strcmp(arg, "--live-port") == 0 && hasValue)
+        {
+            options->livePort = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--live-udp") == 0 && hasValue)
+        {
+            options->liveUdp = argv[++i];
+        }
+        else if (strcmp(arg, "--share-frames") == 0)
+        {
+            options->shareFrames = true;
+        }
+        else if (strcmp(arg, "--burst-frames") == 0 && hasValue)
+        {
+            options->burstFrames = atoi(argv[++i]);
+            if (options->burstFrames < 1)
+                return false;
+        }
+        else if (strcmp(arg, "--synthetic") == 0 && hasValue)
+        {
+            options->useSynthetic = true;
+            if (!SyntheticSource::parseScene(argv[++i], &options->syntheticScene))
+                return false;
+        }
+        else if (strcmp(arg, "--truncate-frames") == 0 && hasValue)
+        {
+            options->truncatePercent = atoi(argv[++i]);
+            if (options->truncatePercent < 0 || options->truncatePercent > 100)
+                return false;
+        }
+        else if (strcmp(arg, "--large-pages") == 0)
+        {
+            options->frameMemoryFlags |= FRAME_MEMORY_LARGE_PAGES;
+        }
+        else if (strcmp(arg, "--lock-frame-memory") == 0)
+        {
+            options->frameMemoryFlags |= FRAME_MEMORY_LOCKED;
+        }
+        else if (strcmp(arg, "--record-raw") == 0 && hasValue)
+        {
+            options->rawPath = argv[++i];
+        }
+        else if (strcmp(arg, "--compress-raw") == 0)
+        {
+            options->compressRaw = true;
+        }
+        else if (strcmp(arg, "--transcode") == 0 && i + 2 < argc)
+        {
+            options->transcodeInput = argv[++i];
+            options->transcodeOutput = argv[++i];
+        }
+        else if (strcmp(arg, "--transcode-preset") == 0 && hasValue)
+        {
+            options->transcodePreset = argv[++i];
+        }
+        else if (strcmp(arg, "--adaptive-quality") == 0)
+        {
+            options->adaptiveQuality = true;
+        }
+        else if (strcmp(arg, "--starve-cpu") == 0 && hasValue)
+        {
+            options->cpuLoadThreads = atoi(argv[++i]);
+            if (options->cpuLoadThreads < 1)
+                return false;
+        }
+        else if (strcmp(arg, "--record") == 0)
+        {
+            options->recordAtStart = true;
+        }
+        else if (strcmp(arg, "--split-screens") == 0 && hasValue)
+        {
+            options->splitPath = argv[++i];
+        }
+        else if (strcmp(arg, "--benchmark") == 0 && hasValue)
+        {
+            options->benchmarkPath = argv[++i];
+        }
+        else if (strcmp(arg, "--benchmark-frames") == 0 && hasValue)
+        {
+            options->benchmarkFrames = atoi(argv[++i]);
+            if (options->benchmarkFrames < 1)
+                return false;
+        }
+        else if (strcmp(arg, "--thread-policy") == 0 && hasValue)
+        {
+            if (!parseThreadPolicy(argv[++i], options->threadPolicies))
+            {
+                printf("Invalid thread policy: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--process-priority") == 0 && hasValue)
+        {
+            options->processPriority = argv[++i];
+        }
+        else if (strcmp(arg, "--analyze-frames") == 0 && hasValue)
+        {
+            options->analysisPath = argv[++i];
+        }
+        else if (strcmp(arg, "--metrics-port") == 0 && hasValue)
+        {
+            options->metricsPort = atoi(argv[++i]);
+        }
+        else if (strcmp(arg, "--control") == 0 && i + 2 < argc)
+        {
+            options->controlPort = atoi(argv[++i]);
+            options->controlCommand = argv[++i];
+        }
+        else if (strcmp(arg, "--pipe") == 0 && hasValue)
+        {
+            options->pipeTarget = argv[++i];
+        }
+        else if (strcmp(arg, "--pipe-format") == 0 && hasValue)
+        {
+            if (!PipeOutput::parseFormat(argv[++i], &options->pipeFormat))
+                return false;
+        }
+        else if (strcmp(arg, "--rendition") == 0 && i + 2 < argc)
+        {
+            if (options->renditionCount == MAX_RENDITIONS)
+            {
+                printf("At most %d renditions can be encoded\n", MAX_RENDITIONS);
+                return false;
+            }
+            RenditionSettings* rendition = &options->renditions[options->renditionCount++];
+            if (!RenditionSet::parseSettings(argv[++i], rendition))
+            {
+                printf("Invalid rendition: %s\n", argv[i]);
+                return false;
+            }
+            rendition->filename = argv[++i];
+        }
+        else
+        {
+            printf("Unknown argument: %s\n", arg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void printUsage()
+{
+    printf("Usage: KDSCap [options]\n");
+    printf("  --replay <file>          Play back a recorded capture instead of using the device\n");
+    printf("  --latency                Report capture-to-photon latency on exit\n");
+    printf("  --latency-budget <ms>    Exit with an error if p99 end-to-end latency exceeds <ms>\n");
+    printf("  --headless               With --replay, measure latency with no window, audio or files\n");
+    printf("  --live-port <port>       Serve a live MPEG-TS stream on tcp://127.0.0.1:<port>\n");
+    printf("  --live-udp <host:port>   Send the live MPEG-TS stream over UDP, e.g. to 239.0.0.1:1234\n");
+    printf("  --share-frames           Publish raw frames to shared memory (see framesharereader.h)\n");
+    printf("  --burst-frames <n>       Number of frames saved by a burst capture (default 60)\n");
+    printf("  --synthetic <scene>      Capture a generated scene: static, scrolling, fullmotion or partial\n");
+    printf("  --truncate-frames <pct>  Cut short this percentage of replayed or synthetic frames\n");
+    printf("  --large-pages            Keep frames in large pages (needs the Lock pages in memory right)\n");
+    printf("  --lock-frame-memory      Lock frame memory so it is never paged out\n");
+    printf("  --record-raw <file>      Record undecoded frames to <file> instead of encoding video live\n");
+    printf("  --compress-raw           LZ compress the raw recording\n");
+    printf("  --transcode <raw> <out>  Encode a raw recording on every core, then exit\n");
+    printf("  --transcode-preset <p>   x264 preset for --transcode (default medium)\n");
+    printf("  --split-screens <file>   Encode the screens as two video tracks in <file>, e.g. screens.mkv\n");
+    printf("  --benchmark <file>       Benchmark the pipeline on synthetic frames and write JSON results\n");
+    printf("  --benchmark-frames <n>   Frames per benchmark stage (default 600)\n");
+    printf("  --thread-policy <p>      Schedule a kind of thread, e.g. capture:highest:0x2 (see README)\n");
+    printf("  --process-priority <c>   Process priority class: normal, above, high or realtime\n");
+    printf("  --record                 Start recording video and audio at launch rather than on R\n");
+    printf("  --adaptive-quality       Adapt CRF, preset and lookahead to keep up in real time\n");
+    printf("  --starve-cpu <n>         Keep <n> threads spinning, to test on a busy machine\n");
+    printf("  --metrics-port <port>    Serve Prometheus metrics and take control commands on <port>\n");
+    printf("  --control <port> <cmd>   Send metrics, start, stop or segment to a running instance\n");
+    printf("  --analyze-frames <file>  Write a CSV timeline of changed, lag and duplicate frames\n");
+    printf("  --pipe <target>          Stream frames to - (stdout), \\\\.\\pipe\\<name>, fd:<n> or a file\n");
+    printf("  --pipe-format <f>        Frame stream format: rgb565, yuv420p or y4m (default y4m)\n");
+    printf("  --rendition <r> <file>   Also encode to <file>; <r> is codec:kbps:scale[:preset], e.g. libx264:1500:2\n");
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "framememory.h"
+#include "pipeoutput.h"
+#include "renditions.h"
+#include "syntheticsource.h"
+#include "threadpolicy.h"
+
+struct Options
+{
+    const char* replayPath = NULL; // Replay a recorded capture instead of opening the device
+    bool measureLatency = false;   // Report capture-to-photon latency on exit
+    double latencyBudget = 0.0;    // Fail if p99 end-to-end latency exceeds this many ms
+    bool headless = false;         // Replay without a window, audio or output files
+    int livePort = 0;              // Serve a live MPEG-TS stream on this localhost port
+    const char* liveUdp = NULL;    // Send the live MPEG-TS stream over UDP to this host:port
+    bool shareFrames = false;      // Publish raw frames to shared memory for other processes
+    int burstFrames = 60;          // Number of frames saved by a burst capture
+    bool useSynthetic = false;     // Capture from a synthetic scene instead of the device
+    synthetic_scene syntheticScene = SceneStaticMenu;
+    int truncatePercent = 0;       // Percentage of replayed or synthetic frames to cut short
+    int frameMemoryFlags = 0;      // FRAME_MEMORY_* flags for the frame pool and capture ring
+    const char* rawPath = NULL;    // Record undecoded frames here instead of encoding video live
+    bool compressRaw = false;      // LZ compress the raw recording
+    const char* transcodeInput = NULL;  // Encode this raw recording and exit
+    const char* transcodeOutput = NULL;
+    const char* transcodePreset = "medium";
+    bool adaptiveQuality = false;  // Adapt encoder settings to what the machine can keep up with
+    int cpuLoadThreads = 0;        // Spin this many threads to simulate a busy machine
+    bool recordAtStart = false;    // Start recording right away instead of waiting for the hotkey
+    const char* splitPath = NULL;  // Encode each screen as its own track in this file
+    const char* benchmarkPath = NULL; // Run the pipeline benchmark and write JSON results here
+    int benchmarkFrames = 600;     // Frames per benchmark stage
+    ThreadPolicy threadPolicies[NUM_THREAD_ROLES]; // Priority and affinity of each kind of thread
+    const char* processPriority = NULL;            // Priority class of the whole process
+    const char* analysisPath = NULL; // Write a lag and duplicate frame timeline here as CSV
+    int metricsPort = 0;           // Serve metrics and take control commands on this localhost port
+    int controlPort = 0;           // Send controlCommand to the instance on this port and exit
+    const char* controlCommand = NULL;
+    const char* pipeTarget = NULL; // Stream raw frames to stdout (-), a named pipe, fd:<n> or a file
+    pipe_format pipeFormat = PipeY4M;
+    RenditionSettings renditions[MAX_RENDITIONS]; // Extra encodes sharing one conversion of each frame
+    int renditionCount = 0;
+};
+
+bool parseOptions(int argc, char* argv[], Options* options);
+void printUsage();
@@ -0,0 +1,13 @@
+#pragma once
+extern "C" {
+    #include <libavcodec/avcodec.h>
+}
+
+// Receives encoded packets as they come out of an encoder. Called on the
+// encoder's thread, so implementations must not block.
+class PacketSink
+{
+public:
+    virtual ~PacketSink() {}
+    virtual void writePacket(const AVCodecContext* context, AVPacket* packet) = 0;
+};
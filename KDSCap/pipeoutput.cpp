@@ -0,0 +1,246 @@
+#include <SDL.h>
+#include <io.h>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "pipeoutput.h"
+#include "screenmodes.h"
+
+static const char* formatNames[NUM_PIPE_FORMATS] = {"rgb565", "yuv420p", "y4m"};
+
+#define PIPE_RGB_FRAME_BYTES (DS_WIDTH * DS_HEIGHT * 2 * sizeof(uint16_t))
+#define PIPE_YUV_FRAME_BYTES (DS_WIDTH * DS_HEIGHT * 2 * 3 / 2)
+
+// Opens target for writing: "-" for stdout, \\.\pipe\<name> to create a named
+// pipe and wait for a reader, fd:<n> for an inherited C runtime descriptor,
+// or anything else as a file.
+PipeOutput::PipeOutput(const char* target, pipe_format format) :
+    output(INVALID_HANDLE_VALUE),
+    namedPipe(false),
+    connected(false),
+    format(format),
+    convertMemory(NULL),
+    convertBuffer(NULL),
+    sinkThread(NULL),
+    writeStarted(0),
+    broken(false),
+    finishing(false),
+    framesWritten(0),
+    framesDiscarded(0),
+    bytesWritten(0),
+    maxWriteMs(0.0)
+{
+    HANDLE process = GetCurrentProcess();
+    if (strcmp(target, "-") == 0)
+    {
+        // Frames take over the real stdout; everything printed goes to stderr from here on
+        fflush(stdout);
+        DuplicateHandle(process, GetStdHandle(STD_OUTPUT_HANDLE), process, &output, 0, FALSE, DUPLICATE_SAME_ACCESS);
+        _dup2(_fileno(stderr), _fileno(stdout));
+        SetStdHandle(STD_OUTPUT_HANDLE, GetStdHandle(STD_ERROR_HANDLE));
+    }
+    else if (strncmp(target, "\\\\.\\pipe\\", 9) == 0)
+    {
+        output = CreateNamedPipe(target, PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT, 1, PIPE_NAMED_BUFFER, 0, 0, NULL);
+        namedPipe = true;
+    }
+    else if (strncmp(target, "fd:", 3) == 0)
+    {
+        char* end;
+        long fd = strtol(target + 3, &end, 10);
+        if (end == target + 3 || *end != '\0' || fd < 0 || fd > INT_MAX)
+        {
+            printf("Not a descriptor number: %s\n", target + 3);
+            throw std::runtime_error("Could not open the frame stream");
+        }
+
+        HANDLE inherited = ( HANDLE) _get_osfhandle(( int) fd);
+        if (inherited != INVALID_HANDLE_VALUE)
+            DuplicateHandle(process, inherited, process, &output, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    }
+    else
+    {
+        output = CreateFile(target, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+
+    if (output == INVALID_HANDLE_VALUE || output == NULL)
+    {
+        printf("Could not open %s for the frame stream: %lu\n", target, GetLastError());
+        throw std::runtime_error("Could not open the frame stream");
+    }
+
+    if (format != PipeRGB565)
+    {
+        convertMemory = new FrameSlab(FrameSlab::align(PIPE_Y4M_HEADER_ROOM + PIPE_YUV_FRAME_BYTES));
+        convertBuffer = convertMemory->data();
+    }
+
+    printf("Streaming %s frames to %s%s\n", formatNames[format], target, namedPipe ? " once a reader connects" : "");
+    if (format != PipeY4M)
+    {
+        printf("Read with: ffmpeg -f rawvideo -pixel_format %s -video_size %dx%d -framerate %g -i <stream>\n",
+               format == PipeRGB565 ? "rgb565le" : "yuv420p", DS_WIDTH, DS_HEIGHT * 2, DS_FRAME_RATE);
+    }
+}
+
+PipeOutput::~PipeOutput()
+{
+    if (namedPipe && connected)
+    {
+        FlushFileBuffers(output);
+        DisconnectNamedPipe(output);
+    }
+    CloseHandle(output);
+    if (sinkThread)
+    {
+        CloseHandle(sinkThread);
+    }
+    delete convertMemory;
+}
+
+bool PipeOutput::parseFormat(const char* name, pipe_format* format)
+{
+    for (int i = 0; i < NUM_PIPE_FORMATS; ++i)
+    {
+        if (strcmp(name, formatNames[i]) == 0)
+        {
+            *format = ( pipe_format) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PipeOutput::consumeFrame(const FrameRef& frame)
+{
+    if (!sinkThread)
+    {
+        DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &sinkThread, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    }
+
+    // Set before checking finishing, so finish() either sees this write or it never starts
+    uint64_t start = SDL_GetPerformanceCounter();
+    writeStarted = start;
+    if (finishing || broken)
+    {
+        writeStarted = 0;
+        ++framesDiscarded;
+        return;
+    }
+
+    if (!connected)
+    {
+        // Frames queued meanwhile are dropped by the frame bus
+        if (namedPipe && !ConnectNamedPipe(output, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+            broken = true;
+        }
+        connected = true;
+        if (!broken)
+        {
+            writeHeader();
+        }
+    }
+
+    const void* data = frame->pixels;
+    DWORD bytes = PIPE_RGB_FRAME_BYTES;
+    if (!broken && format != PipeRGB565)
+    {
+        uint8_t* yuv = convertBuffer + PIPE_Y4M_HEADER_ROOM;
+        if (SDL_ConvertPixels(DS_WIDTH, DS_HEIGHT * 2, SDL_PIXELFORMAT_RGB565, frame->pixels, DS_WIDTH * sizeof(uint16_t),
+                              SDL_PIXELFORMAT_IYUV, yuv, DS_WIDTH) < 0)
+        {
+            writeStarted = 0;
+            ++framesDiscarded;
+            return;
+        }
+
+        // The FRAME header goes right in front, so the whole frame is one write
+        data = yuv;
+        bytes = PIPE_YUV_FRAME_BYTES;
+        if (format == PipeY4M)
+        {
+            static const char frameHeader[] = "FRAME\n";
+            data = yuv - (sizeof(frameHeader) - 1);
+            memcpy(( void*) data, frameHeader, sizeof(frameHeader) - 1);
+            bytes += sizeof(frameHeader) - 1;
+        }
+    }
+
+    if (broken || !writeAll(data, bytes))
+    {
+        if (!finishing)
+            printf("Frame stream reader went away after %llu frames\n", ( unsigned long long) framesWritten);
+        broken = true;
+        writeStarted = 0;
+        ++framesDiscarded;
+        return;
+    }
+    writeStarted = 0;
+
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    if (ms > maxWriteMs)
+        maxWriteMs = ms;
+    ++framesWritten;
+    bytesWritten += bytes;
+}
+
+// Call before stopping the frame bus. A write still blocked on the reader
+// after PIPE_STALL_TIMEOUT_MS is cancelled, so the sink thread can exit.
+void PipeOutput::finish()
+{
+    finishing = true;
+    uint64_t timeout = SDL_GetPerformanceFrequency() * PIPE_STALL_TIMEOUT_MS / 1000;
+    while (true)
+    {
+        uint64_t started = writeStarted;
+        if (started == 0)
+            return;
+
+        if (SDL_GetPerformanceCounter() - started > timeout)
+        {
+            broken = true;
+            CancelSynchronousIo(sinkThread);
+        }
+        SDL_Delay(10);
+    }
+}
+
+void PipeOutput::report()
+{
+    printf("Frame stream: %llu frames written (%.1f MB), %llu discarded as the reader went away or conversion failed, slowest write %.1f ms\n",
+           ( unsigned long long) framesWritten, bytesWritten / (1024.0 * 1024.0),
+           ( unsigned long long) framesDiscarded, maxWriteMs);
+}
+
+bool PipeOutput::writeAll(const void* data, DWORD bytes)
+{
+    const uint8_t* p = ( const uint8_t*) data;
+    while (bytes > 0)
+    {
+        DWORD written = 0;
+        if (broken || !WriteFile(output, p, bytes, &written, NULL))
+            return false;
+        p += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+void PipeOutput::writeHeader()
+{
+    if (format != PipeY4M)
+        return;
+
+    // Planar 4:2:0, as SDL's IYUV conversion produces
+    char header[128];
+    int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:10000 Ip A1:1 C420jpeg\n",
+                          DS_WIDTH, DS_HEIGHT * 2, ( int) (DS_FRAME_RATE * 10000 + 0.5));
+    if (!writeAll(header, length))
+    {
+        broken = true;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <Windows.h>
+#include <atomic>
+#include "framebus.h"
+#include "framememory.h"
+
+#define PIPE_STALL_TIMEOUT_MS 1000      // A write blocked this long at exit is given up on
+#define PIPE_NAMED_BUFFER (1024 * 1024) // Kernel buffer of a pipe we create, a few frames deep
+#define PIPE_Y4M_HEADER_ROOM 64         // Bytes kept in front of a converted frame for its FRAME header
+
+typedef enum
+{
+    PipeRGB565 = 0, // rawvideo, rgb565le, exactly as captured
+    PipeYUV420,     // rawvideo, yuv420p
+    PipeY4M         // YUV4MPEG2 with 4:2:0 frames
+} pipe_format;
+#define NUM_PIPE_FORMATS 3
+
+// Streams every frame to stdout, a named pipe, an inherited handle or a
+// file, for piping into ffmpeg or an analysis tool. RGB565 frames are
+// written straight from the frame pool's memory with no copy in between;
+// YUV frames are converted into one reused page-aligned buffer.
+// Runs on its own frame bus sink, so a reader that falls behind only makes
+// the bus drop frames for this sink, and capture never waits for it.
+class PipeOutput : public FrameSink
+{
+public:
+    PipeOutput(const char* target, pipe_format format);
+    ~PipeOutput();
+
+    void consumeFrame(const FrameRef& frame) override;
+    void finish();
+    void report();
+
+    static bool parseFormat(const char* name, pipe_format* format);
+
+private:
+    HANDLE output;
+    bool namedPipe;
+    bool connected;
+    pipe_format format;
+
+    FrameSlab* convertMemory;
+    uint8_t* convertBuffer;
+
+    HANDLE sinkThread;
+    std::atomic<uint64_t> writeStarted; // SDL performance counter, or 0 when no write is blocked
+    std::atomic<bool> broken;
+    std::atomic<bool> finishing;
+
+    uint64_t framesWritten;
+    uint64_t framesDiscarded; // Reached the sink after the reader had gone, or couldn't be converted
+    uint64_t bytesWritten;
+    double maxWriteMs;
+
+    bool writeAll(const void* data, DWORD bytes);
+    void writeHeader();
+};
@@ -0,0 +1,317 @@
+#include <future>
+#include "presenter.h"
+#include "threadpolicy.h"
+
+const int SCREEN_WIDTH = DS_WIDTH;
+const int SCREEN_HEIGHT = DS_HEIGHT * 2;
+
+// Code of the event posted to the window's thread
+#define WINDOW_EVENT_TITLE 1
+
+Presenter::Presenter(SDL_Window* window, LatencyStats* latencyStats) :
+    window(window),
+    surface(NULL),
+    renderer(NULL),
+    texture(NULL),
+    latencyStats(latencyStats),
+    windowEventType(SDL_RegisterEvents(1)),
+    running(false),
+    finished(true),
+    presentCount(0),
+    scale(1),
+    screenMode(Vertical)
+{
+    title[0] = '\0';
+}
+
+Presenter::~Presenter()
+{
+    stop();
+}
+
+// Starts the presentation thread and waits for it to create the renderer.
+// Call on the thread that made the window.
+// Returns false if the renderer could not be created.
+bool Presenter::start()
+{
+    std::promise<bool> created;
+    std::future<bool> createdResult = created.get_future();
+    running = true;
+    finished = false;
+    presentThread = std::thread([this, &created]() {
+        configureThread(ThreadRender, "presenter");
+        bool ok = init();
+        created.set_value(ok);
+        if (ok)
+            run();
+        destroy();
+        finished = true;
+    });
+
+    if (!createdResult.get())
+    {
+        running = false;
+        presentThread.join();
+        return false;
+    }
+    return true;
+}
+
+// Stops the presentation thread, which destroys the renderer. Called on the
+// thread that started it, which keeps handling window messages meanwhile so
+// a resize the presentation thread is waiting on can finish.
+void Presenter::stop()
+{
+    running = false;
+    if (!presentThread.joinable())
+        return;
+
+    while (!finished)
+    {
+        if (window)
+            SDL_PumpEvents();
+        SDL_Delay(1);
+    }
+    presentThread.join();
+}
+
+// Queues a mode or scale change for the presentation thread. Never blocks on rendering.
+void Presenter::sendCommand(present_command_type type, int value)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.push_back({type, value});
+}
+
+void Presenter::consumeFrame(const FrameRef& frame)
+{
+    tripleBuffer.publish(frame);
+}
+
+unsigned int Presenter::framesPresented()
+{
+    return presentCount;
+}
+
+// Applies a title change the presentation thread posted. Call from the event
+// loop on the thread that made the window.
+// Returns false if the event wasn't one of this presenter's.
+bool Presenter::handleWindowEvent(const SDL_Event& event)
+{
+    if (event.type != windowEventType)
+        return false;
+
+    std::lock_guard<std::mutex> lock(titleMutex);
+    SDL_SetWindowTitle(window, title);
+    return true;
+}
+
+bool Presenter::init()
+{
+    if (window)
+    {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    }
+    else
+    {
+        surface = SDL_CreateRGBSurfaceWithFormat(0, DS_WIDTH, DS_HEIGHT * 2, 16, SDL_PIXELFORMAT_RGB565);
+        if (surface)
+            renderer = SDL_CreateSoftwareRenderer(surface);
+    }
+    if (renderer == NULL)
+    {
+        printf("Could not create renderer: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING, DS_WIDTH, DS_HEIGHT * 2);
+    if (texture == NULL)
+    {
+        printf("Could not create texture: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+// Destroys SDL objects, on the presentation thread
+void Presenter::destroy()
+{
+    if (texture)
+    {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    if (renderer)
+    {
+        SDL_DestroyRenderer(renderer);
+        renderer = NULL;
+    }
+    if (surface)
+    {
+        SDL_FreeSurface(surface);
+        surface = NULL;
+    }
+}
+
+void Presenter::run()
+{
+    unsigned int lastTime = SDL_GetTicks();
+    unsigned int lastPresented = 0;
+    uint64_t lastCaptured = 0;
+
+    while (running)
+    {
+        bool changed = runCommands();
+
+        bool newFrame = tripleBuffer.acquire();
+        if (newFrame)
+        {
+            void* pixels;
+            int pitch;
+
+            SDL_LockTexture(texture, NULL, &pixels, &pitch);
+            memcpy(pixels, tripleBuffer.readFrame()->pixels, DS_WIDTH * DS_HEIGHT * 2 * 2);
+            SDL_UnlockTexture(texture);
+        }
+        uint64_t uploadTime = SDL_GetPerformanceCounter();
+
+        if (newFrame || changed)
+        {
+            render();
+            if (newFrame)
+                ++presentCount;
+
+            if (newFrame && latencyStats)
+            {
+                const DSFrameInfo& info = tripleBuffer.readFrame()->info;
+                latencyStats->record(info.captureTime, info.grabTime, uploadTime, SDL_GetPerformanceCounter());
+            }
+        }
+        else
+        {
+            SDL_Delay(1);
+        }
+
+        unsigned int currentTime = SDL_GetTicks();
+        if (window && currentTime - lastTime >= 1000)
+        {
+            // Frame numbers count every captured frame, including ones this
+            // presenter never received
+            const FrameRef& frame = tripleBuffer.readFrame();
+            unsigned int presented = presentCount;
+            uint64_t captured = frame ? frame->number + 1 : 0;
+            setWindowTitle(presented - lastPresented, ( unsigned int) (captured - lastCaptured));
+            lastPresented = presented;
+            lastCaptured = captured;
+            lastTime = currentTime;
+        }
+    }
+}
+
+// Applies queued window changes.
+// Returns true if the window needs to be redrawn.
+bool Presenter::runCommands()
+{
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        if (commands.empty())
+            return false;
+        pendingCommands.swap(commands);
+    }
+
+    for (const PresentCommand& command : pendingCommands)
+    {
+        switch (command.type)
+        {
+            case PresentSetScale:
+                scale = command.value;
+                break;
+            case PresentNextMode:
+                screenMode = static_cast<screen_mode>((screenMode + 1) % NUM_SCREEN_MODES);
+                break;
+        }
+    }
+    pendingCommands.clear();
+
+    resizeWindow();
+    return true;
+}
+
+void Presenter::render()
+{
+    SDL_Rect src = getSrcRectForMode(screenMode);
+    if (screenMode == Horizontal)
+    {
+        SDL_Rect dest;
+        dest.x = dest.y = 0;
+        dest.w = DS_WIDTH * scale;
+        dest.h = DS_HEIGHT * scale;
+        SDL_RenderCopy(renderer, texture, &src, &dest);
+        src.y += DS_HEIGHT;
+        dest.x += DS_WIDTH * scale;
+        SDL_RenderCopy(renderer, texture, &src, &dest);
+    }
+    else
+    {
+        SDL_RenderCopy(renderer, texture, &src, NULL);
+    }
+    SDL_RenderPresent(renderer);
+}
+
+// Fits the window to the current mode and scale. Returns once the window's
+// thread has handled the change, so SDL updates the renderer for the new size
+// while nothing is being drawn with it.
+void Presenter::resizeWindow()
+{
+    if (!window)
+        return;
+
+    int width = SCREEN_WIDTH, height = SCREEN_HEIGHT;
+    switch (screenMode)
+    {
+        case Vertical:
+            break;
+        case Horizontal:
+            width = DS_WIDTH * 2;
+            height = DS_HEIGHT;
+            break;
+        case GBABottom:
+        case GBATop:
+            width = GBA_WIDTH;
+            height = GBA_HEIGHT;
+            break;
+    }
+
+    SDL_SetWindowSize(window, width * scale, height * scale);
+}
+
+void Presenter::setWindowTitle(unsigned int presented, unsigned int captured)
+{
+    const char* modeName = "";
+    switch (screenMode)
+    {
+        case Vertical:
+            modeName = "Vertical DS";
+            break;
+        case Horizontal:
+            modeName = "Horizontal DS";
+            break;
+        case GBABottom:
+            modeName = "GBA Bottom";
+            break;
+        case GBATop:
+            modeName = "GBA Top";
+            break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(titleMutex);
+        snprintf(title, sizeof(title), "KDSCap - %s - %d fps (%d captured)", modeName, presented, captured);
+    }
+
+    SDL_Event event = {};
+    event.type = windowEventType;
+    event.user.code = WINDOW_EVENT_TITLE;
+    SDL_PushEvent(&event);
+}
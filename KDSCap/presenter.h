@@ -0,0 +1,80 @@
+#pragma once
+#include <SDL.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "framebus.h"
+#include "latencystats.h"
+#include "screenmodes.h"
+#include "triplebuffer.h"
+
+typedef enum
+{
+    PresentSetScale = 0,
+    PresentNextMode
+} present_command_type;
+
+struct PresentCommand
+{
+    present_command_type type;
+    int value;
+};
+
+// Presents frames on its own thread, so vsync never holds up capture or the
+// event loop. Frames arrive from the frame bus through a triple buffer and
+// window changes through a command queue. The presentation thread owns the
+// renderer: it is created, drawn with, resized and destroyed only there, so
+// nothing else touches it. The window can't be resized by hand, and the
+// presentation thread resizes it, blocked until the window's thread has
+// handled the change. Titles are posted back to the window's thread as SDL
+// events, for handleWindowEvent.
+// Made without a window, it renders into an offscreen surface with SDL's
+// software renderer instead, for measuring latency headless.
+class Presenter : public FrameSink
+{
+public:
+    Presenter(SDL_Window* window, LatencyStats* latencyStats);
+    ~Presenter();
+
+    bool start();
+    void stop();
+
+    void sendCommand(present_command_type type, int value = 0);
+    void consumeFrame(const FrameRef& frame) override;
+    unsigned int framesPresented();
+    bool handleWindowEvent(const SDL_Event& event);
+
+private:
+    SDL_Window* window;
+    SDL_Surface* surface; // Rendered into when there is no window
+    SDL_Renderer* renderer;
+    SDL_Texture* texture;
+    LatencyStats* latencyStats;
+    uint32_t windowEventType;
+
+    std::thread presentThread;
+    std::atomic_bool running;
+    std::atomic_bool finished; // The presentation thread has destroyed the renderer
+    std::atomic_uint presentCount; // New frames presented, not redraws
+
+    std::mutex commandMutex;
+    std::vector<PresentCommand> commands;
+    std::vector<PresentCommand> pendingCommands;
+
+    std::mutex titleMutex;
+    char title[80];
+
+    FrameTripleBuffer tripleBuffer;
+
+    int scale;
+    screen_mode screenMode;
+
+    bool init();
+    void destroy();
+    void run();
+    bool runCommands();
+    void render();
+    void resizeWindow();
+    void setWindowTitle(unsigned int presented, unsigned int captured);
+};
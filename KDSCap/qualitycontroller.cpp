@@ -0,0 +1,126 @@
+#include <SDL_timer.h>
+#include <algorithm>
+#include <cstdio>
+#include "dsframe.h"
+#include "qualitycontroller.h"
+
+// Cheapest first. Steps change one or two of CRF, preset and lookahead at a time.
+static const QualityLevel qualityLadder[] = {
+    {"ultrafast", 28, 0},
+    {"ultrafast", 23, 0}, // The settings of a fixed encoder
+    {"superfast", 23, 0},
+    {"veryfast", 23, 0},
+    {"veryfast", 22, 10},
+    {"faster", 22, 10},
+    {"faster", 21, 20},
+    {"fast", 20, 20},
+    {"fast", 20, 30},
+    {"medium", 19, 40},
+};
+#define NUM_QUALITY_LEVELS 10
+
+QualityController::QualityController(const char* name) :
+    name(name),
+    current(QUALITY_START_LEVEL),
+    startTime(SDL_GetPerformanceCounter()),
+    windowFrames(0),
+    windowMs(0.0),
+    windowBacklog(0),
+    settling(false),
+    calmWindows(0),
+    calmWindowsNeeded(QUALITY_CALM_WINDOWS),
+    upgradeAge(-1),
+    stepsUp(0),
+    stepsDown(0),
+    lowestLevel(QUALITY_START_LEVEL)
+{
+}
+
+const QualityLevel& QualityController::level()
+{
+    return qualityLadder[current];
+}
+
+// Called after every encoded frame with how long the encoder took and how many
+// frames were still queued for it. Returns true if level() has changed.
+bool QualityController::update(uint64_t frameNumber, double encodeMs, int backlog)
+{
+    windowMs += encodeMs;
+    windowBacklog = std::max(windowBacklog, backlog);
+    if (++windowFrames < QUALITY_WINDOW_FRAMES)
+        return false;
+
+    double meanMs = windowMs / windowFrames;
+    int maxBacklog = windowBacklog;
+    windowFrames = 0;
+    windowMs = 0.0;
+    windowBacklog = 0;
+
+    if (settling)
+    {
+        settling = false;
+        return false;
+    }
+
+    if (upgradeAge >= 0 && ++upgradeAge > QUALITY_CALM_WINDOWS)
+    {
+        // The last step up held, so the next one needn't wait any longer than usual
+        upgradeAge = -1;
+        calmWindowsNeeded = QUALITY_CALM_WINDOWS;
+    }
+
+    double frameMs = 1000.0 / DS_FRAME_RATE;
+    if (meanMs > QUALITY_OVERLOADED * frameMs || maxBacklog >= QUALITY_MAX_BACKLOG)
+    {
+        calmWindows = 0;
+        if (current == 0)
+            return false;
+
+        if (upgradeAge >= 0)
+        {
+            calmWindowsNeeded = std::min(calmWindowsNeeded * 2, QUALITY_MAX_CALM_WINDOWS);
+            upgradeAge = -1;
+        }
+        change(current - 1, frameNumber, meanMs, maxBacklog, "overloaded");
+        return true;
+    }
+
+    if (meanMs < QUALITY_HEADROOM * frameMs && maxBacklog <= 1)
+    {
+        if (++calmWindows < calmWindowsNeeded || current == NUM_QUALITY_LEVELS - 1)
+            return false;
+
+        calmWindows = 0;
+        upgradeAge = 0;
+        change(current + 1, frameNumber, meanMs, maxBacklog, "headroom");
+        return true;
+    }
+
+    // Between the two thresholds nothing changes, so the level doesn't flap
+    calmWindows = 0;
+    return false;
+}
+
+void QualityController::change(int level, uint64_t frameNumber, double meanMs, int backlog, const char* reason)
+{
+    double seconds = ( double) (SDL_GetPerformanceCounter() - startTime) / SDL_GetPerformanceFrequency();
+    const QualityLevel& to = qualityLadder[level];
+    printf("[%9.3f s] %s quality %d -> %d: %s crf %d lookahead %d (%s, %.2f ms/frame, backlog %d, frame %llu)\n",
+           seconds, name.c_str(), current, level, to.preset, to.crf, to.lookahead, reason, meanMs, backlog,
+           ( unsigned long long) frameNumber);
+
+    if (level > current)
+        ++stepsUp;
+    else
+        ++stepsDown;
+    current = level;
+    lowestLevel = std::min(lowestLevel, level);
+    settling = true;
+}
+
+void QualityController::report()
+{
+    const QualityLevel& last = qualityLadder[current];
+    printf("%s quality: ended at %d (%s crf %d lookahead %d), lowest %d, %d steps up, %d down\n", name.c_str(),
+           current, last.preset, last.crf, last.lookahead, lowestLevel, stepsUp, stepsDown);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+#define QUALITY_WINDOW_FRAMES 60  // Frames measured before each decision
+#define QUALITY_OVERLOADED 0.8    // Mean encode time, as a share of the frame time, that forces a step down
+#define QUALITY_HEADROOM 0.45     // Mean encode time that allows a step up once it has lasted
+#define QUALITY_MAX_BACKLOG 4     // Queued frames that force a step down
+#define QUALITY_CALM_WINDOWS 5    // Windows with headroom needed before stepping up
+#define QUALITY_MAX_CALM_WINDOWS 80
+#define QUALITY_START_LEVEL 1     // The settings of a fixed encoder
+
+// One step on the quality ladder. B-frames stay off at every step, so
+// timestamps keep increasing when the encoder is restarted for a new preset.
+struct QualityLevel
+{
+    const char* preset;
+    int crf;
+    int lookahead;
+};
+
+// Picks the best encoder settings that still keep up with capture in real
+// time. Steps down as soon as a window of frames took too long to encode or
+// frames queued up; steps up only after several windows with plenty of
+// headroom, and waits twice as long after each step up that didn't hold.
+class QualityController
+{
+public:
+    QualityController(const char* name);
+
+    const QualityLevel& level();
+    int levelIndex() { return current; }
+    int lowestLevelIndex() { return lowestLevel; }
+    bool update(uint64_t frameNumber, double encodeMs, int backlog);
+    void report();
+
+private:
+    std::string name;
+    int current;
+    uint64_t startTime;
+
+    int windowFrames;
+    double windowMs;
+    int windowBacklog;
+    bool settling;         // The first window after a change includes the switch itself
+    int calmWindows;
+    int calmWindowsNeeded;
+    int upgradeAge;        // Windows since the last step up, or -1 once it has held
+
+    int stepsUp;
+    int stepsDown;
+    int lowestLevel;
+
+    void change(int level, uint64_t frameNumber, double meanMs, int backlog, const char* reason);
+};
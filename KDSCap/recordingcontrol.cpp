@@ -0,0 +1,212 @@
+#include <SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include "recordingcontrol.h"
+
+static VideoEncoder* openSpareEncoder(bool adaptiveQuality)
+{
+    VideoEncoder* encoder = new VideoEncoder("ultrafast", NULL);
+    if (adaptiveQuality)
+    {
+        encoder->enableAdaptiveQuality("recording");
+    }
+    return encoder;
+}
+
+// With adaptiveQuality, every recording's encoder adapts its settings to keep up
+RecordingControl::RecordingControl(AudioRecorder* audioRecorder, bool adaptiveQuality) :
+    audioRecorder(audioRecorder),
+    adaptiveQuality(adaptiveQuality),
+    encoder(NULL),
+    firstFrame(0),
+    recordingCount(0),
+    recordingsStarted(0),
+    recordingWanted(false),
+    segmentWanted(false),
+    requestTime(0),
+    totalStartMs(0.0),
+    maxStartMs(0.0)
+{
+    spareEncoder = std::async(std::launch::async, openSpareEncoder, adaptiveQuality);
+}
+
+// The frame bus has to be stopped first
+RecordingControl::~RecordingControl()
+{
+    if (encoder)
+    {
+        stop();
+    }
+    for (std::future<void>& closing : closingEncoders)
+    {
+        closing.wait();
+    }
+    if (spareEncoder.valid())
+    {
+        try
+        {
+            delete spareEncoder.get();
+        }
+        catch (const std::exception&)
+        {
+            // It never opened, so there is nothing to close
+        }
+    }
+}
+
+// Starts recording from the next captured frame, or stops after the last one.
+// Never blocks the caller.
+void RecordingControl::toggle()
+{
+    requestTime = SDL_GetPerformanceCounter();
+    recordingWanted = !recordingWanted;
+}
+
+void RecordingControl::setRecording(bool record)
+{
+    if (recordingWanted != record)
+    {
+        toggle();
+    }
+}
+
+// Ends the recording after the current frame and carries on into new files
+// from the next one, so no frame is missed between the two.
+// Returns false if nothing is being recorded.
+bool RecordingControl::splitSegment()
+{
+    if (!recordingWanted)
+        return false;
+
+    requestTime = SDL_GetPerformanceCounter();
+    segmentWanted = true;
+    return true;
+}
+
+bool RecordingControl::isRecording()
+{
+    return recordingWanted;
+}
+
+EncoderMetrics* RecordingControl::metrics()
+{
+    return &recordingMetrics;
+}
+
+void RecordingControl::consumeFrame(const FrameRef& frame)
+{
+    bool wanted = recordingWanted;
+    if (segmentWanted.exchange(false) && wanted && encoder)
+    {
+        stop();
+    }
+
+    if (wanted && !encoder)
+    {
+        start(frame);
+    }
+    else if (!wanted && encoder)
+    {
+        stop();
+    }
+
+    if (encoder)
+    {
+        encoder->sendFrame(frame->pixels, frame->number - firstFrame);
+        encoder->adaptQuality(frame->number, queuedFrames);
+        if (frame->number == firstFrame)
+        {
+            double startMs = (SDL_GetPerformanceCounter() - requestTime) * 1000.0 / SDL_GetPerformanceFrequency();
+            ++recordingsStarted;
+            totalStartMs += startMs;
+            if (startMs > maxStartMs)
+                maxStartMs = startMs;
+            printf("Recording started %.1f ms after it was requested\n", startMs);
+        }
+    }
+}
+
+void RecordingControl::start(const FrameRef& frame)
+{
+    char timestamp[32];
+    time_t now = time(NULL);
+    tm local;
+    localtime_s(&local, &now);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", &local);
+
+    ++recordingCount;
+    char videoName[64], audioName[64];
+    snprintf(videoName, sizeof(videoName), "video-%s-%u.mp4", timestamp, recordingCount);
+    snprintf(audioName, sizeof(audioName), "audio-%s-%u.mp3", timestamp, recordingCount);
+
+    // Only waits if the last spare is still being opened, i.e. recording was
+    // restarted within moments of starting the one before. A spare that
+    // failed to open is replaced, so the next request tries again.
+    try
+    {
+        encoder = spareEncoder.get();
+    }
+    catch (const std::exception& e)
+    {
+        printf("Could not open an encoder, not recording: %s\n", e.what());
+        encoder = NULL;
+    }
+    spareEncoder = std::async(std::launch::async, openSpareEncoder, adaptiveQuality);
+    if (!encoder)
+    {
+        recordingWanted = false;
+        return;
+    }
+    encoder->setMetrics(&recordingMetrics);
+
+    if (!encoder->openOutput(videoName))
+    {
+        printf("Could not open %s, not recording\n", videoName);
+        closeEncoder(encoder);
+        encoder = NULL;
+        recordingWanted = false;
+        return;
+    }
+    if (!audioRecorder->openOutput(audioName))
+    {
+        printf("Could not open %s, recording video only\n", audioName);
+    }
+
+    firstFrame = frame->number;
+    printf("Recording to %s and %s\n", videoName, audioName);
+}
+
+void RecordingControl::stop()
+{
+    audioRecorder->closeOutput();
+    encoder->reportQuality();
+
+    // Flushing x264 takes a while; the next recording uses the spare meanwhile
+    closeEncoder(encoder);
+    encoder = NULL;
+    printf("Recording stopped\n");
+}
+
+// Deletes the encoder in the background, forgetting encoders already closed
+// so a long session of recordings doesn't keep one future for each
+void RecordingControl::closeEncoder(VideoEncoder* closing)
+{
+    closingEncoders.erase(std::remove_if(closingEncoders.begin(), closingEncoders.end(),
+                                         [](const std::future<void>& f) {
+                                             return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                         }),
+                          closingEncoders.end());
+    closingEncoders.push_back(std::async(std::launch::async, [](VideoEncoder* e) { delete e; }, closing));
+}
+
+void RecordingControl::report()
+{
+    if (recordingsStarted == 0)
+        return;
+
+    printf("Recordings: %u, time to start mean %.1f ms, max %.1f ms\n", recordingsStarted,
+           totalStartMs / recordingsStarted, maxStartMs);
+}
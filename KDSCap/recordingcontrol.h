@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <future>
+#include <vector>
+#include "audiorecorder.h"
+#include "framebus.h"
+#include "videoencoder.h"
+
+// Starts and stops recording video and audio while capture keeps running.
+// A spare encoder is always opened ahead of time, so a recording starts on
+// the first frame after the request without waiting for x264. A stopped
+// recording's encoder is flushed and closed in the background.
+// Each recording is written to video-<time>-<n>.mp4 and audio-<time>-<n>.mp3.
+// Besides the hotkey, recordings can be started, stopped and split into
+// segments through the metrics port (see metricsserver.h).
+class RecordingControl : public FrameSink
+{
+public:
+    RecordingControl(AudioRecorder* audioRecorder, bool adaptiveQuality);
+    ~RecordingControl();
+
+    void toggle();
+    void setRecording(bool record);
+    bool splitSegment();
+    bool isRecording();
+    EncoderMetrics* metrics();
+    void consumeFrame(const FrameRef& frame) override;
+    void report();
+
+private:
+    AudioRecorder* audioRecorder;
+    bool adaptiveQuality;
+    std::future<VideoEncoder*> spareEncoder;
+    std::vector<std::future<void>> closingEncoders;
+
+    // Only touched on the sink thread
+    VideoEncoder* encoder;
+    uint64_t firstFrame;
+    unsigned int recordingCount;
+    unsigned int recordingsStarted;
+
+    EncoderMetrics recordingMetrics; // Every recording's encoder counts into these
+
+    std::atomic<bool> recordingWanted;
+    std::atomic<bool> segmentWanted;
+    std::atomic<uint64_t> requestTime; // SDL performance counter when toggled
+    double totalStartMs;
+    double maxStartMs;
+
+    void start(const FrameRef& frame);
+    void stop();
+    void closeEncoder(VideoEncoder* closing);
+};
@@ -0,0 +1,206 @@
+#include <SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "muxer.h"
+#include "renditions.h"
+#include "screenmodes.h"
+
+// Converted frames are kept in a pooled frame's pixel memory
+static_assert(DS_WIDTH * DS_HEIGHT * 2 * 3 / 2 <= DS_WIDTH * DS_HEIGHT * 2 * sizeof(uint16_t), "I420 frame doesn't fit in a pooled frame");
+
+struct Rendition : public FrameSink
+{
+    std::string name;
+    Muxer* muxer = NULL;
+    VideoEncoder* encoder = NULL;
+
+    void consumeFrame(const FrameRef& frame) override
+    {
+        encoder->sendYuvFrame(frame);
+    }
+};
+
+RenditionSet::RenditionSet() :
+    yuvPool(RENDITION_POOL_FRAMES),
+    running(false),
+    framesConverted(0),
+    framesDropped(0),
+    encoderDropped(0),
+    totalConvertMs(0.0)
+{
+    ticksToMs = 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+RenditionSet::~RenditionSet()
+{
+    stop();
+    for (Rendition* rendition : renditions)
+    {
+        delete rendition;
+    }
+}
+
+// Opens the rendition's encoder and file. Must be called before start.
+void RenditionSet::addRendition(const RenditionSettings& settings)
+{
+    Rendition* rendition = new Rendition();
+    if (settings.filename)
+    {
+        rendition->name = settings.filename;
+        rendition->muxer = new Muxer(settings.filename);
+    }
+    else
+    {
+        rendition->name = "rendition " + std::to_string(renditions.size());
+    }
+
+    EncoderFormat format;
+    format.codec = settings.codec[0] ? settings.codec : NULL;
+    format.bitRate = settings.bitRate;
+    format.scale = settings.scale;
+    const char* preset = settings.preset[0] ? settings.preset : (format.codec ? NULL : "ultrafast");
+    rendition->encoder = new VideoEncoder(preset, NULL, EncodeBothScreens,
+                                          rendition->muxer && rendition->muxer->needsGlobalHeader(), format);
+    if (rendition->muxer)
+    {
+        rendition->muxer->addStream(rendition->encoder->codecContext());
+        rendition->encoder->setPacketSink(rendition->muxer);
+        rendition->muxer->start();
+    }
+
+    renditions.push_back(rendition);
+    renditionBus.addSink(rendition->name.c_str(), rendition, RENDITION_QUEUE_DEPTH, DropOldest, ThreadEncoder, StopDrain);
+}
+
+void RenditionSet::start()
+{
+    renditionBus.start();
+    running = true;
+}
+
+// Encodes the frames still queued, then stops the encoders, flushing each into its file.
+void RenditionSet::stop()
+{
+    if (!running)
+        return;
+
+    renditionBus.stop();
+    for (Rendition* rendition : renditions)
+    {
+        encoderDropped += rendition->encoder->metrics()->dropped;
+        delete rendition->encoder;
+        rendition->encoder = NULL;
+        if (rendition->muxer)
+        {
+            rendition->muxer->finish();
+            delete rendition->muxer;
+            rendition->muxer = NULL;
+        }
+    }
+    running = false;
+}
+
+// Converts the frame once and hands it to every rendition
+void RenditionSet::consumeFrame(const FrameRef& frame)
+{
+    Frame* yuv = yuvPool.acquire();
+    if (!yuv)
+    {
+        ++framesDropped;
+        return;
+    }
+
+    FrameRef ref(yuv);
+    uint64_t start = SDL_GetPerformanceCounter();
+    if (SDL_ConvertPixels(DS_WIDTH, DS_HEIGHT * 2, SDL_PIXELFORMAT_RGB565, frame->pixels, DS_WIDTH * sizeof(uint16_t),
+                          SDL_PIXELFORMAT_IYUV, yuv->pixels, DS_WIDTH) < 0)
+    {
+        ++framesDropped;
+        return;
+    }
+    totalConvertMs += (SDL_GetPerformanceCounter() - start) * ticksToMs;
+    ++framesConverted;
+
+    yuv->info = frame->info;
+    yuv->number = frame->number;
+    renditionBus.publish(ref);
+}
+
+int RenditionSet::renditionCount()
+{
+    return ( int) renditions.size();
+}
+
+const char* RenditionSet::renditionName(int index)
+{
+    return renditions[index]->name.c_str();
+}
+
+// Only valid until stop
+EncoderMetrics* RenditionSet::metrics(int index)
+{
+    return renditions[index]->encoder->metrics();
+}
+
+// Frames a rendition didn't encode, whether it fell behind, no converted frame
+// was free or its codec still held every buffer
+uint64_t RenditionSet::droppedFrames()
+{
+    uint64_t dropped = framesDropped * renditions.size() + encoderDropped;
+    for (Rendition* rendition : renditions)
+    {
+        if (rendition->encoder)
+            dropped += rendition->encoder->metrics()->dropped;
+    }
+    for (int i = 0; i < renditionBus.sinkCount(); ++i)
+    {
+        dropped += renditionBus.sinkStats(i).dropped;
+    }
+    return dropped;
+}
+
+void RenditionSet::report()
+{
+    printf("Renditions: %llu frames converted once for %d encoders, %.3f ms per frame, %llu dropped before conversion\n",
+           ( unsigned long long) framesConverted, renditionCount(),
+           framesConverted ? totalConvertMs / framesConverted : 0.0, ( unsigned long long) framesDropped);
+    renditionBus.report();
+}
+
+// Parses <codec>:<kbps>:<scale>[:<preset>], e.g. libx264:0:1:medium for an
+// archive at constant quality or libx264:1500:2 for a stream at 512x768.
+// A codec of "default" is the usual H.264 encoder.
+bool RenditionSet::parseSettings(const char* spec, RenditionSettings* settings)
+{
+    const char* kbps = strchr(spec, ':');
+    if (!kbps || kbps - spec >= ( int) sizeof(settings->codec))
+        return false;
+    if (kbps - spec != 7 || strncmp(spec, "default", 7) != 0)
+    {
+        memcpy(settings->codec, spec, kbps - spec);
+        settings->codec[kbps - spec] = '\0';
+    }
+
+    char* end;
+    settings->bitRate = strtol(kbps + 1, &end, 10) * 1000;
+    if (*end != ':' || settings->bitRate < 0)
+        return false;
+
+    settings->scale = strtol(end + 1, &end, 10);
+    if (settings->scale < 1 || settings->scale > MAX_RENDITION_SCALE)
+        return false;
+
+    if (*end == ':')
+    {
+        size_t length = strlen(end + 1);
+        if (length == 0 || length >= sizeof(settings->preset))
+            return false;
+        memcpy(settings->preset, end + 1, length + 1);
+    }
+    else if (*end != '\0')
+    {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "framebus.h"
+#include "framepool.h"
+#include "videoencoder.h"
+
+#define MAX_RENDITIONS 4
+#define MAX_RENDITION_SCALE 4
+#define RENDITION_QUEUE_DEPTH 8
+// Enough converted frames for a full queue plus everything the encoders hold,
+// so one slow rendition never starves the others of frames
+#define RENDITION_POOL_FRAMES (RENDITION_QUEUE_DEPTH + MAX_RENDITIONS * (ENCODER_YUV_BUFFERS + 1))
+
+// One output of a RenditionSet, from --rendition <codec>:<kbps>:<scale>[:<preset>] <file>
+struct RenditionSettings
+{
+    const char* filename = NULL; // Muxed by its extension, or NULL to only encode
+    char codec[32] = "";         // Empty for the default H.264 encoder
+    char preset[32] = "";        // Empty for ultrafast on the default encoder, or another codec's own default
+    int bitRate = 0;             // Bits per second, or 0 for constant quality
+    int scale = 1;
+};
+
+struct Rendition;
+
+// Encodes the same capture several ways at once, e.g. an archival file and a
+// low bitrate stream. Each frame is converted to I420 once, into a pooled
+// frame that every rendition's encoder reads in place, and each encoder runs
+// on its own thread behind its own queue on a frame bus of converted frames.
+// A rendition that can't keep up drops frames itself; the others carry on.
+class RenditionSet : public FrameSink
+{
+public:
+    RenditionSet();
+    ~RenditionSet();
+
+    void addRendition(const RenditionSettings& settings);
+    void start();
+    void stop();
+
+    void consumeFrame(const FrameRef& frame) override;
+
+    int renditionCount();
+    const char* renditionName(int index);
+    EncoderMetrics* metrics(int index);
+    uint64_t droppedFrames();
+    void report();
+
+    static bool parseSettings(const char* spec, RenditionSettings* settings);
+
+private:
+    FramePool yuvPool;
+    FrameBus renditionBus;
+    std::vector<Rendition*> renditions;
+    bool running;
+
+    uint64_t framesConverted;
+    uint64_t framesDropped; // Every converted frame was still held by a rendition, or conversion failed
+    uint64_t encoderDropped; // By the encoders already stopped
+    double totalConvertMs;
+    double ticksToMs;
+};
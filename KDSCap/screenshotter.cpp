@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include "pixelconvert.h"
+#include "screenmodes.h"
+#include "screenshotter.h"
+#include "threadpolicy.h"
+
+Screenshotter::Screenshotter(int historyFrames, const char* directory) :
+    historyFrames(historyFrames),
+    history(historyFrames),
+    historyPos(0),
+    historyCount(0),
+    directory(directory ? std::string(directory) + "\\" : ""),
+    running(true),
+    disabled(false),
+    activeJobs(0),
+    burstCount(0),
+    saved(0),
+    failed(0)
+{
+    int workerCount = std::max(2u, std::thread::hardware_concurrency() / 2);
+    for (int i = 0; i < workerCount; ++i)
+    {
+        workers.push_back(std::thread(&Screenshotter::work, this));
+    }
+}
+
+Screenshotter::~Screenshotter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false; // Workers finish the queued jobs first
+    }
+    jobCondition.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Keeps a reference to the frame in the history ring
+void Screenshotter::consumeFrame(const FrameRef& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    history[historyPos] = frame;
+    historyPos = (historyPos + 1) % historyFrames;
+    historyCount = std::min(historyCount + 1, historyFrames);
+}
+
+// Saves the most recent frame
+void Screenshotter::snapshot()
+{
+    queueFrames(1, "screenshot");
+}
+
+// Saves the last historyFrames frames
+void Screenshotter::burst()
+{
+    queueFrames(historyFrames, "burst");
+}
+
+// Hands the newest frames in the history over to the workers
+void Screenshotter::queueFrames(int frames, const char* prefix)
+{
+    char timestamp[32];
+    time_t now = time(NULL);
+    tm local;
+    localtime_s(&local, &now);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", &local);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (disabled)
+        {
+            printf("Screenshots are disabled, %s skipped\n", prefix);
+            return;
+        }
+
+        frames = std::min(frames, historyCount);
+        if (frames == 0)
+        {
+            printf("No frames captured yet, %s skipped\n", prefix);
+            return;
+        }
+
+        ++burstCount;
+        for (int i = frames; i > 0; --i)
+        {
+            int slot = (historyPos - i + historyFrames) % historyFrames;
+            char filename[96];
+            if (frames == 1)
+                snprintf(filename, sizeof(filename), "%s-%s-%u.png", prefix, timestamp, burstCount);
+            else
+                snprintf(filename, sizeof(filename), "%s-%s-%u-%03d.png", prefix, timestamp, burstCount, frames - i);
+
+            jobs.push_back({history[slot], directory + filename});
+        }
+    }
+    jobCondition.notify_all();
+}
+
+// Blocks until every queued screenshot has been saved or has failed
+void Screenshotter::waitForJobs()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCondition.wait(lock, [this]() { return jobs.empty() && activeJobs == 0; });
+}
+
+void Screenshotter::work()
+{
+    configureThread(ThreadWorker, "screenshots");
+
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec)
+    {
+        printf("Could not find PNG encoder, screenshots are disabled\n");
+        disable();
+        return;
+    }
+
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    if (!context || !frame || !packet || !openEncoder(codec, context, frame))
+    {
+        printf("Could not set up the PNG encoder, screenshots are disabled\n");
+        disable();
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        avcodec_free_context(&context);
+        return;
+    }
+
+    while (true)
+    {
+        ScreenshotJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobCondition.wait(lock, [this]() { return !running || !jobs.empty(); });
+            if (jobs.empty())
+                break;
+            job = jobs.front();
+            jobs.pop_front();
+            ++activeJobs;
+        }
+
+        if (savePNG(context, frame, packet, job))
+        {
+            ++saved;
+        }
+        else
+        {
+            printf("Could not save %s\n", job.filename.c_str());
+            ++failed;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --activeJobs;
+        }
+        idleCondition.notify_all();
+    }
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+}
+
+// Stops taking screenshots; whatever is still queued is counted as failed
+void Screenshotter::disable()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        disabled = true;
+        failed += ( unsigned int) jobs.size();
+        jobs.clear();
+    }
+    idleCondition.notify_all();
+}
+
+bool Screenshotter::openEncoder(const AVCodec* codec, AVCodecContext* context, AVFrame* frame)
+{
+    context->width = DS_WIDTH;
+    context->height = DS_HEIGHT * 2;
+    context->pix_fmt = AV_PIX_FMT_RGB24;
+    context->time_base = {1, 60};
+    if (avcodec_open2(context, codec, NULL) < 0)
+        return false;
+
+    frame->format = context->pix_fmt;
+    frame->width = context->width;
+    frame->height = context->height;
+    return av_frame_get_buffer(frame, 0) >= 0;
+}
+
+bool Screenshotter::savePNG(AVCodecContext* context, AVFrame* frame, AVPacket* packet, const ScreenshotJob& job)
+{
+    if (av_frame_make_writable(frame) < 0)
+        return false;
+
+    for (int y = 0; y < context->height; ++y)
+    {
+        convertRGB565ToRGB24(job.frame->pixels + y * DS_WIDTH, frame->data[0] + y * frame->linesize[0], DS_WIDTH);
+    }
+
+    // The PNG encoder turns every frame into a complete file in one packet
+    if (avcodec_send_frame(context, frame) < 0 || avcodec_receive_packet(context, packet) < 0)
+        return false;
+
+    FILE* output;
+    bool saved = false;
+    if (fopen_s(&output, job.filename.c_str(), "wb") == 0)
+    {
+        saved = fwrite(packet->data, 1, packet->size, output) == ( size_t) packet->size;
+        fclose(output);
+    }
+    av_packet_unref(packet);
+    return saved;
+}
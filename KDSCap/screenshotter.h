@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "framebus.h"
+
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+}
+
+struct ScreenshotJob
+{
+    FrameRef frame;
+    std::string filename;
+};
+
+// Saves PNGs of captured frames without slowing down capture or rendering.
+// The last few frames are kept as references into the frame pool; a
+// screenshot or burst just hands those references to the worker threads,
+// which do the colour conversion and PNG compression. If a worker can't set
+// up the PNG encoder, screenshots are disabled rather than taken down with it.
+class Screenshotter : public FrameSink
+{
+public:
+    Screenshotter(int historyFrames, const char* directory = NULL);
+    ~Screenshotter();
+
+    void consumeFrame(const FrameRef& frame) override;
+    void snapshot();
+    void burst();
+    void waitForJobs();
+
+    unsigned int savedCount() { return saved; }
+    unsigned int failedCount() { return failed; }
+
+private:
+    int historyFrames;
+    std::vector<FrameRef> history;
+    int historyPos;
+    int historyCount;
+    std::string directory;
+
+    std::vector<std::thread> workers;
+    std::deque<ScreenshotJob> jobs;
+    std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable idleCondition;
+    bool running;
+    bool disabled;
+    int activeJobs;
+    unsigned int burstCount;
+    std::atomic<unsigned int> saved;
+    std::atomic<unsigned int> failed;
+
+    void queueFrames(int frames, const char* prefix);
+    void work();
+    void disable();
+    bool openEncoder(const AVCodec* codec, AVCodecContext* context, AVFrame* frame);
+    bool savePNG(AVCodecContext* context, AVFrame* frame, AVPacket* packet, const ScreenshotJob& job);
+};
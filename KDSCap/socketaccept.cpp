@@ -0,0 +1,43 @@
+// winsock2.h has to come before anything that pulls in Windows.h
+#include <winsock2.h>
+#include <cstdio>
+#include "socketaccept.h"
+
+static bool isTransient(int error)
+{
+    switch (error)
+    {
+        case WSAEMFILE:      // Out of sockets until some are closed
+        case WSAENOBUFS:
+        case WSAECONNRESET:  // The client gave up before it was accepted
+        case WSAEINTR:
+        case WSAEINPROGRESS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uintptr_t acceptConnection(uintptr_t listenSocket, const std::atomic_bool& running)
+{
+    int backoffMs = 0;
+    while (running)
+    {
+        SOCKET s = accept(( SOCKET) listenSocket, NULL, NULL);
+        if (s != INVALID_SOCKET)
+            return s;
+
+        // Closing the listen socket to stop lands here too
+        int error = WSAGetLastError();
+        if (!running || !isTransient(error))
+            break;
+
+        if (backoffMs == 0)
+            printf("Could not accept a connection: %d, retrying\n", error);
+        backoffMs = backoffMs ? backoffMs * 2 : ACCEPT_BACKOFF_MIN_MS;
+        if (backoffMs > ACCEPT_BACKOFF_MAX_MS)
+            backoffMs = ACCEPT_BACKOFF_MAX_MS;
+        Sleep(backoffMs);
+    }
+    return INVALID_SOCKET;
+}
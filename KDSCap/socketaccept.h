@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+#define ACCEPT_BACKOFF_MIN_MS 10
+#define ACCEPT_BACKOFF_MAX_MS 500
+
+// Waits for the next connection on a listening socket. Transient failures,
+// e.g. running out of sockets, are retried after a growing delay rather than
+// straight away; closing the socket or clearing running ends the wait.
+// Returns the connected SOCKET, or INVALID_SOCKET once no more will come.
+uintptr_t acceptConnection(uintptr_t listenSocket, const std::atomic_bool& running);
@@ -0,0 +1,345 @@
+#include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "rawfile.h"
+#include "screenmodes.h"
+#include "threadpolicy.h"
+#include "transcoder.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+struct TranscodeChunk
+{
+    int firstFrame;
+    int frames;
+    std::vector<AVPacket*> packets;
+    bool done = false;
+    bool failed = false;
+};
+
+struct TranscodeJob
+{
+    const char* rawPath;
+    const char* preset;
+    bool globalHeader;
+    uint64_t firstCaptureTime;
+    uint64_t timestampFrequency; // 0 for recordings without timestamps
+    std::vector<int64_t> offsets;
+    std::vector<TranscodeChunk> chunks;
+    std::atomic_int nextChunk;
+    std::mutex mutex;
+    std::condition_variable chunkDone;
+};
+
+// Every chunk gets a fresh encoder, so it starts with a keyframe and depends
+// on no other chunk. Chunks are encoded in parallel, so each encoder is
+// single threaded, and B-frames are off so every chunk's timestamps follow on.
+static AVCodecContext* openChunkEncoder(const char* preset, bool globalHeader)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec)
+    {
+        throw std::runtime_error("Could not find video codec");
+    }
+
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    if (!context)
+    {
+        throw std::runtime_error("Could not allocate video codec context");
+    }
+
+    context->width = DS_WIDTH;
+    context->height = DS_HEIGHT * 2;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = {1, TRANSCODE_TIME_BASE};
+    context->framerate = {60, 1};
+    context->gop_size = TRANSCODE_CHUNK_FRAMES;
+    context->max_b_frames = 0;
+    context->thread_count = 1;
+    if (globalHeader)
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    av_opt_set(context->priv_data, "preset", preset, 0);
+
+    if (avcodec_open2(context, codec, NULL) < 0)
+    {
+        avcodec_free_context(&context);
+        throw std::runtime_error("Could not open context");
+    }
+    return context;
+}
+
+static void receivePackets(AVCodecContext* context, TranscodeChunk* chunk)
+{
+    AVPacket* packet = av_packet_alloc();
+    while (avcodec_receive_packet(context, packet) == 0)
+    {
+        chunk->packets.push_back(av_packet_clone(packet));
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+}
+
+// When the frame was captured, relative to the first frame, so gaps where the
+// device sent nothing stay gaps. Recordings without timestamps fall back to
+// the frame number at the DS frame rate.
+static int64_t framePts(const TranscodeJob* job, uint64_t captureTime, int index)
+{
+    if (job->timestampFrequency == 0)
+        return ( int64_t) (index * TRANSCODE_TIME_BASE / DS_FRAME_RATE + 0.5);
+    return ( int64_t) ((captureTime - job->firstCaptureTime) * TRANSCODE_TIME_BASE / ( double) job->timestampFrequency + 0.5);
+}
+
+static void encodeChunk(TranscodeJob* job, RawFileReader* reader, TranscodeChunk* chunk)
+{
+    std::vector<uint8_t> payload(DS_FRAME_SIZE);
+    uint8_t frameInfo[DS_INFO_SIZE];
+    std::vector<uint16_t> pixels[2];
+    pixels[0].resize(DS_WIDTH * DS_HEIGHT * 2);
+    pixels[1].resize(DS_WIDTH * DS_HEIGHT * 2);
+    const uint16_t* previous = NULL;
+    int current = 0;
+    uint64_t captureTime;
+    int64_t lastPts = -1;
+
+    // Incomplete frames are patched from the one before, so decoding starts a frame early
+    int first = chunk->firstFrame > 0 ? chunk->firstFrame - 1 : 0;
+    if (!reader->seek(job->offsets[first]))
+    {
+        chunk->failed = true;
+        return;
+    }
+
+    AVCodecContext* context = openChunkEncoder(job->preset, job->globalHeader);
+    AVFrame* frame = av_frame_alloc();
+    frame->format = context->pix_fmt;
+    frame->width = context->width;
+    frame->height = context->height;
+    int yuvSize = av_image_get_buffer_size(context->pix_fmt, context->width, context->height, 1);
+
+    for (int i = first; i < chunk->firstFrame + chunk->frames; ++i)
+    {
+        int payloadBytes = reader->readFrame(&payload[0], frameInfo, &captureTime);
+        if (payloadBytes < 0)
+        {
+            chunk->failed = true;
+            break;
+        }
+
+        if (decodeFrame(( const uint16_t*) &payload[0], payloadBytes, frameInfo, previous, &pixels[current][0]) < 0)
+            continue;
+        previous = &pixels[current][0];
+        current ^= 1;
+
+        if (i < chunk->firstFrame)
+            continue;
+
+        // The codec may still hold the last frame's buffer, so each frame gets its own
+        av_buffer_unref(&frame->buf[0]);
+        frame->buf[0] = av_buffer_alloc(yuvSize);
+        if (!frame->buf[0])
+        {
+            chunk->failed = true;
+            break;
+        }
+        av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, context->pix_fmt, context->width, context->height, 1);
+        SDL_ConvertPixels(context->width, context->height, SDL_PIXELFORMAT_RGB565, previous, DS_WIDTH * sizeof(uint16_t),
+                          SDL_PIXELFORMAT_IYUV, frame->data[0], frame->linesize[0]);
+
+        // Timestamps must always increase, even if the clock behind them didn't
+        frame->pts = std::max(framePts(job, captureTime, i), lastPts + 1);
+        lastPts = frame->pts;
+        if (avcodec_send_frame(context, frame) < 0)
+        {
+            chunk->failed = true;
+            break;
+        }
+        receivePackets(context, chunk);
+    }
+
+    avcodec_send_frame(context, NULL);
+    receivePackets(context, chunk);
+
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+}
+
+static void runWorker(TranscodeJob* job)
+{
+    configureThread(ThreadEncoder, "transcoder");
+    RawFileReader* reader = NULL;
+    try
+    {
+        reader = new RawFileReader(job->rawPath);
+    }
+    catch (const std::exception& e)
+    {
+        printf("Transcoder could not read %s: %s\n", job->rawPath, e.what());
+    }
+
+    // A chunk that can't be encoded is marked failed rather than left
+    // undone, so writing out the chunks never waits on it
+    while (true)
+    {
+        int index = job->nextChunk++;
+        if (index >= ( int) job->chunks.size())
+            break;
+
+        TranscodeChunk* chunk = &job->chunks[index];
+        try
+        {
+            if (!reader)
+                throw std::runtime_error("No reader");
+            encodeChunk(job, reader, chunk);
+        }
+        catch (const std::exception& e)
+        {
+            printf("Could not transcode frames %d to %d: %s\n", chunk->firstFrame, chunk->firstFrame + chunk->frames - 1, e.what());
+            chunk->failed = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            chunk->done = true;
+        }
+        job->chunkDone.notify_all();
+    }
+    delete reader;
+}
+
+int transcodeRaw(const char* rawPath, const char* outputPath, const char* preset)
+{
+    TranscodeJob job;
+    job.rawPath = rawPath;
+    job.preset = preset;
+    job.nextChunk = 0;
+
+    try
+    {
+        RawFileReader reader(rawPath);
+        if (!reader.indexFrames(&job.offsets) || job.offsets.empty())
+        {
+            printf("No frames in %s\n", rawPath);
+            return 1;
+        }
+
+        std::vector<uint8_t> payload(DS_FRAME_SIZE);
+        uint8_t frameInfo[DS_INFO_SIZE];
+        job.firstCaptureTime = 0;
+        job.timestampFrequency = reader.timestampFrequency();
+        if (!reader.seek(job.offsets[0]) || reader.readFrame(&payload[0], frameInfo, &job.firstCaptureTime) < 0)
+        {
+            printf("Could not read the first frame of %s\n", rawPath);
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        printf("Could not transcode %s: %s\n", rawPath, e.what());
+        return 1;
+    }
+
+    int frames = ( int) job.offsets.size();
+    for (int first = 0; first < frames; first += TRANSCODE_CHUNK_FRAMES)
+    {
+        TranscodeChunk chunk;
+        chunk.firstFrame = first;
+        chunk.frames = std::min(TRANSCODE_CHUNK_FRAMES, frames - first);
+        job.chunks.push_back(chunk);
+    }
+
+    AVFormatContext* format = NULL;
+    if (avformat_alloc_output_context2(&format, NULL, NULL, outputPath) < 0)
+    {
+        printf("Could not find an output format for %s\n", outputPath);
+        return 1;
+    }
+    job.globalHeader = (format->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+
+    // Every chunk encoder has the same settings, so one opened up front supplies the stream parameters
+    AVStream* stream = avformat_new_stream(format, NULL);
+    AVCodecContext* headerContext;
+    try
+    {
+        headerContext = openChunkEncoder(preset, job.globalHeader);
+    }
+    catch (const std::exception& e)
+    {
+        printf("Could not open the %s encoder: %s\n", preset, e.what());
+        avformat_free_context(format);
+        return 1;
+    }
+    avcodec_parameters_from_context(stream->codecpar, headerContext);
+    stream->time_base = headerContext->time_base;
+    AVRational codecTimeBase = headerContext->time_base;
+    avcodec_free_context(&headerContext);
+
+    if (avio_open(&format->pb, outputPath, AVIO_FLAG_WRITE) < 0 || avformat_write_header(format, NULL) < 0)
+    {
+        printf("Could not open %s\n", outputPath);
+        avformat_free_context(format);
+        return 1;
+    }
+
+    int workers = std::max(1, ( int) std::thread::hardware_concurrency());
+    printf("Transcoding %d frames in %d chunks on %d threads\n", frames, ( int) job.chunks.size(), workers);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; ++i)
+    {
+        threads.push_back(std::thread(runWorker, &job));
+    }
+
+    // Chunks are written as soon as every one before them is done
+    bool failed = false;
+    for (size_t i = 0; i < job.chunks.size(); ++i)
+    {
+        TranscodeChunk* chunk = &job.chunks[i];
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.chunkDone.wait(lock, [chunk]() { return chunk->done; });
+        }
+
+        failed |= chunk->failed;
+        for (AVPacket* packet : chunk->packets)
+        {
+            packet->stream_index = stream->index;
+            av_packet_rescale_ts(packet, codecTimeBase, stream->time_base);
+            av_interleaved_write_frame(format, packet);
+            av_packet_free(&packet);
+        }
+        chunk->packets.clear();
+        printf("\rTranscoded %d/%d frames", chunk->firstFrame + chunk->frames, frames);
+        fflush(stdout);
+    }
+    printf("\n");
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    av_write_trailer(format);
+    avio_closep(&format->pb);
+    avformat_free_context(format);
+
+    double seconds = ( double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    printf("Wrote %s in %.1f s (%.0f fps)\n", outputPath, seconds, frames / seconds);
+    if (failed)
+    {
+        printf("Some frames of %s could not be transcoded\n", rawPath);
+        return 1;
+    }
+    return 0;
+}
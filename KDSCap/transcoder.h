@@ -0,0 +1,10 @@
+#pragma once
+
+#define TRANSCODE_CHUNK_FRAMES 60 // Frames per independently encoded chunk, one GOP each
+#define TRANSCODE_TIME_BASE 1000  // Ticks per second of the encoded timestamps
+
+// Encodes a raw recording (see rawfile.h) to H.264 in outputPath, muxed in the
+// format its extension names. The recording is split into GOP-sized chunks
+// that are encoded on every core at once, then written out in order.
+// Returns the process exit code.
+int transcodeRaw(const char* rawPath, const char* outputPath, const char* preset);
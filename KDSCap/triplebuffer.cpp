@@ -0,0 +1,41 @@
+#include "triplebuffer.h"
+
+// Set on the middle index when it holds a frame the consumer hasn't seen
+#define FRESH_FRAME 4
+
+FrameTripleBuffer::FrameTripleBuffer()
+{
+    writeIndex = 0;
+    middle = 1;
+    readIndex = 2;
+    publishCount = 0;
+}
+
+// Hands the frame to the consumer, replacing any frame it hasn't picked up yet
+void FrameTripleBuffer::publish(const FrameRef& frame)
+{
+    frames[writeIndex] = frame;
+    writeIndex = middle.exchange(writeIndex | FRESH_FRAME) & ~FRESH_FRAME;
+    ++publishCount;
+}
+
+// Swaps in the newest published frame as the read frame.
+// Returns false if nothing was published since the last call.
+bool FrameTripleBuffer::acquire()
+{
+    if (!(middle.load() & FRESH_FRAME))
+        return false;
+
+    readIndex = middle.exchange(readIndex) & ~FRESH_FRAME;
+    return true;
+}
+
+const FrameRef& FrameTripleBuffer::readFrame()
+{
+    return frames[readIndex];
+}
+
+unsigned int FrameTripleBuffer::published()
+{
+    return publishCount;
+}
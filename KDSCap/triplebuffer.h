@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include "framepool.h"
+
+// Single producer, single consumer frame handoff. The producer never waits
+// and the consumer always gets the newest published frame; frames it never
+// picked up are simply released.
+class FrameTripleBuffer
+{
+public:
+    FrameTripleBuffer();
+
+    void publish(const FrameRef& frame);
+
+    bool acquire();
+    const FrameRef& readFrame();
+
+    unsigned int published();
+
+private:
+    FrameRef frames[3];
+    std::atomic_int middle;
+    std::atomic_uint publishCount;
+    int writeIndex;
+    int readIndex;
+};
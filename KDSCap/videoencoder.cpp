@@ -1,5 +1,9 @@
+#include <cstring>
 #include <stdexcept>
 #include <SDL_surface.h>
+#include <SDL_timer.h>
+#include "allocationcount.h"
+#include "pixelconvert.h"
 #include "screenmodes.h"
 #include "videoencoder.h"
 
@@ -9,37 +13,39 @@ extern "C"
 #include <libavutil/imgutils.h>
 }
 
-VideoEncoder::VideoEncoder()
+// filename may be NULL to only encode, e.g. when benchmarking or live streaming.
+// globalHeader is needed when the packets are muxed into e.g. MP4 or Matroska.
+VideoEncoder::VideoEncoder(const char* preset, const char* filename, encode_region region, bool globalHeader,
+                           const EncoderFormat& format) :
+    region(region),
+    globalHeader(globalHeader),
+    format(format)
 {
-    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    codec = format.codec ? avcodec_find_encoder_by_name(format.codec) : avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!codec)
     {
+        printf("Could not find the %s encoder\n", format.codec ? format.codec : "H.264");
         throw std::runtime_error("Could not find video codec");
     }
 
-    context = avcodec_alloc_context3(codec);
-    if (!context)
-    {
-        throw std::runtime_error("Could not allocate video codec context");
-    }
-
-    context->width = DS_WIDTH;
-    context->height = DS_HEIGHT;
-    context->pix_fmt = AV_PIX_FMT_YUV444P;
-    context->time_base = {1, 60};
-    context->framerate = {60, 1};
-    //context->bit_rate = 400000;
-    //context->gop_size = 10;
-    //context->max_b_frames = 1;
-    av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+    openContext(preset, NULL);
 
-    if (avcodec_open2(context, codec, NULL) < 0)
+    // What packets are tagged with and sinks set their streams up from. It stays
+    // the same when the encoder is restarted for a new quality level.
+    streamContext = avcodec_alloc_context3(NULL);
+    AVCodecParameters* parameters = avcodec_parameters_alloc();
+    if (!streamContext || !parameters ||
+        avcodec_parameters_from_context(parameters, context) < 0 ||
+        avcodec_parameters_to_context(streamContext, parameters) < 0)
     {
-        throw std::runtime_error("Could not open context");
+        throw std::runtime_error("Could not describe the video stream");
     }
+    avcodec_parameters_free(&parameters);
+    streamContext->time_base = context->time_base;
+    streamContext->framerate = context->framerate;
 
-    auto error = fopen_s(&output, "video.mp4", "wb");
-    if (error != 0)
+    output = NULL;
+    if (filename && !openOutput(filename))
     {
         throw std::runtime_error("Could not open file");
     }
@@ -59,9 +65,21 @@ VideoEncoder::VideoEncoder()
     frame->width = context->width;
     frame->height = context->height;
 
-    if (av_frame_get_buffer(frame, 0) < 0)
+    // SDL converts straight into pooled buffers that are lent to the frame and
+    // referenced by libav, so frames are never copied by avcodec_send_frame.
+    // The only allocation per frame is the AVBufferRef libav makes for its
+    // own reference, with av_malloc where it can't be counted.
+    int yuvSize = av_image_get_buffer_size(context->pix_fmt, context->width, context->height, 1);
+    size_t yuvStride = FrameSlab::align(yuvSize);
+    yuvMemory = new FrameSlab(yuvStride * ENCODER_YUV_BUFFERS);
+    for (int i = 0; i < ENCODER_YUV_BUFFERS; ++i)
     {
-        throw std::runtime_error("Could not allocate the video frame data");
+        // The slab owns the memory, so there is nothing to free when the last reference goes
+        yuvBuffers[i] = av_buffer_create(yuvMemory->data() + yuvStride * i, yuvSize, [](void*, uint8_t*) {}, NULL, 0);
+        if (!yuvBuffers[i])
+        {
+            throw std::runtime_error("Could not create video frame buffer");
+        }
     }
 }
 
@@ -73,28 +91,294 @@ VideoEncoder::~VideoEncoder()
     av_frame_free(&frame);
     av_packet_free(&packet);
     avcodec_free_context(&context);
-    fwrite(endcode, 1, sizeof(endcode), output); // Add sequence end code
-    fclose(output);
+    avcodec_free_context(&streamContext);
+    delete quality;
+    for (int i = 0; i < ENCODER_YUV_BUFFERS; ++i)
+    {
+        av_buffer_unref(&yuvBuffers[i]);
+    }
+    delete yuvMemory;
+    if (output)
+    {
+        fwrite(endcode, 1, sizeof(endcode), output); // Add sequence end code
+        fclose(output);
+    }
 }
 
-void VideoEncoder::sendFrame(uint16_t* buffer)
+// Encodes one RGB565 frame of both screens, or just the screen this encoder
+// was made for. pts is in frames, so gaps from dropped frames are kept.
+void VideoEncoder::sendFrame(const uint16_t* buffer, int64_t pts)
 {
-    uint16_t dstBuffer[DS_WIDTH + DS_HEIGHT * 2];
-    av_frame_make_writable(frame);
+    if (region == EncodeBottomScreen)
+        buffer += DS_WIDTH * DS_HEIGHT;
 
-    SDL_ConvertPixels(DS_WIDTH, DS_HEIGHT, SDL_PIXELFORMAT_RGB565, buffer, 0, SDL_PIXELFORMAT_IYUV, dstBuffer, 0);
+    AVBufferRef* yuvBuffer = freeYuvBuffer();
+    if (!yuvBuffer)
+    {
+        encoderMetrics->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    av_buffer_unref(&frame->buf[0]);
+    if (av_image_fill_arrays(frame->data, frame->linesize, yuvBuffer->data, context->pix_fmt, context->width, context->height, 1) < 0)
+    {
+        throw std::runtime_error("Could not fill image");
+    }
 
-    if (av_frame_make_writable(frame) < 0)
+    if (SDL_ConvertPixels(context->width, context->height, SDL_PIXELFORMAT_RGB565, buffer, DS_WIDTH * sizeof(uint16_t),
+                          SDL_PIXELFORMAT_IYUV, frame->data[0], frame->linesize[0]) < 0)
     {
-        throw std::runtime_error("Could not make frame writable");
+        throw std::runtime_error("Could not convert frame");
     }
 
-    if (av_image_fill_arrays(frame->data, frame->linesize, NULL, AV_PIX_FMT_YUV444P, DS_WIDTH, DS_HEIGHT * 2, DS_WIDTH) < 0)
+    submitPooled(yuvBuffer, pts);
+}
+
+// Encodes a frame of both screens that RenditionSet already converted to
+// I420, shared read-only with the other renditions. At scale 1 libav
+// references the planes where they are; otherwise they are upscaled into this
+// encoder's own buffers. A codec that holds on to more frames than there are
+// holders, e.g. a frame threaded one, gets a copy in its own buffer instead,
+// and the frame is dropped if even those are all held. The frame number is the pts.
+void VideoEncoder::sendYuvFrame(const FrameRef& yuv)
+{
+    const int width = DS_WIDTH, height = DS_HEIGHT * 2;
+    const uint8_t* planes = ( const uint8_t*) yuv->pixels;
+
+    av_buffer_unref(&frame->buf[0]);
+    AVBufferRef* shared = format.scale == 1 ? holdSharedFrame(yuv) : NULL;
+    if (shared)
     {
-        throw std::runtime_error("Could not fill image");
+        frame->buf[0] = shared;
+        if (av_image_fill_arrays(frame->data, frame->linesize, planes, context->pix_fmt, width, height, 1) < 0)
+        {
+            throw std::runtime_error("Could not fill image");
+        }
     }
+    else
+    {
+        AVBufferRef* yuvBuffer = freeYuvBuffer();
+        if (!yuvBuffer)
+        {
+            encoderMetrics->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (av_image_fill_arrays(frame->data, frame->linesize, yuvBuffer->data, context->pix_fmt, context->width, context->height, 1) < 0)
+        {
+            throw std::runtime_error("Could not fill image");
+        }
 
+        const uint8_t* u = planes + width * height;
+        const uint8_t* v = u + width * height / 4;
+        if (format.scale == 1)
+        {
+            const uint8_t* source[4] = {planes, u, v, NULL};
+            const int sourceLinesize[4] = {width, width / 2, width / 2, 0};
+            av_image_copy(frame->data, frame->linesize, source, sourceLinesize, context->pix_fmt, width, height);
+        }
+        else
+        {
+            upscalePlane(planes, width, width, height, frame->data[0], frame->linesize[0], format.scale);
+            upscalePlane(u, width / 2, width / 2, height / 2, frame->data[1], frame->linesize[1], format.scale);
+            upscalePlane(v, width / 2, width / 2, height / 2, frame->data[2], frame->linesize[2], format.scale);
+        }
+        submitPooled(yuvBuffer, yuv->number);
+        return;
+    }
+
+    submit(yuv->number);
+}
+
+// Encodes frame and records how long it took
+void VideoEncoder::submit(int64_t pts)
+{
+    frame->pts = pts;
+    uint64_t start = SDL_GetPerformanceCounter();
     encode(frame);
+    lastEncodeMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    encoderMetrics->encodeTime.record(lastEncodeMs);
+    encoderMetrics->frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+EncoderMetrics* VideoEncoder::metrics()
+{
+    return encoderMetrics;
+}
+
+// Counts into shared instead of this encoder's own metrics, e.g. so every
+// recording adds to the same totals. Call before the first frame.
+void VideoEncoder::setMetrics(EncoderMetrics* shared)
+{
+    encoderMetrics = shared;
+}
+
+// Starts writing the H.264 stream to filename. Made for an encoder that was
+// opened ahead of time without a file and hasn't encoded anything yet.
+bool VideoEncoder::openOutput(const char* filename)
+{
+    return output == NULL && fopen_s(&output, filename, "wb") == 0;
+}
+
+void VideoEncoder::consumeFrame(const FrameRef& frame)
+{
+    sendFrame(frame->pixels, frame->number);
+    adaptQuality(frame->number, queuedFrames);
+}
+
+// From now on, picks the CRF, preset and lookahead that keep up with capture
+// (see qualitycontroller.h) instead of the preset the encoder was made with.
+// Must be called before the first frame. Not for encoders with a global header,
+// whose stream can't change settings part way through.
+void VideoEncoder::enableAdaptiveQuality(const char* name)
+{
+    if (globalHeader || quality)
+        return;
+
+    quality = new QualityController(name);
+    avcodec_free_context(&context);
+    openContext(NULL, &quality->level());
+}
+
+// Feeds the time the last frame took to encode, and the number of frames
+// waiting behind it, to the quality controller
+void VideoEncoder::adaptQuality(uint64_t frameNumber, int backlog)
+{
+    if (!quality)
+        return;
+
+    QualityLevel from = quality->level();
+    if (!quality->update(frameNumber, lastEncodeMs, backlog))
+        return;
+
+    const QualityLevel& to = quality->level();
+    if (strcmp(from.preset, to.preset) == 0 && from.lookahead == to.lookahead)
+    {
+        // libx264 picks a new CRF up from the next frame
+        av_opt_set_double(context->priv_data, "crf", to.crf, 0);
+        return;
+    }
+
+    // Presets and lookahead are fixed once x264 is open, so drain this encoder
+    // and carry on with a new one. It starts on a keyframe with its own headers.
+    encode(NULL);
+    avcodec_free_context(&context);
+    openContext(NULL, &to);
+}
+
+void VideoEncoder::reportQuality()
+{
+    if (quality)
+    {
+        quality->report();
+    }
+}
+
+// Also sends every encoded packet to sink, e.g. for live streaming
+void VideoEncoder::setPacketSink(PacketSink* sink)
+{
+    packetSink = sink;
+}
+
+const AVCodecContext* VideoEncoder::codecContext()
+{
+    return streamContext;
+}
+
+// Opens x264 with either a preset or a quality level. A NULL preset leaves the
+// codec's own defaults; a codec without presets can't be given one.
+void VideoEncoder::openContext(const char* preset, const QualityLevel* level)
+{
+    context = avcodec_alloc_context3(codec);
+    if (!context)
+    {
+        throw std::runtime_error("Could not allocate video codec context");
+    }
+
+    context->width = DS_WIDTH * format.scale;
+    context->height = (region == EncodeBothScreens ? DS_HEIGHT * 2 : DS_HEIGHT) * format.scale;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = {1, 60};
+    context->framerate = {60, 1};
+    if (format.bitRate > 0)
+        context->bit_rate = format.bitRate;
+    context->gop_size = 60; // A keyframe every second so live subscribers can join quickly
+    //context->max_b_frames = 1;
+    if (globalHeader)
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if (level)
+    {
+        context->max_b_frames = 0;
+        av_opt_set(context->priv_data, "preset", level->preset, 0);
+        av_opt_set_double(context->priv_data, "crf", level->crf, 0);
+        av_opt_set_int(context->priv_data, "rc-lookahead", level->lookahead, 0);
+    }
+    else if (preset && av_opt_set(context->priv_data, "preset", preset, 0) < 0)
+    {
+        printf("The %s encoder has no preset %s\n", codec->name, preset);
+        avcodec_free_context(&context);
+        throw std::runtime_error("Unsupported encoder preset");
+    }
+
+    if (avcodec_open2(context, codec, NULL) < 0)
+    {
+        throw std::runtime_error("Could not open context");
+    }
+}
+
+// Submits the frame with a pooled buffer lent to it rather than referenced,
+// so no AVBufferRef is made here; libav takes its own reference when the
+// frame is sent. The buffer is taken back afterwards, as the frame must
+// never unreference it.
+void VideoEncoder::submitPooled(AVBufferRef* yuvBuffer, int64_t pts)
+{
+    frame->buf[0] = yuvBuffer;
+    try
+    {
+        submit(pts);
+    }
+    catch (...)
+    {
+        frame->buf[0] = NULL;
+        throw;
+    }
+    frame->buf[0] = NULL;
+}
+
+// Returns a pooled buffer the codec no longer references, or NULL if the
+// codec holds them all
+AVBufferRef* VideoEncoder::freeYuvBuffer()
+{
+    for (int i = 0; i < ENCODER_YUV_BUFFERS; ++i)
+    {
+        if (av_buffer_get_ref_count(yuvBuffers[i]) == 1)
+            return yuvBuffers[i];
+    }
+    return NULL;
+}
+
+// Wraps a converted frame in a read-only buffer for libav. The frame is held
+// until libav lets go of the buffer, so its pool can't hand it out meanwhile.
+// Returns NULL if libav still holds every frame this encoder can hold.
+AVBufferRef* VideoEncoder::holdSharedFrame(const FrameRef& yuv)
+{
+    for (int i = 0; i < ENCODER_YUV_BUFFERS; ++i)
+    {
+        if (sharedFrames[i])
+            continue;
+
+        sharedFrames[i] = yuv;
+        AVBufferRef* buffer = av_buffer_create(( uint8_t*) yuv->pixels, DS_WIDTH * DS_HEIGHT * 2 * 3 / 2,
+                                               [](void* held, uint8_t*) { (( FrameRef*) held)->reset(); },
+                                               &sharedFrames[i], AV_BUFFER_FLAG_READONLY);
+        countAvBufferRef();
+        if (!buffer)
+        {
+            sharedFrames[i].reset();
+            throw std::runtime_error("Could not create video frame buffer");
+        }
+        return buffer;
+    }
+    return NULL;
 }
 
 void VideoEncoder::encode(AVFrame* frame)
@@ -109,7 +393,15 @@ void VideoEncoder::encode(AVFrame* frame)
         else if (ret < 0)
             throw std::runtime_error("Error encoding video frame");
         
-        fwrite(packet->data, 1, packet->size, output);
+        encoderMetrics->bytes.fetch_add(packet->size, std::memory_order_relaxed);
+        if (output)
+        {
+            fwrite(packet->data, 1, packet->size, output);
+        }
+        if (packetSink)
+        {
+            packetSink->writePacket(streamContext, packet);
+        }
         av_packet_unref(packet);
     }
 }
@@ -1,27 +1,91 @@
 #pragma once
+#include <atomic>
 #include <cstdio>
+#include "framebus.h"
+#include "framememory.h"
+#include "metrics.h"
+#include "packetsink.h"
+#include "qualitycontroller.h"
 extern "C" {
     #include <libavcodec/avcodec.h>
 }
 
-class VideoEncoder
+#define ENCODER_YUV_BUFFERS 4
+
+typedef enum
+{
+    EncodeBothScreens = 0, // The top screen stacked on the bottom one
+    EncodeTopScreen,
+    EncodeBottomScreen
+} encode_region;
+
+// What an encoder produces beyond its preset, e.g. for a rendition (see renditions.h)
+struct EncoderFormat
+{
+    const char* codec = NULL; // A libavcodec encoder name taking yuv420p, or NULL for the default H.264 encoder
+    int bitRate = 0;          // Average bits per second, or 0 to encode at constant quality
+    int scale = 1;            // Integer upscale, only for frames sent by sendYuvFrame
+};
+
+// Kept on the encoding thread for a metrics scrape; never locked
+struct EncoderMetrics
+{
+    std::atomic<uint64_t> frames = {0};
+    std::atomic<uint64_t> bytes = {0}; // Encoded bytes, whether written to a file or a packet sink
+    std::atomic<uint64_t> dropped = {0}; // Frames skipped because the codec still held every buffer
+    MetricHistogram encodeTime;
+};
+
+class VideoEncoder : public FrameSink
 {
 public:
-    VideoEncoder();
+    VideoEncoder(const char* preset = "ultrafast", const char* filename = "video.mp4",
+                 encode_region region = EncodeBothScreens, bool globalHeader = false,
+                 const EncoderFormat& format = EncoderFormat());
     ~VideoEncoder();
 
-    void sendFrame(uint16_t* buffer);
+    bool openOutput(const char* filename);
+    void sendFrame(const uint16_t* buffer, int64_t pts);
+    void sendYuvFrame(const FrameRef& yuv);
+    void consumeFrame(const FrameRef& frame) override;
+    void setPacketSink(PacketSink* sink);
+    const AVCodecContext* codecContext();
+
+    void enableAdaptiveQuality(const char* name);
+    void adaptQuality(uint64_t frameNumber, int backlog);
+    void reportQuality();
+    QualityController* qualityController() { return quality; }
+
+    EncoderMetrics* metrics();
+    void setMetrics(EncoderMetrics* shared);
 
 private:
     const AVCodec* codec;
     AVCodecContext* context;
+    AVCodecContext* streamContext;
     AVFrame* frame;
     AVPacket* packet;
-    
+    FrameSlab* yuvMemory;
+    AVBufferRef* yuvBuffers[ENCODER_YUV_BUFFERS];
+
+    FrameRef sharedFrames[ENCODER_YUV_BUFFERS]; // Converted frames libav holds a reference to
+
+    encode_region region;
+    bool globalHeader;
+    EncoderFormat format;
     FILE* output;
+    PacketSink* packetSink = NULL;
 
-    int frameCount = 0;
+    QualityController* quality = NULL;
+    double lastEncodeMs = 0.0;
+    EncoderMetrics ownMetrics;
+    EncoderMetrics* encoderMetrics = &ownMetrics;
 
+    void openContext(const char* preset, const QualityLevel* level);
+    AVBufferRef* freeYuvBuffer();
+    AVBufferRef* holdSharedFrame(const FrameRef& yuv);
+    void submit(int64_t pts);
+    void submitPooled(AVBufferRef* yuvBuffer, int64_t pts);
     void encode(AVFrame* frame);
 };
 
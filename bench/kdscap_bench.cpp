@@ -0,0 +1,290 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "benchmarkstages.h"
+#include "dsframe.h"
+#include "lzcompress.h"
+#include "pixelconvert.h"
+#include "syntheticsource.h"
+
+// The portable subset of KDSCap --benchmark: de-swizzling, recovering cut off
+// frames (checked against the pixels that should survive), colour conversion, frame differences, raw recording compression,
+// plain stdio writes and, when built with SDL2 and FFmpeg, video and audio
+// encoding. Needs neither Windows nor a device, so it runs on a CI box or a
+// Linux workstation, and writes the same JSON as KDSCap --benchmark, whose
+// stages it shares (see KDSCap/benchmarkstages.h).
+//
+//     kdscap_bench [<file>] [<frames>]
+
+#define BENCH_DEFAULT_FRAMES 600
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+// Minimal LCG, so every run checks the same cases
+static uint32_t nextRandom(uint32_t* state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// Frames cut off at random points, with a growing share of half-lines masked
+// out as repeats, decoded and checked against what should have survived: the
+// half-lines that arrived whole and repeats of them, with every other
+// half-line kept from the previous frame. Then checks a frame without the
+// valid flags is repeated whole, or lost when there is no previous frame.
+static BenchmarkResult benchRecoverCheck(int frames)
+{
+    BenchmarkResult result = {"recover", "checked", frames};
+    const int halfWidth = DS_LCD_WIDTH / 2;
+    const int bottom = DS_LCD_WIDTH * DS_LCD_HEIGHT;
+    const int halfLines = DS_LCD_HEIGHT * 2;
+    std::vector<uint16_t> truth(BENCH_FRAME_PIXELS);
+    std::vector<uint16_t> previous(BENCH_FRAME_PIXELS);
+    std::vector<uint16_t> expected(BENCH_FRAME_PIXELS);
+    std::vector<uint16_t> output(BENCH_FRAME_PIXELS);
+    std::vector<uint16_t> payload(DS_FRAME_SIZE / sizeof(uint16_t));
+    int sentIndex[DS_LCD_HEIGHT * 2]; // Position in the payload, or -1 if masked out
+    bool present[DS_LCD_HEIGHT * 2];
+    uint8_t info[DS_INFO_SIZE];
+    uint32_t random = 1;
+    char failure[128] = "";
+    BenchmarkTimer timer;
+
+    for (int i = 0; i < BENCH_FRAME_PIXELS; ++i)
+    {
+        previous[i] = ( uint16_t) nextRandom(&random);
+    }
+
+    timer.start();
+    for (int f = 0; f < frames && !failure[0]; ++f)
+    {
+        // The first two half-lines carry the valid flags, so are always sent
+        memset(info, 0, sizeof(info));
+        info[52] = 1;
+        int maskedPercent = f % 4 * 25;
+        int sent = 0;
+        for (int line = 0; line < halfLines; ++line)
+        {
+            bool send = line < 2 || ( int) (nextRandom(&random) % 100) >= maskedPercent;
+            sentIndex[line] = send ? sent++ : -1;
+            if (send)
+                info[line >> 3] |= 1 << (line & 7);
+
+            uint16_t* dst = &truth[line * halfWidth];
+            for (int i = 0; i < halfWidth; ++i)
+            {
+                if (send)
+                {
+                    dst[i] = ( uint16_t) nextRandom(&random);
+                    dst[bottom + i] = ( uint16_t) nextRandom(&random);
+                    payload[(sentIndex[line] * halfWidth + i) * 2] = dst[bottom + i];
+                    payload[(sentIndex[line] * halfWidth + i) * 2 + 1] = dst[i];
+                }
+                else
+                {
+                    dst[i] = dst[i - DS_LCD_WIDTH];
+                    dst[bottom + i] = dst[bottom + i - DS_LCD_WIDTH];
+                }
+            }
+        }
+
+        // Cut anywhere, including mid half-line, and every third case on a half-line boundary
+        int cut = ( int) (nextRandom(&random) % (sent * DS_HALF_LINE_BYTES + 1));
+        if (f % 3 == 0)
+            cut -= cut % DS_HALF_LINE_BYTES;
+        int arrived = cut / DS_HALF_LINE_BYTES;
+
+        int expectedRecovered = 0;
+        for (int line = 0; line < halfLines; ++line)
+        {
+            present[line] = sentIndex[line] >= 0 ? sentIndex[line] < arrived : line >= 2 && present[line - 2];
+            const uint16_t* src = present[line] ? &truth[line * halfWidth] : &previous[line * halfWidth];
+            memcpy(&expected[line * halfWidth], src, halfWidth * sizeof(uint16_t));
+            memcpy(&expected[bottom + line * halfWidth], src + bottom, halfWidth * sizeof(uint16_t));
+            if (!present[line])
+                ++expectedRecovered;
+        }
+
+        int recovered = decodeFrame(&payload[0], cut, info, &previous[0], &output[0]);
+        if (recovered != expectedRecovered)
+            snprintf(failure, sizeof(failure), "case %d recovered %d half-lines, expected %d", f, recovered, expectedRecovered);
+        else if (memcmp(&output[0], &expected[0], BENCH_FRAME_PIXELS * sizeof(uint16_t)) != 0)
+            snprintf(failure, sizeof(failure), "case %d merged the wrong pixels", f);
+    }
+    timer.stop(&result);
+
+    info[0] &= ~3;
+    if (!failure[0])
+    {
+        int recovered = decodeFrame(&payload[0], DS_FRAME_SIZE, info, &previous[0], &output[0]);
+        if (recovered != halfLines || memcmp(&output[0], &previous[0], BENCH_FRAME_PIXELS * sizeof(uint16_t)) != 0)
+            snprintf(failure, sizeof(failure), "an invalid frame recovered %d half-lines, expected the previous frame", recovered);
+        else if (decodeFrame(&payload[0], DS_FRAME_SIZE, info, NULL, &output[0]) != -1)
+            snprintf(failure, sizeof(failure), "an invalid frame with no previous frame wasn't lost");
+    }
+    result.failure = failure;
+    return result;
+}
+
+// How much each frame changed from the one before, as lag frame analysis measures it
+static BenchmarkResult benchDifference(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"difference", "", frames};
+    volatile uint64_t difference; // Kept, so the calls aren't optimized away
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        difference = sumAbsDifference(scene.frame(i), scene.frame(i + BENCH_SOURCE_FRAMES - 1), BENCH_FRAME_PIXELS);
+    }
+    timer.stop(&result);
+    ( void) difference;
+    return result;
+}
+
+// Compressing payloads as a raw recording does, then checking every one
+// decompresses back to the original
+static BenchmarkResult benchCompress(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"compress", "lz", frames};
+    std::vector<uint8_t> compressed(BENCH_SOURCE_FRAMES * LZ_COMPRESS_BOUND(DS_FRAME_SIZE));
+    std::vector<int> sizes(BENCH_SOURCE_FRAMES);
+    BenchmarkTimer timer;
+
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        int slot = i % BENCH_SOURCE_FRAMES;
+        sizes[slot] = lzCompress(( const uint8_t*) scene.payload(i), DS_FRAME_SIZE,
+                                 &compressed[slot * LZ_COMPRESS_BOUND(DS_FRAME_SIZE)], LZ_COMPRESS_BOUND(DS_FRAME_SIZE));
+    }
+    timer.stop(&result);
+
+    std::vector<uint8_t> decompressed(DS_FRAME_SIZE);
+    for (int i = 0; i < BENCH_SOURCE_FRAMES && i < frames; ++i)
+    {
+        int size = lzDecompress(&compressed[i * LZ_COMPRESS_BOUND(DS_FRAME_SIZE)], sizes[i], &decompressed[0], DS_FRAME_SIZE);
+        if (sizes[i] <= 0 || size != DS_FRAME_SIZE || memcmp(&decompressed[0], scene.payload(i), DS_FRAME_SIZE) != 0)
+        {
+            result.failure = "frame " + std::to_string(i) + " did not decompress to the original";
+            break;
+        }
+    }
+    return result;
+}
+
+// Plain stdio writes of every frame, to the null device so only the copying
+// into stdio's buffer and the system calls are timed, not a disk
+static BenchmarkResult benchWrite(const SceneFrames& scene, int frames)
+{
+    BenchmarkResult result = {"write", "", frames};
+    FILE* file = fopen(NULL_DEVICE, "wb");
+    if (!file)
+        throw std::runtime_error("Could not open " NULL_DEVICE);
+
+    BenchmarkTimer timer;
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+    {
+        fwrite(scene.frame(i), sizeof(uint16_t), BENCH_FRAME_PIXELS, file);
+    }
+    fclose(file);
+    timer.stop(&result);
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* outputPath = argc > 1 ? argv[1] : "bench.json";
+    int frames = BENCH_DEFAULT_FRAMES;
+    if (argc > 2)
+    {
+        char* end;
+        frames = ( int) strtol(argv[2], &end, 10);
+        if (*end != '\0' || frames <= 0)
+        {
+            printf("Usage: %s [<file>] [<frames>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    try
+    {
+        for (int s = 0; s < NUM_SYNTHETIC_SCENES; ++s)
+        {
+            synthetic_scene scene = ( synthetic_scene) s;
+            std::string name = SyntheticSource::sceneName(scene);
+            SceneFrames sceneFrames;
+            generateScene(scene, &sceneFrames);
+
+            printf("Benchmarking %s scene\n", name.c_str());
+
+            results.push_back(benchDeswizzle(sceneFrames, frames));
+            results.back().variant = name;
+            results.push_back(benchRecover(sceneFrames, frames));
+            results.back().variant = name;
+            results.push_back(benchConvertRGB(sceneFrames, frames));
+            results.back().variant += "/" + name;
+            results.push_back(benchDifference(sceneFrames, frames));
+            results.back().variant = name;
+            results.push_back(benchCompress(sceneFrames, frames));
+            results.back().variant += "/" + name;
+            results.push_back(benchWrite(sceneFrames, frames));
+            results.back().variant = name;
+
+#ifdef KDSCAP_BENCH_ENCODE
+            for (int p = 0; p < NUM_ENCODER_PRESETS; ++p)
+            {
+                results.push_back(benchEncode(sceneFrames, encoderPresets[p], frames));
+                results.back().variant += "/" + name;
+            }
+#endif
+        }
+
+        printf("Checking partial frame recovery\n");
+        results.push_back(benchRecoverCheck(frames));
+
+#ifdef KDSCAP_BENCH_ENCODE
+        printf("Benchmarking audio\n");
+        results.push_back(benchAudio(frames));
+#endif
+    }
+    catch (const std::exception& e)
+    {
+        printf("Benchmark failed: %s\n", e.what());
+        return 1;
+    }
+
+    printResults(results);
+
+    FILE* file = fopen(outputPath, "w");
+    if (!file)
+    {
+        printf("Could not open %s\n", outputPath);
+        return 1;
+    }
+    writeResults(file, frames, results);
+    fclose(file);
+
+    printf("Wrote benchmark results to %s\n", outputPath);
+
+    int exitCode = 0;
+    for (const BenchmarkResult& r : results)
+    {
+        if (!r.failure.empty())
+        {
+            printf("%s/%s failed: %s\n", r.stage.c_str(), r.variant.c_str(), r.failure.c_str());
+            exitCode = 1;
+        }
+    }
+    return exitCode;
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Forced into every file of the portable benchmark when it isn't built with
+// the Microsoft CRT, for the few of its functions the shared sources use
+#include <cerrno>
+#include <cstdio>
+
+static inline int fopen_s(FILE** file, const char* filename, const char* mode)
+{
+    *file = fopen(filename, mode);
+    return *file ? 0 : errno;
+}
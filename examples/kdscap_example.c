@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Windows.h>
+#include "kdscap.h"
+
+/*
+ * Captures from the device, a raw recording or a synthetic scene through
+ * libkdscap, first with a frame callback and then by waiting for frames, and
+ * prints how long frames took to reach the program. A replay starts again
+ * from its first frame the second time.
+ *
+ * kdscap_example                     capture from the device
+ * kdscap_example replay <file>       replay a raw recording
+ * kdscap_example synthetic <scene>   static, scrolling, fullmotion or partial
+ */
+
+#define EXAMPLE_FRAMES 300
+
+typedef struct
+{
+    double frequency;
+    uint64_t frames;
+    double totalMs;
+    double maxMs;
+    uint32_t checksum;
+} delivery_stats;
+
+/* The callback counts on the library's thread while main watches the count */
+typedef struct
+{
+    delivery_stats stats;
+    CRITICAL_SECTION lock;
+} shared_stats;
+
+static double msSince(uint64_t captureTime, double frequency)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - captureTime) * 1000.0 / frequency;
+}
+
+static void countFrame(delivery_stats* stats, const kdscap_frame* frame)
+{
+    double ms = msSince(frame->capture_time, stats->frequency);
+    ++stats->frames;
+    stats->totalMs += ms;
+    if (ms > stats->maxMs)
+        stats->maxMs = ms;
+
+    // Touch the pixels the way a consumer would
+    stats->checksum += frame->pixels[(frame->number * 7919) % (KDSCAP_WIDTH * KDSCAP_HEIGHT)];
+}
+
+static void printStats(const char* name, const delivery_stats* stats)
+{
+    if (stats->frames == 0)
+    {
+        printf("%s: no frames\n", name);
+        return;
+    }
+    printf("%s: %llu frames, delivery mean %.3f ms, max %.3f ms\n", name,
+           ( unsigned long long) stats->frames, stats->totalMs / stats->frames, stats->maxMs);
+}
+
+static void onFrame(const kdscap_frame* frame, void* user)
+{
+    shared_stats* shared = ( shared_stats*) user;
+    EnterCriticalSection(&shared->lock);
+    countFrame(&shared->stats, frame);
+    LeaveCriticalSection(&shared->lock);
+}
+
+static uint64_t sharedFrames(shared_stats* shared)
+{
+    uint64_t frames;
+    EnterCriticalSection(&shared->lock);
+    frames = shared->stats.frames;
+    LeaveCriticalSection(&shared->lock);
+    return frames;
+}
+
+static kdscap_capture* openCapture(int argc, char** argv)
+{
+    if (argc > 2 && strcmp(argv[1], "replay") == 0)
+        return kdscap_open_replay(argv[2]);
+    if (argc > 2 && strcmp(argv[1], "synthetic") == 0)
+        return kdscap_open_synthetic(argv[2], 1);
+    return kdscap_open_device();
+}
+
+int main(int argc, char** argv)
+{
+    double frequency = ( double) kdscap_timestamp_frequency();
+
+    printf("libkdscap API version %d\n", kdscap_api_version());
+
+    kdscap_capture* capture = openCapture(argc, argv);
+    if (!capture)
+    {
+        printf("Could not open capture: %s\n", kdscap_last_error());
+        return EXIT_FAILURE;
+    }
+
+    shared_stats callbackStats = {0};
+    callbackStats.stats.frequency = frequency;
+    InitializeCriticalSection(&callbackStats.lock);
+    kdscap_set_frame_callback(capture, onFrame, &callbackStats);
+    kdscap_start(capture);
+    while (sharedFrames(&callbackStats) < EXAMPLE_FRAMES && kdscap_is_capturing(capture))
+    {
+        Sleep(10);
+    }
+    kdscap_stop(capture); /* The callback has returned for the last time */
+    printStats("Callback", &callbackStats.stats);
+    DeleteCriticalSection(&callbackStats.lock);
+
+    delivery_stats pullStats = {0};
+    pullStats.frequency = frequency;
+    kdscap_set_frame_callback(capture, NULL, NULL);
+    kdscap_start(capture);
+    while (pullStats.frames < EXAMPLE_FRAMES)
+    {
+        kdscap_frame frame;
+        int result = kdscap_wait_frame(capture, 1000, &frame);
+        if (result < 0)
+            break;
+        if (result > 0)
+            countFrame(&pullStats, &frame);
+    }
+    kdscap_stop(capture);
+    printStats("Wait", &pullStats);
+
+    kdscap_close(capture);
+    return EXIT_SUCCESS;
+}
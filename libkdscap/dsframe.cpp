@@ -0,0 +1,134 @@
+#include <cstring>
+#include "dsframe.h"
+
+// Returns false if the device flagged the frame as unusable
+bool isFrameValid(const uint8_t* frameInfo)
+{
+    if ((frameInfo[0] & 3) != 3)
+        return false;
+    if (!frameInfo[52])
+        return false;
+    return true;
+}
+
+// Returns the size of the payload the frame info's mask describes
+int expectedPayloadBytes(const uint8_t* frameInfo)
+{
+    int halfLines = 0;
+    for (int line = 0; line < DS_LCD_HEIGHT * 2; ++line)
+    {
+        if (frameInfo[line >> 3] & (1 << (line & 7)))
+            ++halfLines;
+    }
+    return halfLines * DS_HALF_LINE_BYTES;
+}
+
+// Converts a bulk payload into the top screen followed by the bottom screen.
+// The payload holds the two screens' pixels interleaved, one half-line at a
+// time. Half-lines not set in the frame info's mask were left out of the
+// payload because they repeat the half-line above.
+void deswizzleFrame(const uint16_t* payload, const uint8_t* frameInfo, uint16_t* output)
+{
+    const uint16_t* src = payload;
+    uint16_t* dst = output;
+    for (int line = 0; line < DS_LCD_HEIGHT * 2; ++line)
+    {
+        if (frameInfo[line >> 3] & (1 << (line & 7)))
+        {
+            for (int i = 0; i < DS_LCD_WIDTH / 2; ++i)
+            {
+                dst[0] = src[1];
+                dst[DS_LCD_WIDTH * DS_LCD_HEIGHT] = src[0];
+                dst++;
+                src += 2;
+            }
+        }
+        else
+        {
+            memcpy(dst, dst - 256, 256);
+            memcpy(dst + 256 * 192, dst + 256 * 191, 256);
+            dst += 128;
+        }
+    }
+}
+
+// Like deswizzleFrame, for a payload that was cut short after payloadBytes.
+// Half-lines that never arrived, and masked-out half-lines repeating one that
+// never arrived, are kept from previous, or left black if previous is NULL.
+// Returns the number of half-lines kept from previous.
+int deswizzlePartialFrame(const uint16_t* payload, int payloadBytes, const uint8_t* frameInfo,
+                          const uint16_t* previous, uint16_t* output)
+{
+    const int halfWidth = DS_LCD_WIDTH / 2;
+    const int bottom = DS_LCD_WIDTH * DS_LCD_HEIGHT;
+    const uint16_t* src = payload;
+    const uint16_t* end = payload + payloadBytes / sizeof(uint16_t);
+    bool missing[DS_LCD_HEIGHT * 2];
+    int recovered = 0;
+
+    for (int line = 0; line < DS_LCD_HEIGHT * 2; ++line)
+    {
+        uint16_t* dst = output + line * halfWidth;
+
+        if (frameInfo[line >> 3] & (1 << (line & 7)))
+        {
+            missing[line] = src + halfWidth * 2 > end;
+            if (!missing[line])
+            {
+                for (int i = 0; i < halfWidth; ++i)
+                {
+                    dst[i] = src[1];
+                    dst[bottom + i] = src[0];
+                    src += 2;
+                }
+                continue;
+            }
+        }
+        else
+        {
+            // Repeats the same half of the line above
+            missing[line] = line < 2 || missing[line - 2];
+            if (!missing[line])
+            {
+                memcpy(dst, dst - DS_LCD_WIDTH, halfWidth * sizeof(uint16_t));
+                memcpy(dst + bottom, dst + bottom - DS_LCD_WIDTH, halfWidth * sizeof(uint16_t));
+                continue;
+            }
+        }
+
+        if (previous)
+        {
+            const uint16_t* old = previous + line * halfWidth;
+            memcpy(dst, old, halfWidth * sizeof(uint16_t));
+            memcpy(dst + bottom, old + bottom, halfWidth * sizeof(uint16_t));
+        }
+        else
+        {
+            memset(dst, 0, halfWidth * sizeof(uint16_t));
+            memset(dst + bottom, 0, halfWidth * sizeof(uint16_t));
+        }
+        ++recovered;
+    }
+
+    return recovered;
+}
+
+// Decodes a frame as received: whole frames are de-swizzled, and incomplete
+// ones are patched from previous. Without the valid flags the payload can't
+// be trusted, so previous is repeated whole.
+// Returns the number of half-lines kept from previous, or -1 if the frame
+// is unusable because there is no previous frame to patch it from.
+int decodeFrame(const uint16_t* payload, int payloadBytes, const uint8_t* frameInfo,
+                const uint16_t* previous, uint16_t* output)
+{
+    bool valid = isFrameValid(frameInfo);
+    if (valid && payloadBytes >= expectedPayloadBytes(frameInfo))
+    {
+        deswizzleFrame(payload, frameInfo, output);
+        return 0;
+    }
+    if (!valid && !previous)
+        return -1;
+
+    return deswizzlePartialFrame(payload, valid ? payloadBytes : 0, frameInfo, previous, output);
+}
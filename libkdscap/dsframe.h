@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+// Layout of the frames the capture board sends, independent of how they are read from USB
+
+#define DS_INFO_SIZE 64
+#define DS_LCD_WIDTH 256
+#define DS_LCD_HEIGHT 192
+#define DS_FRAME_SIZE 1024 * DS_LCD_HEIGHT
+#define DS_FRAME_RATE 59.8261
+#define DS_LINE_MASK_SIZE (DS_LCD_HEIGHT * 2 / 8)
+#define DS_HALF_LINE_BYTES (DS_LCD_WIDTH * 2 * sizeof(uint16_t) / 2) // Both screens, interleaved
+
+// Per-frame data handed out by grabFrame alongside the pixels.
+// Timestamps are SDL performance counter values.
+struct DSFrameInfo
+{
+    uint64_t captureTime; // Bulk read of the frame completed
+    uint64_t grabTime;    // Frame was dequeued by grabFrame
+    uint8_t lineMask[DS_LINE_MASK_SIZE]; // Half-lines sent by the device this frame
+    uint16_t recoveredLines; // Half-lines that did not arrive and were kept from the previous frame
+};
+
+bool isFrameValid(const uint8_t* frameInfo);
+int expectedPayloadBytes(const uint8_t* frameInfo);
+void deswizzleFrame(const uint16_t* payload, const uint8_t* frameInfo, uint16_t* output);
+int deswizzlePartialFrame(const uint16_t* payload, int payloadBytes, const uint8_t* frameInfo,
+                          const uint16_t* previous, uint16_t* output);
+int decodeFrame(const uint16_t* payload, int payloadBytes, const uint8_t* frameInfo,
+                const uint16_t* previous, uint16_t* output);
@@ -0,0 +1,165 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <cerrno>
+#endif
+#include <cstdio>
+#include <stdexcept>
+#include "framememory.h"
+
+static int memoryFlags = 0;
+
+#ifdef _WIN32
+// Large pages need SeLockMemoryPrivilege, which has to be granted to the
+// user by policy and then enabled for the process.
+static bool enableLockMemoryPrivilege()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool result = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                  AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+                  GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return result;
+}
+
+FrameSlab::FrameSlab(size_t bytes) :
+    memory(NULL),
+    bytes(bytes),
+    usingLargePages(false),
+    locked(false)
+{
+    if (memoryFlags & FRAME_MEMORY_LARGE_PAGES)
+    {
+        static bool privilegeEnabled = enableLockMemoryPrivilege();
+        size_t largePage = GetLargePageMinimum();
+        if (privilegeEnabled && largePage > 0)
+        {
+            size_t largeBytes = (bytes + largePage - 1) / largePage * largePage;
+            memory = ( uint8_t*) VirtualAlloc(NULL, largeBytes, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (memory)
+            {
+                this->bytes = largeBytes;
+                usingLargePages = true;
+            }
+        }
+        if (!usingLargePages)
+        {
+            printf("Large pages unavailable for frame memory, using normal pages\n");
+        }
+    }
+
+    // VirtualAlloc memory is page aligned, so FRAME_ALIGNMENT always holds
+    if (!memory)
+    {
+        memory = ( uint8_t*) VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!memory)
+        {
+            printf("Could not allocate %llu bytes of frame memory: %d\n", ( unsigned long long) bytes, GetLastError());
+            throw std::runtime_error("Could not allocate frame memory");
+        }
+    }
+
+    // Large pages are never paged out anyway
+    if ((memoryFlags & FRAME_MEMORY_LOCKED) && !usingLargePages)
+    {
+        SIZE_T minimum, maximum;
+        if (GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum))
+        {
+            SetProcessWorkingSetSize(GetCurrentProcess(), minimum + this->bytes, maximum + this->bytes);
+        }
+        locked = VirtualLock(memory, this->bytes) != 0;
+        if (!locked)
+        {
+            printf("Could not lock frame memory: %d\n", GetLastError());
+        }
+    }
+}
+
+FrameSlab::~FrameSlab()
+{
+    if (locked)
+    {
+        VirtualUnlock(memory, bytes);
+    }
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+#else
+
+FrameSlab::FrameSlab(size_t bytes) :
+    memory(NULL),
+    bytes(bytes),
+    usingLargePages(false),
+    locked(false)
+{
+#ifdef MAP_HUGETLB
+    // Huge pages have to be reserved first, e.g. with the vm.nr_hugepages sysctl
+    if (memoryFlags & FRAME_MEMORY_LARGE_PAGES)
+    {
+        size_t largePage = 2 * 1024 * 1024;
+        size_t largeBytes = (bytes + largePage - 1) / largePage * largePage;
+        void* pages = mmap(NULL, largeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pages != MAP_FAILED)
+        {
+            memory = ( uint8_t*) pages;
+            this->bytes = largeBytes;
+            usingLargePages = true;
+        }
+        else
+        {
+            printf("Large pages unavailable for frame memory, using normal pages\n");
+        }
+    }
+#endif
+
+    // mmap memory is page aligned, so FRAME_ALIGNMENT always holds
+    if (!memory)
+    {
+        void* pages = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pages == MAP_FAILED)
+        {
+            printf("Could not allocate %llu bytes of frame memory: %d\n", ( unsigned long long) bytes, errno);
+            throw std::runtime_error("Could not allocate frame memory");
+        }
+        memory = ( uint8_t*) pages;
+    }
+
+    if ((memoryFlags & FRAME_MEMORY_LOCKED) && !usingLargePages)
+    {
+        locked = mlock(memory, this->bytes) == 0;
+        if (!locked)
+        {
+            printf("Could not lock frame memory: %d\n", errno);
+        }
+    }
+}
+
+FrameSlab::~FrameSlab()
+{
+    if (locked)
+    {
+        munlock(memory, bytes);
+    }
+    munmap(memory, bytes);
+}
+
+#endif
+
+// Sets how slabs created from now on are backed. Called once at startup.
+void FrameSlab::setFlags(int flags)
+{
+    memoryFlags = flags;
+}
+
+// Rounds a buffer size up so the next buffer in a slab stays aligned
+size_t FrameSlab::align(size_t bytes)
+{
+    return (bytes + FRAME_ALIGNMENT - 1) & ~(( size_t) FRAME_ALIGNMENT - 1);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_ALIGNMENT 64 // Buffers carved from a slab start on a cache line, for SIMD loads and stores
+
+#define FRAME_MEMORY_LARGE_PAGES 1 // Back slabs with large pages when the process may lock memory
+#define FRAME_MEMORY_LOCKED 2      // Lock slabs into physical memory so frames never page out
+
+// One block of page-backed memory that frame buffers are carved out of.
+// Allocated once up front; nothing is allocated or freed per frame.
+class FrameSlab
+{
+public:
+    FrameSlab(size_t bytes);
+    ~FrameSlab();
+
+    uint8_t* data() { return memory; }
+    size_t size() { return bytes; }
+    bool largePages() { return usingLargePages; }
+
+    static void setFlags(int flags);
+    static size_t align(size_t bytes);
+
+private:
+    uint8_t* memory;
+    size_t bytes;
+    bool usingLargePages;
+    bool locked;
+};
@@ -0,0 +1,254 @@
+#include <SDL_timer.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "framememory.h"
+#include "kdscap.h"
+#include "threadpolicy.h"
+#include "win_dscapture.h"
+
+static_assert(KDSCAP_LINE_MASK_SIZE == DS_LINE_MASK_SIZE, "kdscap.h is out of step with dsframe.h");
+static_assert(KDSCAP_WIDTH == DS_LCD_WIDTH && KDSCAP_HEIGHT == DS_LCD_HEIGHT * 2, "kdscap.h is out of step with dsframe.h");
+
+#define KDSCAP_DELIVERY_WAIT_MS 100 // How often the delivery thread checks whether to stop
+
+struct kdscap_capture
+{
+    DSCapture* capture;
+    FrameSlab* memory;
+    uint16_t* pixels; // The frame being handed out
+    DSFrameInfo info;
+    uint64_t frameNumber;
+    bool started;
+
+    kdscap_frame_callback callback;
+    void* user;
+    std::thread deliveryThread;
+    std::atomic<bool> delivering;
+};
+
+static thread_local std::string lastError;
+
+static bool checkArgument(const void* argument, const char* name)
+{
+    if (argument)
+        return true;
+    lastError = std::string(name) + " is NULL";
+    return false;
+}
+
+static kdscap_capture* wrap(DSCapture* dscapture)
+{
+    kdscap_capture* capture = new kdscap_capture();
+    capture->capture = dscapture;
+    capture->memory = new FrameSlab(FrameSlab::align(KDSCAP_WIDTH * KDSCAP_HEIGHT * sizeof(uint16_t)));
+    capture->pixels = ( uint16_t*) capture->memory->data();
+    capture->frameNumber = 0;
+    capture->started = false;
+    capture->callback = NULL;
+    capture->user = NULL;
+    capture->delivering = false;
+    return capture;
+}
+
+// De-swizzles the next queued frame straight into the buffer handed out
+static bool grab(kdscap_capture* capture, kdscap_frame* frame)
+{
+    if (!capture->capture->grabFrame(capture->pixels, &capture->info))
+        return false;
+
+    frame->pixels = capture->pixels;
+    frame->number = capture->frameNumber++;
+    frame->capture_time = capture->info.captureTime;
+    frame->line_mask = capture->info.lineMask;
+    frame->recovered_lines = capture->info.recoveredLines;
+    return true;
+}
+
+static void deliverFrames(kdscap_capture* capture)
+{
+    configureThread(ThreadWorker, "frame callback");
+
+    kdscap_frame frame;
+    while (capture->delivering)
+    {
+        if (!capture->capture->waitForFrame(KDSCAP_DELIVERY_WAIT_MS))
+        {
+            if (!capture->capture->isCapturing())
+                break;
+            continue;
+        }
+
+        if (grab(capture, &frame))
+        {
+            capture->callback(&frame, capture->user);
+        }
+    }
+}
+
+int kdscap_api_version(void)
+{
+    return KDSCAP_API_VERSION;
+}
+
+const char* kdscap_last_error(void)
+{
+    return lastError.c_str();
+}
+
+uint64_t kdscap_timestamp_frequency(void)
+{
+    return SDL_GetPerformanceFrequency();
+}
+
+kdscap_capture* kdscap_open_device(void)
+{
+    try
+    {
+        return wrap(new DSCapture());
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return NULL;
+    }
+}
+
+kdscap_capture* kdscap_open_replay(const char* path)
+{
+    if (!checkArgument(path, "path"))
+        return NULL;
+
+    try
+    {
+        return wrap(new DSCapture(path));
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return NULL;
+    }
+}
+
+// scene is static, scrolling, fullmotion or partial. Unpaced scenes run as
+// fast as frames are taken.
+kdscap_capture* kdscap_open_synthetic(const char* scene, int paced)
+{
+    if (!checkArgument(scene, "scene"))
+        return NULL;
+
+    synthetic_scene parsed;
+    if (!SyntheticSource::parseScene(scene, &parsed))
+    {
+        lastError = std::string("Unknown synthetic scene: ") + scene;
+        return NULL;
+    }
+
+    try
+    {
+        return wrap(new DSCapture(parsed, paced != 0));
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return NULL;
+    }
+}
+
+void kdscap_close(kdscap_capture* capture)
+{
+    if (!capture)
+        return;
+
+    kdscap_stop(capture);
+    delete capture->capture;
+    delete capture->memory;
+    delete capture;
+}
+
+// Must be called while stopped. A NULL callback goes back to kdscap_wait_frame.
+int kdscap_set_frame_callback(kdscap_capture* capture, kdscap_frame_callback callback, void* user)
+{
+    if (!checkArgument(capture, "capture"))
+        return KDSCAP_ERROR_INVALID_ARGUMENT;
+    if (capture->started)
+    {
+        lastError = "The frame callback can't be changed while capturing";
+        return -1;
+    }
+
+    capture->callback = callback;
+    capture->user = user;
+    return 0;
+}
+
+int kdscap_start(kdscap_capture* capture)
+{
+    if (!checkArgument(capture, "capture"))
+        return KDSCAP_ERROR_INVALID_ARGUMENT;
+    if (capture->started)
+    {
+        lastError = "Already capturing";
+        return -1;
+    }
+
+    capture->frameNumber = 0;
+    capture->capture->startCapture();
+    capture->started = true;
+    if (capture->callback)
+    {
+        capture->delivering = true;
+        capture->deliveryThread = std::thread(deliverFrames, capture);
+    }
+    return 0;
+}
+
+// Returns once the callback, if any, has returned for the last time
+void kdscap_stop(kdscap_capture* capture)
+{
+    if (!capture || !capture->started)
+        return;
+
+    capture->delivering = false;
+    if (capture->deliveryThread.joinable())
+    {
+        capture->deliveryThread.join();
+    }
+    capture->capture->endCapture();
+    capture->started = false;
+}
+
+// False once a replay has run out or the device was lost
+int kdscap_is_capturing(kdscap_capture* capture)
+{
+    if (!checkArgument(capture, "capture"))
+        return 0;
+    return capture->started && capture->capture->isCapturing();
+}
+
+int kdscap_wait_frame(kdscap_capture* capture, int timeout_ms, kdscap_frame* frame)
+{
+    if (!checkArgument(capture, "capture") || !checkArgument(frame, "frame"))
+        return KDSCAP_ERROR_INVALID_ARGUMENT;
+    if (!capture->started || capture->callback)
+    {
+        lastError = capture->callback ? "Frames are going to the frame callback" : "Not capturing";
+        return -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        int remainingMs = ( int) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (!capture->capture->waitForFrame(remainingMs > 0 ? remainingMs : 0))
+        {
+            return capture->capture->isCapturing() ? 0 : -1;
+        }
+
+        // A frame that couldn't be decoded is skipped, like the device never sent it
+        if (grab(capture, frame))
+            return 1;
+    }
+}
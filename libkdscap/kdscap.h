@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * C API for capturing from the DS capture board, a raw recording or a
+ * synthetic scene. Link against libkdscap.lib.
+ *
+ * Frames are handed out as borrowed pointers into the library's own buffer;
+ * nothing is copied after de-swizzling. Frames come either from a callback on
+ * the library's delivery thread or from kdscap_wait_frame, not both.
+ *
+ * Functions that fail return NULL or a negative number, and
+ * kdscap_last_error describes what went wrong on the calling thread. A NULL
+ * capture, path, scene or frame is KDSCAP_ERROR_INVALID_ARGUMENT.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KDSCAP_API_VERSION 2
+
+#define KDSCAP_ERROR_INVALID_ARGUMENT -2
+
+#define KDSCAP_WIDTH 256
+#define KDSCAP_HEIGHT 384        /* Both screens, top screen first */
+#define KDSCAP_LINE_MASK_SIZE 48 /* One bit per half-line */
+
+typedef struct kdscap_capture kdscap_capture;
+
+typedef struct
+{
+    const uint16_t* pixels;      /* KDSCAP_WIDTH x KDSCAP_HEIGHT RGB565 */
+    uint64_t number;             /* Frames delivered since kdscap_start, from 0 */
+    uint64_t capture_time;       /* When the frame finished arriving, in QueryPerformanceCounter ticks (see kdscap_timestamp_frequency) */
+    const uint8_t* line_mask;    /* Half-lines the device sent this frame; the rest didn't change */
+    int recovered_lines;         /* Half-lines that didn't arrive and were kept from the previous frame */
+} kdscap_frame;
+
+/* Called on the library's delivery thread. frame and everything it points to
+   are only valid until the callback returns. */
+typedef void (*kdscap_frame_callback)(const kdscap_frame* frame, void* user);
+
+int kdscap_api_version(void);
+const char* kdscap_last_error(void);
+uint64_t kdscap_timestamp_frequency(void); /* capture_time ticks per second */
+
+kdscap_capture* kdscap_open_device(void);
+kdscap_capture* kdscap_open_replay(const char* path);
+kdscap_capture* kdscap_open_synthetic(const char* scene, int paced);
+void kdscap_close(kdscap_capture* capture);
+
+int kdscap_set_frame_callback(kdscap_capture* capture, kdscap_frame_callback callback, void* user);
+/* A replay starts again from its first frame every time */
+int kdscap_start(kdscap_capture* capture);
+void kdscap_stop(kdscap_capture* capture);
+int kdscap_is_capturing(kdscap_capture* capture); /* 0 for a NULL capture */
+
+/* Waits up to timeout_ms for the next frame. Returns 1 with frame filled in,
+   0 on timeout, or -1 once capture has stopped. frame stays valid until the
+   next call, kdscap_stop or kdscap_close. */
+int kdscap_wait_frame(kdscap_capture* capture, int timeout_ms, kdscap_frame* frame);
+
+#ifdef __cplusplus
+}
+#endif
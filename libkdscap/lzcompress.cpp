@@ -0,0 +1,164 @@
+#include <cstring>
+#include "lzcompress.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // The block always ends with at least this many literals
+#define LZ_MATCH_LIMIT 12  // No match starts this close to the end
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline int hash32(uint32_t sequence)
+{
+    return ( int) ((sequence * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+// Writes a length that didn't fit in its 4-bit token field
+static inline uint8_t* writeLength(uint8_t* op, int length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = ( uint8_t) length;
+    return op;
+}
+
+// Compresses src into dst, which should hold LZ_COMPRESS_BOUND(srcSize) bytes.
+// Returns the compressed size, or -1 if it didn't fit in dstCapacity.
+int lzCompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity)
+{
+    int table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+
+    uint8_t* op = dst;
+    uint8_t* end = dst + dstCapacity;
+    int anchor = 0;
+    int ip = 0;
+
+    while (ip < srcSize - LZ_MATCH_LIMIT)
+    {
+        uint32_t sequence = read32(src + ip);
+        int h = hash32(sequence);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != sequence)
+        {
+            // Skip faster through data that doesn't compress
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        int matchLength = LZ_MIN_MATCH;
+        while (ip + matchLength < srcSize - LZ_LAST_LITERALS && src[ref + matchLength] == src[ip + matchLength])
+            ++matchLength;
+
+        int literals = ip - anchor;
+        if (op + 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1 > end)
+            return -1;
+
+        uint8_t* token = op++;
+        *token = ( uint8_t) ((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15)
+            op = writeLength(op, literals - 15);
+        memcpy(op, src + anchor, literals);
+        op += literals;
+
+        int offset = ip - ref;
+        *op++ = ( uint8_t) offset;
+        *op++ = ( uint8_t) (offset >> 8);
+
+        int extra = matchLength - LZ_MIN_MATCH;
+        *token |= ( uint8_t) (extra < 15 ? extra : 15);
+        if (extra >= 15)
+            op = writeLength(op, extra - 15);
+
+        ip += matchLength;
+        anchor = ip;
+    }
+
+    int literals = srcSize - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > end)
+        return -1;
+
+    uint8_t* token = op++;
+    *token = ( uint8_t) ((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        op = writeLength(op, literals - 15);
+    memcpy(op, src + anchor, literals);
+    op += literals;
+
+    return ( int) (op - dst);
+}
+
+// Decompresses a block made by lzCompress.
+// Returns the decompressed size, or -1 if the block is corrupt or too big for dst.
+int lzDecompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity)
+{
+    const uint8_t* ip = src;
+    const uint8_t* srcEnd = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* dstEnd = dst + dstCapacity;
+
+    while (ip < srcEnd)
+    {
+        int token = *ip++;
+
+        int literals = token >> 4;
+        if (literals == 15)
+        {
+            int b;
+            do
+            {
+                if (ip >= srcEnd) return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > srcEnd - ip || literals > dstEnd - op)
+            return -1;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == srcEnd)
+            break; // The last sequence has no match
+
+        if (srcEnd - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst)
+            return -1;
+
+        int matchLength = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15)
+        {
+            int b;
+            do
+            {
+                if (ip >= srcEnd) return -1;
+                b = *ip++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        if (matchLength > dstEnd - op)
+            return -1;
+
+        // Byte by byte, since the match may overlap what it is copying
+        const uint8_t* match = op - offset;
+        for (int i = 0; i < matchLength; ++i)
+            op[i] = match[i];
+        op += matchLength;
+    }
+
+    return ( int) (op - dst);
+}
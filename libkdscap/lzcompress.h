@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+
+// Fast LZ77 compression in the LZ4 block format, cheap enough to run on
+// every captured frame while recording
+
+#define LZ_COMPRESS_BOUND(size) ((size) + (size) / 255 + 16)
+
+int lzCompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity);
+int lzDecompress(const uint8_t* src, int srcSize, uint8_t* dst, int dstCapacity);
@@ -0,0 +1,63 @@
+#include <cstdio>
+#include "metrics.h"
+
+// Upper bounds in seconds, doubling from half a millisecond
+static const double bucketBounds[METRIC_HISTOGRAM_BUCKETS] = {
+    0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.032, 0.064, 0.128, 0.256, 0.512, 1.024
+};
+
+void MetricHistogram::record(double ms)
+{
+    double seconds = ms / 1000.0;
+    int bucket = 0;
+    while (bucket < METRIC_HISTOGRAM_BUCKETS && seconds > bucketBounds[bucket])
+        ++bucket;
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(ms > 0.0 ? ( uint64_t) (ms * 1000.0) : 0, std::memory_order_relaxed);
+}
+
+// Buckets are cumulative in the output, as Prometheus expects. A scrape racing
+// record() may see a count one off from the buckets, which is harmless.
+void MetricHistogram::write(std::string& out, const char* name, const char* labels) const
+{
+    char line[256];
+    const char* separator = labels ? "," : "";
+    labels = labels ? labels : "";
+    uint64_t cumulative = 0;
+    for (int i = 0; i <= METRIC_HISTOGRAM_BUCKETS; ++i)
+    {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        if (i < METRIC_HISTOGRAM_BUCKETS)
+            snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, bucketBounds[i], ( unsigned long long) cumulative);
+        else
+            snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, ( unsigned long long) cumulative);
+        out += line;
+    }
+
+    const char* open = *labels ? "{" : "";
+    const char* close = *labels ? "}" : "";
+    snprintf(line, sizeof(line), "%s_sum%s%s%s %.6f\n%s_count%s%s%s %llu\n",
+             name, open, labels, close, sumUs.load(std::memory_order_relaxed) / 1000000.0,
+             name, open, labels, close, ( unsigned long long) count.load(std::memory_order_relaxed));
+    out += line;
+}
+
+void writeMetricHeader(std::string& out, const char* type, const char* name, const char* help)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    out += line;
+}
+
+// labels is e.g. encoder="live", without braces
+void writeMetricSample(std::string& out, const char* name, double value, const char* labels)
+{
+    char line[256];
+    if (labels)
+        snprintf(line, sizeof(line), "%s{%s} %.17g\n", name, labels, value);
+    else
+        snprintf(line, sizeof(line), "%s %.17g\n", name, value);
+    out += line;
+}
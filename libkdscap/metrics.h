@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#define METRIC_HISTOGRAM_BUCKETS 12
+
+// Durations bucketed for a Prometheus histogram. record() only does relaxed
+// atomic adds, so it can be called from capture and encode threads without
+// locking or allocating; write() is for whoever is scraping.
+class MetricHistogram
+{
+public:
+    void record(double ms);
+    void write(std::string& out, const char* name, const char* labels = NULL) const;
+
+private:
+    std::atomic<uint64_t> buckets[METRIC_HISTOGRAM_BUCKETS + 1] = {}; // The last is +Inf
+    std::atomic<uint64_t> count = {0};
+    std::atomic<uint64_t> sumUs = {0};
+};
+
+// Text exposition helpers. A metric with several labelled samples gets one header.
+void writeMetricHeader(std::string& out, const char* type, const char* name, const char* help);
+void writeMetricSample(std::string& out, const char* name, double value, const char* labels = NULL);
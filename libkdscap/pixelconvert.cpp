@@ -0,0 +1,147 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <tmmintrin.h>
+#include <cstring>
+#include "pixelconvert.h"
+
+// Lets GCC and Clang build a function with SSSE3 without letting the
+// compiler use it anywhere else; MSVC accepts the intrinsics as they are
+#ifdef _MSC_VER
+#define TARGET_SSSE3
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+static bool hasSSSE3()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        supported = (info[2] & (1 << 9)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 9)) != 0;
+#endif
+    }
+    return supported != 0;
+}
+
+// Expands 5 and 6 bit channels to 8 bits by replicating the top bits into the bottom
+static inline void convertPixel(uint16_t pixel, uint8_t* dst)
+{
+    uint8_t r = pixel >> 11;
+    uint8_t g = (pixel >> 5) & 0x3f;
+    uint8_t b = pixel & 0x1f;
+    dst[0] = (r << 3) | (r >> 2);
+    dst[1] = (g << 2) | (g >> 4);
+    dst[2] = (b << 3) | (b >> 2);
+}
+
+// Converts 8 pixels per iteration. Each store writes 4 bytes past the 24 it
+// owns, so the last block is left to the scalar loop.
+// Returns the number of pixels converted.
+TARGET_SSSE3 static int convertBlocksSSSE3(const uint16_t* src, uint8_t* dst, int pixels)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i packRGB = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 16 <= pixels; i += 8)
+    {
+        __m128i p = _mm_loadu_si128(( const __m128i*) (src + i));
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        __m128i b = _mm_and_si128(p, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        // R G in each 16 bit lane, then interleave with B to get R G B 0 per pixel
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i lo = _mm_shuffle_epi8(_mm_unpacklo_epi16(rg, b), packRGB);
+        __m128i hi = _mm_shuffle_epi8(_mm_unpackhi_epi16(rg, b), packRGB);
+
+        _mm_storeu_si128(( __m128i*) (dst + i * 3), lo);
+        _mm_storeu_si128(( __m128i*) (dst + i * 3 + 12), hi);
+    }
+    return i;
+}
+
+void convertRGB565ToRGB24(const uint16_t* src, uint8_t* dst, int pixels)
+{
+    int i = hasSSSE3() ? convertBlocksSSSE3(src, dst, pixels) : 0;
+    for (; i < pixels; ++i)
+    {
+        convertPixel(src[i], dst + i * 3);
+    }
+}
+
+// Sum of absolute differences between two RGB565 images, taken byte by byte.
+// Zero only when they are identical, and grows with how much changed; it is a
+// measure of change, not of colour distance. SSE2 is on every CPU this builds for.
+uint64_t sumAbsDifference(const uint16_t* a, const uint16_t* b, int pixels)
+{
+    int i = 0;
+    __m128i sum0 = _mm_setzero_si128();
+    __m128i sum1 = _mm_setzero_si128();
+
+    // Two independent sums so consecutive SADs don't wait on each other
+    for (; i + 16 <= pixels; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128(( const __m128i*) (a + i));
+        __m128i b0 = _mm_loadu_si128(( const __m128i*) (b + i));
+        __m128i a1 = _mm_loadu_si128(( const __m128i*) (a + i + 8));
+        __m128i b1 = _mm_loadu_si128(( const __m128i*) (b + i + 8));
+        sum0 = _mm_add_epi64(sum0, _mm_sad_epu8(a0, b0));
+        sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(a1, b1));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128(( __m128i*) lanes, _mm_add_epi64(sum0, sum1));
+    uint64_t total = lanes[0] + lanes[1];
+
+    const uint8_t* aBytes = ( const uint8_t*) a;
+    const uint8_t* bBytes = ( const uint8_t*) b;
+    for (int byte = i * 2; byte < pixels * 2; ++byte)
+    {
+        total += aBytes[byte] > bBytes[byte] ? aBytes[byte] - bBytes[byte] : bBytes[byte] - aBytes[byte];
+    }
+    return total;
+}
+
+// Nearest neighbour integer upscale of one 8 bit plane, so pixel art stays
+// sharp. Each row is widened once, then copied for the rows below it.
+void upscalePlane(const uint8_t* src, int srcStride, int width, int height, uint8_t* dst, int dstStride, int scale)
+{
+    for (int y = 0; y < height; ++y, src += srcStride)
+    {
+        uint8_t* row = dst + y * scale * dstStride;
+        int x = 0;
+        if (scale == 2)
+        {
+            // Doubling each byte is an unpack with itself
+            for (; x + 16 <= width; x += 16)
+            {
+                __m128i p = _mm_loadu_si128(( const __m128i*) (src + x));
+                _mm_storeu_si128(( __m128i*) (row + x * 2), _mm_unpacklo_epi8(p, p));
+                _mm_storeu_si128(( __m128i*) (row + x * 2 + 16), _mm_unpackhi_epi8(p, p));
+            }
+        }
+        for (; x < width; ++x)
+        {
+            memset(row + x * scale, src[x], scale);
+        }
+
+        for (int i = 1; i < scale; ++i)
+        {
+            memcpy(row + i * dstStride, row, width * scale);
+        }
+    }
+}
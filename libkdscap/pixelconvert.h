@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+void convertRGB565ToRGB24(const uint16_t* src, uint8_t* dst, int pixels);
+uint64_t sumAbsDifference(const uint16_t* a, const uint16_t* b, int pixels);
+void upscalePlane(const uint8_t* src, int srcStride, int width, int height, uint8_t* dst, int dstStride, int scale);
@@ -0,0 +1,118 @@
+#include <cstring>
+#include <stdexcept>
+#include "lzcompress.h"
+#include "rawfile.h"
+
+RawFileReader::RawFileReader(const char* path)
+{
+    if (fopen_s(&file, path, "rb") != 0)
+    {
+        printf("Could not open raw recording %s\n", path);
+        throw std::runtime_error("Could not open raw recording");
+    }
+
+    legacy = fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, RAW_MAGIC, sizeof(header.magic)) != 0;
+    if (legacy)
+    {
+        memset(&header, 0, sizeof(header));
+        rewind(file);
+        return;
+    }
+
+    if (header.version != RAW_VERSION || header.frameSize != DS_FRAME_SIZE || header.infoSize != DS_INFO_SIZE)
+    {
+        fclose(file);
+        printf("Unsupported raw recording version %u\n", header.version);
+        throw std::runtime_error("Unsupported raw recording");
+    }
+    compressed.resize(LZ_COMPRESS_BOUND(DS_FRAME_SIZE));
+}
+
+RawFileReader::~RawFileReader()
+{
+    fclose(file);
+}
+
+// Reads the next frame into payload, which must hold DS_FRAME_SIZE bytes.
+// Returns the number of payload bytes the device sent, or -1 at the end of the file.
+int RawFileReader::readFrame(uint8_t* payload, uint8_t* frameInfo, uint64_t* captureTime)
+{
+    if (legacy)
+    {
+        if (fread(payload, 1, DS_FRAME_SIZE, file) != DS_FRAME_SIZE)
+            return -1;
+        if (fread(frameInfo, 1, DS_INFO_SIZE, file) != DS_INFO_SIZE)
+            return -1;
+        if (captureTime)
+            *captureTime = 0;
+        return expectedPayloadBytes(frameInfo);
+    }
+
+    RawFrameHeader frame;
+    if (fread(&frame, sizeof(frame), 1, file) != 1)
+        return -1;
+    if (frame.payloadBytes > DS_FRAME_SIZE || frame.storedBytes > compressed.size())
+        return -1;
+    if (fread(frameInfo, 1, DS_INFO_SIZE, file) != DS_INFO_SIZE)
+        return -1;
+
+    if (frame.flags & RAW_FRAME_COMPRESSED)
+    {
+        if (fread(&compressed[0], 1, frame.storedBytes, file) != frame.storedBytes)
+            return -1;
+        if (lzDecompress(&compressed[0], frame.storedBytes, payload, DS_FRAME_SIZE) != ( int) frame.payloadBytes)
+            return -1;
+    }
+    else
+    {
+        if (fread(payload, 1, frame.storedBytes, file) != frame.storedBytes)
+            return -1;
+    }
+
+    if (captureTime)
+        *captureTime = frame.captureTime;
+    return frame.payloadBytes;
+}
+
+// Finds where every frame starts, for seeking to it later.
+// Leaves the reader at the end of the file.
+bool RawFileReader::indexFrames(std::vector<int64_t>* offsets)
+{
+    offsets->clear();
+    if (legacy)
+    {
+        _fseeki64(file, 0, SEEK_END);
+        int64_t frames = _ftelli64(file) / (DS_FRAME_SIZE + DS_INFO_SIZE);
+        for (int64_t i = 0; i < frames; ++i)
+            offsets->push_back(i * (DS_FRAME_SIZE + DS_INFO_SIZE));
+        return true;
+    }
+
+    _fseeki64(file, 0, SEEK_END);
+    int64_t fileSize = _ftelli64(file);
+
+    // A recording that was cut off ends at the last whole frame
+    int64_t offset = sizeof(RawFileHeader);
+    while (true)
+    {
+        RawFrameHeader frame;
+        if (_fseeki64(file, offset, SEEK_SET) != 0 || fread(&frame, sizeof(frame), 1, file) != 1)
+            return true;
+
+        int64_t next = offset + sizeof(frame) + DS_INFO_SIZE + frame.storedBytes;
+        if (next > fileSize)
+            return true;
+        offsets->push_back(offset);
+        offset = next;
+    }
+}
+
+bool RawFileReader::seek(int64_t offset)
+{
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+}
+
+bool RawFileReader::seekToFirstFrame()
+{
+    return seek(legacy ? 0 : sizeof(header));
+}
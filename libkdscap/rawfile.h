@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+#include "dsframe.h"
+
+// Raw recordings: the undecoded bulk payloads and frame info exactly as the
+// device sent them, so recording costs next to nothing and frames are
+// decoded and encoded later.
+//
+// The file is a RawFileHeader followed by one record per frame: a
+// RawFrameHeader, DS_INFO_SIZE bytes of frame info, then storedBytes of
+// payload, LZ compressed if RAW_FRAME_COMPRESSED is set.
+//
+// Older recordings without a header, DS_FRAME_SIZE payloads each followed
+// by DS_INFO_SIZE frame info, can still be read.
+
+#define RAW_MAGIC "KDSRAW\r\n"
+#define RAW_VERSION 1
+
+#define RAW_FRAME_COMPRESSED 1
+
+struct RawFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t frameSize;  // DS_FRAME_SIZE
+    uint32_t infoSize;   // DS_INFO_SIZE
+    uint32_t reserved;
+    uint64_t timestampFrequency; // Ticks per second of captureTime
+};
+
+struct RawFrameHeader
+{
+    uint32_t payloadBytes; // As received from the device
+    uint32_t storedBytes;  // As written to the file
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t captureTime;
+};
+
+// Reads the frames of a raw recording in order
+class RawFileReader
+{
+public:
+    RawFileReader(const char* path);
+    ~RawFileReader();
+
+    int readFrame(uint8_t* payload, uint8_t* frameInfo, uint64_t* captureTime = NULL);
+    bool indexFrames(std::vector<int64_t>* offsets);
+    bool seek(int64_t offset);
+    bool seekToFirstFrame();
+    uint64_t timestampFrequency() { return header.timestampFrequency; }
+
+private:
+    FILE* file;
+    bool legacy;
+    RawFileHeader header;
+    std::vector<uint8_t> compressed;
+};
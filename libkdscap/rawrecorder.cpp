@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <SDL_timer.h>
+#include "lzcompress.h"
+#include "rawrecorder.h"
+#include "threadpolicy.h"
+
+RawRecorder::RawRecorder(const char* path, bool compress) :
+    compress(compress),
+    head(0),
+    count(0),
+    stopping(false),
+    closed(false),
+    blockUsed(0),
+    fileBytes(0),
+    framesWritten(0),
+    payloadBytesWritten(0),
+    framesDropped(0),
+    writeFailed(false),
+    writeError(0)
+{
+    // Unbuffered, so recording doesn't fill the file cache and evict everything else
+    file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        printf("Could not create raw recording %s: %d\n", path, GetLastError());
+        throw std::runtime_error("Could not create raw recording");
+    }
+
+    // Unbuffered writes must be whole sectors from sector aligned memory
+    sectorSize = RAW_SECTOR_SIZE;
+    FILE_STORAGE_INFO storage;
+    if (GetFileInformationByHandleEx(file, FileStorageInfo, &storage, sizeof(storage)))
+    {
+        sectorSize = std::max<int>(sectorSize, storage.LogicalBytesPerSector);
+        sectorSize = std::max<int>(sectorSize, storage.PhysicalBytesPerSectorForPerformance);
+    }
+    if (RAW_WRITE_BLOCK % sectorSize != 0)
+    {
+        printf("Unsupported sector size for raw recording: %d\n", sectorSize);
+        CloseHandle(file);
+        throw std::runtime_error("Unsupported sector size for raw recording");
+    }
+
+    // Queue slots hold a frame header, its info and the payload, in file order
+    slotSize = FrameSlab::align(sizeof(RawFrameHeader) + DS_INFO_SIZE + DS_FRAME_SIZE);
+    size_t queueBytes = slotSize * RAW_QUEUE_FRAMES;
+    size_t compressedBytes = FrameSlab::align(LZ_COMPRESS_BOUND(DS_FRAME_SIZE));
+    memory = new FrameSlab(queueBytes + compressedBytes);
+    queue = memory->data();
+    compressed = queue + queueBytes;
+    blockMemory = new FrameSlab(RAW_WRITE_BLOCK);
+    block = blockMemory->data();
+
+    RawFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RAW_MAGIC, sizeof(header.magic));
+    header.version = RAW_VERSION;
+    header.frameSize = DS_FRAME_SIZE;
+    header.infoSize = DS_INFO_SIZE;
+    header.timestampFrequency = SDL_GetPerformanceFrequency();
+    append(&header, sizeof(header));
+
+    writer = std::thread(&RawRecorder::runWriter, this);
+    printf("Recording raw frames to %s\n", path);
+}
+
+RawRecorder::~RawRecorder()
+{
+    stop();
+    delete memory;
+    delete blockMemory;
+}
+
+// Writes out every queued frame and closes the file. No more frames may be
+// written once the recording is stopped.
+void RawRecorder::stop()
+{
+    if (closed)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_one();
+    writer.join();
+
+    // The last write is padded to a whole sector, then the file is cut back to size
+    if (!writeFailed)
+    {
+        int padded = (blockUsed + sectorSize - 1) / sectorSize * sectorSize;
+        memset(block + blockUsed, 0, padded - blockUsed);
+        writeBlock(padded);
+    }
+    if (writeFailed)
+    {
+        printf("Raw recording stopped after a write failed: %d\n", writeError);
+    }
+
+    LARGE_INTEGER size;
+    size.QuadPart = fileBytes;
+    SetFilePointerEx(file, size, NULL, FILE_BEGIN);
+    SetEndOfFile(file);
+    CloseHandle(file);
+    closed = true;
+}
+
+// Called on the capture thread. Never waits for the disk.
+void RawRecorder::writeFrame(const uint8_t* payload, int payloadBytes, const uint8_t* frameInfo, uint64_t captureTime)
+{
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == RAW_QUEUE_FRAMES || writeFailed)
+        {
+            ++framesDropped;
+            return;
+        }
+        slot = (head + count) % RAW_QUEUE_FRAMES;
+    }
+
+    // Only the capture thread fills slots, so the copy can be made unlocked
+    uint8_t* p = queue + slot * slotSize;
+    RawFrameHeader* header = ( RawFrameHeader*) p;
+    header->payloadBytes = payloadBytes;
+    header->storedBytes = payloadBytes;
+    header->flags = 0;
+    header->reserved = 0;
+    header->captureTime = captureTime;
+    memcpy(p + sizeof(RawFrameHeader), frameInfo, DS_INFO_SIZE);
+    memcpy(p + sizeof(RawFrameHeader) + DS_INFO_SIZE, payload, payloadBytes);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++count;
+    }
+    condition.notify_one();
+}
+
+void RawRecorder::report()
+{
+    printf("Raw recording: %llu frames, %.1f MB", ( unsigned long long) framesWritten, fileBytes / (1024.0 * 1024.0));
+    if (compress && payloadBytesWritten > 0)
+    {
+        printf(" (%.0f%% of the payload size)", 100.0 * fileBytes / payloadBytesWritten);
+    }
+    printf(", %llu frames dropped", ( unsigned long long) framesDropped);
+    if (writeFailed)
+    {
+        printf(", stopped when a write failed (%d)", writeError);
+    }
+    printf("\n");
+}
+
+void RawRecorder::runWriter()
+{
+    configureThread(ThreadWorker, "raw writer");
+
+    while (true)
+    {
+        uint8_t* p;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || count > 0 || writeFailed; });
+            if (writeFailed)
+            {
+                // Nothing more can be written; what's still queued is lost
+                framesDropped += count;
+                count = 0;
+                break;
+            }
+            if (count == 0)
+                break; // Stopping, and everything has been written
+            p = queue + head * slotSize;
+        }
+
+        RawFrameHeader* header = ( RawFrameHeader*) p;
+        const uint8_t* payload = p + sizeof(RawFrameHeader) + DS_INFO_SIZE;
+        payloadBytesWritten += header->payloadBytes;
+
+        int compressedBytes = -1;
+        if (compress)
+        {
+            compressedBytes = lzCompress(payload, header->payloadBytes, compressed, LZ_COMPRESS_BOUND(DS_FRAME_SIZE));
+        }
+
+        if (compressedBytes > 0 && compressedBytes < ( int) header->payloadBytes)
+        {
+            header->storedBytes = compressedBytes;
+            header->flags |= RAW_FRAME_COMPRESSED;
+            append(p, sizeof(RawFrameHeader) + DS_INFO_SIZE);
+            append(compressed, compressedBytes);
+        }
+        else
+        {
+            append(p, sizeof(RawFrameHeader) + DS_INFO_SIZE + header->payloadBytes);
+        }
+        ++framesWritten;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % RAW_QUEUE_FRAMES;
+            --count;
+        }
+    }
+}
+
+// Adds to the file, writing out every block that fills up
+void RawRecorder::append(const void* data, int bytes)
+{
+    const uint8_t* src = ( const uint8_t*) data;
+    while (bytes > 0 && !writeFailed)
+    {
+        int copy = RAW_WRITE_BLOCK - blockUsed;
+        if (copy > bytes)
+            copy = bytes;
+
+        memcpy(block + blockUsed, src, copy);
+        blockUsed += copy;
+        fileBytes += copy;
+        src += copy;
+        bytes -= copy;
+
+        if (blockUsed == RAW_WRITE_BLOCK)
+        {
+            writeBlock(RAW_WRITE_BLOCK);
+            blockUsed = 0;
+        }
+    }
+}
+
+void RawRecorder::writeBlock(int bytes)
+{
+    DWORD written;
+    if (bytes > 0 && (!WriteFile(file, block, bytes, &written, NULL) || ( int) written != bytes))
+    {
+        writeError = GetLastError();
+        fileBytes -= blockUsed; // The file ends with the last block that was written
+        writeFailed = true;
+        printf("Raw recording write failed: %d\n", writeError);
+    }
+}
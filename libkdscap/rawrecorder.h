@@ -0,0 +1,65 @@
+#pragma once
+#include <Windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "framememory.h"
+#include "rawfile.h"
+
+#define RAW_QUEUE_FRAMES 240             // Four seconds of frames waiting to be written
+#define RAW_WRITE_BLOCK (4 * 1024 * 1024) // Size of each unbuffered write
+#define RAW_SECTOR_SIZE 4096             // Unbuffered writes are multiples of the sector size, at least this
+
+// Streams undecoded frames straight from the capture thread to a raw
+// recording (see rawfile.h). The capture thread only copies the frame into a
+// queue; compression and writing happen on the recorder's own thread with
+// large unbuffered sequential writes. Frames are dropped, never waited for,
+// if the disk falls behind. A failed write ends the recording; every frame
+// after it is counted as dropped.
+class RawRecorder
+{
+public:
+    RawRecorder(const char* path, bool compress);
+    ~RawRecorder();
+
+    void stop();
+    void writeFrame(const uint8_t* payload, int payloadBytes, const uint8_t* frameInfo, uint64_t captureTime);
+    void report();
+
+    uint64_t bytesWritten() { return fileBytes; }
+    uint64_t droppedFrames() { return framesDropped; }
+    bool failed() { return writeFailed; }
+
+private:
+    HANDLE file;
+    bool compress;
+
+    FrameSlab* memory;
+    FrameSlab* blockMemory; // Separate, so the block starts on a page as unbuffered writes need
+    uint8_t* queue;
+    size_t slotSize;
+    int head;
+    int count;
+    bool stopping;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread writer;
+
+    uint8_t* block;
+    int blockUsed;
+    int sectorSize;
+    uint8_t* compressed;
+
+    std::atomic<uint64_t> fileBytes;
+    uint64_t framesWritten;
+    uint64_t payloadBytesWritten;
+    std::atomic<uint64_t> framesDropped;
+    std::atomic_bool writeFailed;
+    DWORD writeError;
+
+    void runWriter();
+    void append(const void* data, int bytes);
+    void writeBlock(int bytes);
+};
@@ -0,0 +1,121 @@
+#include <cstring>
+#include "syntheticsource.h"
+
+static const char* sceneNames[NUM_SYNTHETIC_SCENES] = {
+    "static",
+    "scrolling",
+    "fullmotion",
+    "partial"
+};
+
+static inline uint16_t rgb565(int r, int g, int b)
+{
+    return (uint16_t) (((r & 0x1f) << 11) | ((g & 0x3f) << 5) | (b & 0x1f));
+}
+
+SyntheticSource::SyntheticSource(synthetic_scene scene) :
+    scene(scene),
+    frameCount(0)
+{
+}
+
+const char* SyntheticSource::sceneName(synthetic_scene scene)
+{
+    return sceneNames[scene];
+}
+
+bool SyntheticSource::parseScene(const char* name, synthetic_scene* scene)
+{
+    for (int i = 0; i < NUM_SYNTHETIC_SCENES; ++i)
+    {
+        if (strcmp(name, sceneNames[i]) == 0)
+        {
+            *scene = static_cast<synthetic_scene>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void SyntheticSource::render()
+{
+    for (int s = 0; s < 2; ++s)
+    {
+        uint16_t* screen = screens[s];
+        for (int y = 0; y < DS_LCD_HEIGHT; ++y)
+        {
+            for (int x = 0; x < DS_LCD_WIDTH; ++x)
+            {
+                uint16_t pixel;
+                switch (scene)
+                {
+                    case SceneStaticMenu:
+                        // Flat menu panels with a few text-like rows
+                        pixel = (y / 24) % 2 ? rgb565(4, 8, 12) : rgb565(28, 56, 30);
+                        if (y % 24 >= 8 && y % 24 < 16 && x > 32 && x < 224 && (x / 6 + y) % 3 == 0)
+                            pixel = rgb565(0, 0, 0);
+                        break;
+                    case SceneScrolling:
+                    {
+                        int ty = (y + frameCount) % 256;
+                        pixel = rgb565((x / 8 + ty / 8) & 0x1f, (ty * 2 + s * 20) & 0x3f, (x / 4) & 0x1f);
+                        break;
+                    }
+                    case SceneFullMotion:
+                    {
+                        unsigned int h = (x * 73856093u) ^ (y * 19349663u) ^ ((frameCount + s) * 83492791u);
+                        pixel = (uint16_t) (h ^ (h >> 16));
+                        break;
+                    }
+                    case ScenePartialUpdate:
+                    default:
+                    {
+                        pixel = rgb565(6, 20 + (y / 48) * 8, 10);
+                        int spriteX = (frameCount * 3) % (DS_LCD_WIDTH - 32);
+                        int spriteY = 80 + s * 16;
+                        if (x >= spriteX && x < spriteX + 32 && y >= spriteY && y < spriteY + 32)
+                            pixel = rgb565(x - spriteX, (y - spriteY) * 2, 31);
+                        break;
+                    }
+                }
+                screen[y * DS_LCD_WIDTH + x] = pixel;
+            }
+        }
+    }
+}
+
+// Writes the next frame's payload and frame info.
+// Returns the number of payload bytes used; half-lines that repeat the one
+// above on both screens are left out, as the device does.
+int SyntheticSource::generate(uint8_t* payload, uint8_t* frameInfo)
+{
+    render();
+    ++frameCount;
+
+    memset(frameInfo, 0, DS_INFO_SIZE);
+    frameInfo[52] = 1;
+
+    uint16_t* dst = ( uint16_t*) payload;
+    const int halfWidth = DS_LCD_WIDTH / 2;
+    for (int line = 0; line < DS_LCD_HEIGHT * 2; ++line)
+    {
+        const uint16_t* top = screens[0] + line * halfWidth;
+        const uint16_t* bottom = screens[1] + line * halfWidth;
+
+        bool repeated = line >= 2 &&
+                        memcmp(top, top - DS_LCD_WIDTH, halfWidth * sizeof(uint16_t)) == 0 &&
+                        memcmp(bottom, bottom - DS_LCD_WIDTH, halfWidth * sizeof(uint16_t)) == 0;
+        if (repeated)
+            continue;
+
+        frameInfo[line >> 3] |= 1 << (line & 7);
+        for (int i = 0; i < halfWidth; ++i)
+        {
+            dst[0] = bottom[i];
+            dst[1] = top[i];
+            dst += 2;
+        }
+    }
+
+    return ( int) (( uint8_t*) dst - payload);
+}
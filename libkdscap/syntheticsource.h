@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include "dsframe.h"
+
+typedef enum
+{
+    SceneStaticMenu = 0, // Nothing changes, long runs of repeated lines
+    SceneScrolling,      // Background scrolling a pixel a frame
+    SceneFullMotion,     // Every pixel changes every frame
+    ScenePartialUpdate   // Static background with a moving sprite
+} synthetic_scene;
+#define NUM_SYNTHETIC_SCENES 4
+
+// Generates bulk payloads and frame info the way the capture board sends
+// them, for replaying and benchmarking without a device.
+class SyntheticSource
+{
+public:
+    SyntheticSource(synthetic_scene scene);
+
+    int generate(uint8_t* payload, uint8_t* frameInfo);
+
+    static const char* sceneName(synthetic_scene scene);
+    static bool parseScene(const char* name, synthetic_scene* scene);
+
+private:
+    synthetic_scene scene;
+    unsigned int frameCount;
+    uint16_t screens[2][DS_LCD_WIDTH * DS_LCD_HEIGHT];
+
+    void render();
+};
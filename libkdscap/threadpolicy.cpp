@@ -0,0 +1,254 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "threadpolicy.h"
+
+#define WAKE_DELAY_BUCKETS 64 // Quarter powers of two of a microsecond, up to about 55 ms
+
+static const char* roleNames[] = {"capture", "audio", "render", "encoder", "worker"};
+
+#ifndef _WIN32
+// The same levels as Windows, so policies parse alike everywhere. Elsewhere,
+// e.g. in the portable benchmark, only thread names are applied.
+#define THREAD_PRIORITY_IDLE -15
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_BELOW_NORMAL -1
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_ABOVE_NORMAL 1
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_TIME_CRITICAL 15
+#endif
+
+static const struct
+{
+    const char* name;
+    int priority;
+} priorityNames[] = {
+    {"idle", THREAD_PRIORITY_IDLE},
+    {"lowest", THREAD_PRIORITY_LOWEST},
+    {"below", THREAD_PRIORITY_BELOW_NORMAL},
+    {"normal", THREAD_PRIORITY_NORMAL},
+    {"above", THREAD_PRIORITY_ABOVE_NORMAL},
+    {"highest", THREAD_PRIORITY_HIGHEST},
+    {"critical", THREAD_PRIORITY_TIME_CRITICAL},
+};
+
+#ifdef _WIN32
+static const struct
+{
+    const char* name;
+    DWORD priorityClass;
+} processPriorityNames[] = {
+    {"normal", NORMAL_PRIORITY_CLASS},
+    {"above", ABOVE_NORMAL_PRIORITY_CLASS},
+    {"high", HIGH_PRIORITY_CLASS},
+    {"realtime", REALTIME_PRIORITY_CLASS},
+};
+#endif
+
+// How late one named thread has run after it was due. Threads sharing a name
+// share one, so it's only updated with relaxed atomic adds; a report may see
+// the counts one wake apart, which is harmless.
+struct ThreadSchedule
+{
+    std::string name;
+    thread_role role;
+    std::atomic<uint64_t> wakes = {0};
+    std::atomic<uint64_t> totalUs = {0};
+    std::atomic<uint64_t> maxUs = {0};
+    std::atomic<uint64_t> buckets[WAKE_DELAY_BUCKETS] = {};
+};
+
+static ThreadPolicy rolePolicies[NUM_THREAD_ROLES];
+static std::mutex registryMutex;
+static std::vector<ThreadSchedule*> registry;
+static thread_local ThreadSchedule* currentThread = NULL;
+
+// Parses <role>:<priority>[:<cpu mask>], e.g. capture:highest:0x2.
+// A priority of "default" only sets the affinity.
+bool parseThreadPolicy(const char* arg, ThreadPolicy policies[NUM_THREAD_ROLES])
+{
+    const char* priority = strchr(arg, ':');
+    if (!priority)
+        return false;
+    ++priority;
+
+    int role = -1;
+    for (int i = 0; i < NUM_THREAD_ROLES; ++i)
+    {
+        if (strncmp(arg, roleNames[i], priority - 1 - arg) == 0 && strlen(roleNames[i]) == ( size_t) (priority - 1 - arg))
+            role = i;
+    }
+    if (role < 0)
+        return false;
+
+    ThreadPolicy policy;
+    const char* mask = strchr(priority, ':');
+    size_t priorityLength = mask ? mask - priority : strlen(priority);
+    if (priorityLength != strlen("default") || strncmp(priority, "default", priorityLength) != 0)
+    {
+        for (const auto& p : priorityNames)
+        {
+            if (strlen(p.name) == priorityLength && strncmp(priority, p.name, priorityLength) == 0)
+            {
+                policy.setPriority = true;
+                policy.priority = p.priority;
+            }
+        }
+        if (!policy.setPriority)
+            return false;
+    }
+
+    if (mask)
+    {
+        char* end;
+        policy.affinity = strtoull(mask + 1, &end, 0);
+        if (*end != '\0' || policy.affinity == 0)
+            return false;
+    }
+
+    policies[role] = policy;
+    return true;
+}
+
+// Sets the priority class every thread's priority is relative to.
+// realtime needs administrator rights; Windows quietly uses high otherwise.
+bool setProcessPriority(const char* name)
+{
+#ifndef _WIN32
+    printf("Process priority is only set on Windows\n");
+    return false;
+#else
+    for (const auto& p : processPriorityNames)
+    {
+        if (strcmp(name, p.name) == 0)
+        {
+            if (!SetPriorityClass(GetCurrentProcess(), p.priorityClass))
+            {
+                printf("Could not set the process priority to %s\n", name);
+                return false;
+            }
+            return true;
+        }
+    }
+    printf("Unknown process priority: %s\n", name);
+    return false;
+#endif
+}
+
+// Must be called before any threads are started
+void setThreadPolicies(const ThreadPolicy policies[NUM_THREAD_ROLES])
+{
+    for (int i = 0; i < NUM_THREAD_ROLES; ++i)
+    {
+        rolePolicies[i] = policies[i];
+    }
+}
+
+// Names the calling thread, so it shows up in debuggers, Process Explorer and
+// ETW traces, and applies its role's policy. Call at the start of the thread.
+void configureThread(thread_role role, const char* name)
+{
+#ifdef _WIN32
+    std::wstring wideName(name, name + strlen(name));
+    SetThreadDescription(GetCurrentThread(), wideName.c_str());
+
+    const ThreadPolicy& policy = rolePolicies[role];
+    if (policy.setPriority && !SetThreadPriority(GetCurrentThread(), policy.priority))
+    {
+        printf("Could not set the priority of the %s thread\n", name);
+    }
+    if (policy.affinity && !SetThreadAffinityMask(GetCurrentThread(), ( DWORD_PTR) policy.affinity))
+    {
+        printf("Could not set the affinity of the %s thread\n", name);
+    }
+#elif defined(__linux__)
+    // Linux keeps thread names to 15 characters
+    char shortName[16];
+    snprintf(shortName, sizeof(shortName), "%s", name);
+    pthread_setname_np(pthread_self(), shortName);
+#endif
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (ThreadSchedule* schedule : registry)
+    {
+        if (schedule->name == name)
+        {
+            currentThread = schedule;
+            return;
+        }
+    }
+    currentThread = new ThreadSchedule();
+    currentThread->name = name;
+    currentThread->role = role;
+    registry.push_back(currentThread);
+}
+
+// Records how long after it was due the calling thread got to run, e.g. from
+// a frame being queued to its sink waking up. Never allocates or locks.
+void recordWakeDelay(double ms)
+{
+    ThreadSchedule* schedule = currentThread;
+    if (!schedule)
+        return;
+    if (ms < 0.0)
+        ms = 0.0;
+
+    double us = ms * 1000.0;
+    int bucket = us < 1.0 ? 0 : ( int) (log2(us) * 4.0) + 1;
+    if (bucket >= WAKE_DELAY_BUCKETS)
+        bucket = WAKE_DELAY_BUCKETS - 1;
+
+    uint64_t wholeUs = ( uint64_t) us;
+    schedule->wakes.fetch_add(1, std::memory_order_relaxed);
+    schedule->totalUs.fetch_add(wholeUs, std::memory_order_relaxed);
+    uint64_t maxUs = schedule->maxUs.load(std::memory_order_relaxed);
+    while (wholeUs > maxUs && !schedule->maxUs.compare_exchange_weak(maxUs, wholeUs, std::memory_order_relaxed))
+    {
+    }
+    schedule->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Upper bound of the bucket holding the p-th percentile
+static double bucketPercentile(const ThreadSchedule* schedule, uint64_t wakes, double maxMs, double p)
+{
+    uint64_t target = ( uint64_t) ceil(wakes * p / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < WAKE_DELAY_BUCKETS; ++i)
+    {
+        seen += schedule->buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+            return i == WAKE_DELAY_BUCKETS - 1 ? maxMs : pow(2.0, i / 4.0) / 1000.0;
+    }
+    return maxMs;
+}
+
+void reportSchedulingLatency()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    printf("Scheduling latency:\n");
+    for (ThreadSchedule* schedule : registry)
+    {
+        uint64_t wakes = schedule->wakes.load(std::memory_order_relaxed);
+        if (wakes == 0)
+        {
+            printf("  %-16s %-8s not measured\n", schedule->name.c_str(), roleNames[schedule->role]);
+            continue;
+        }
+        double totalMs = schedule->totalUs.load(std::memory_order_relaxed) / 1000.0;
+        double maxMs = schedule->maxUs.load(std::memory_order_relaxed) / 1000.0;
+        printf("  %-16s %-8s %llu wakes, mean %.3f ms, p99 < %.3f ms, max %.3f ms\n", schedule->name.c_str(),
+               roleNames[schedule->role], ( unsigned long long) wakes, totalMs / wakes,
+               bucketPercentile(schedule, wakes, maxMs, 99.0), maxMs);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+typedef enum
+{
+    ThreadCapture = 0, // Reads frames from the device, a replay or a synthetic source
+    ThreadAudio,       // SDL's audio capture callback
+    ThreadRender,      // The main loop and the presenter
+    ThreadEncoder,     // Frame sinks that encode video, and transcoder workers
+    ThreadWorker       // Everything else, e.g. screenshots, the raw writer and live streaming
+} thread_role;
+#define NUM_THREAD_ROLES 5
+
+// Scheduling for every thread with a role. The defaults leave threads as Windows made them.
+struct ThreadPolicy
+{
+    bool setPriority = false;
+    int priority = 0;      // A THREAD_PRIORITY_* level
+    uint64_t affinity = 0; // Mask of the CPUs the threads may run on, 0 for any
+};
+
+bool parseThreadPolicy(const char* arg, ThreadPolicy policies[NUM_THREAD_ROLES]);
+bool setProcessPriority(const char* name);
+void setThreadPolicies(const ThreadPolicy policies[NUM_THREAD_ROLES]);
+
+void configureThread(thread_role role, const char* name);
+void recordWakeDelay(double ms);
+void reportSchedulingLatency();
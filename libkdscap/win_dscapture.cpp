@@ -0,0 +1,658 @@
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <SDL_timer.h>
+#include "threadpolicy.h"
+#include "win_dscapture.h"
+
+typedef struct _UsbDeviceRequest
+{
+    union
+    {
+        BYTE requestType;
+        struct
+        {
+            BYTE recipient : 5;
+            BYTE type : 2;
+            BYTE dataDirection : 1;
+        } bits;
+    };
+} UsbDeviceRequest;
+
+DSCapture::DSCapture()
+{
+    USB_DEVICE_DESCRIPTOR deviceDesc;
+    ULONG lengthReceived;
+
+    replayFile = NULL;
+    rawRecorder = NULL;
+    synthetic = NULL;
+    truncatePercent = 0;
+    ringMemory = NULL;
+    HRESULT hr = openDevice();
+    if (FAILED(hr))
+    {
+        printf("Failed looking for device, HRESULT 0x%x\n", hr);
+        throw std::runtime_error("Could not open device");
+    }
+
+    bool result = WinUsb_GetDescriptor(winusbHandle,
+                                       USB_DEVICE_DESCRIPTOR_TYPE,
+                                       0,
+                                       0,
+                                       ( PBYTE) & deviceDesc,
+                                       sizeof(deviceDesc),
+                                       &lengthReceived);
+    if (result == false || lengthReceived != sizeof(deviceDesc))
+    {
+        printf("Error among LastError %d or lengthReceived %d\n", result == false ? GetLastError() : 0, lengthReceived);
+        closeDevice();
+        throw std::runtime_error("Could not open device");
+    }
+
+    printf("Device found: VID_%04X&PID_%04X\n", deviceDesc.idVendor, deviceDesc.idProduct);
+
+    if (!queryDeviceEndpoints())
+    {
+        printf("Couldn't query device endpoints\n");
+        closeDevice();
+        throw std::runtime_error("Could not query device endpoints");
+    }
+
+    bool rawIO = true;
+    if (!WinUsb_SetPipePolicy(winusbHandle, bulkPipeInId, RAW_IO, sizeof(bool), &rawIO))
+    {
+        printf("Couldn't set pipe policy: %d\n", GetLastError());
+        closeDevice();
+        throw std::runtime_error("Couldn't set pipe policy");
+    }
+}
+
+// Replays a recorded capture instead of reading from the device. The file is a
+// raw recording (see rawfile.h) and is played back once at the DS frame rate.
+DSCapture::DSCapture(const char* replayPath)
+{
+    handlesOpen = false;
+    winusbHandle = INVALID_HANDLE_VALUE;
+    synthetic = NULL;
+    pacedSource = true;
+    truncatePercent = 0;
+    ringMemory = NULL;
+
+    rawRecorder = NULL;
+    replayFile = new RawFileReader(replayPath);
+}
+
+// Generates frames of a synthetic scene instead of reading from the device.
+// An unpaced source produces frames as fast as they are consumed.
+DSCapture::DSCapture(synthetic_scene scene, bool paced)
+{
+    handlesOpen = false;
+    winusbHandle = INVALID_HANDLE_VALUE;
+    replayFile = NULL;
+    rawRecorder = NULL;
+    synthetic = new SyntheticSource(scene);
+    pacedSource = paced;
+    truncatePercent = 0;
+    ringMemory = NULL;
+}
+
+DSCapture::~DSCapture()
+{
+    closeDevice();
+    delete replayFile;
+    delete synthetic;
+    delete ringMemory;
+}
+
+// Copies the oldest captured frame into outputBuffer. Frames that did not
+// fully arrive are patched line by line from the previous frame.
+// Returns false if there was no new frame to grab.
+bool DSCapture::grabFrame(uint16_t* outputBuffer, DSFrameInfo* info)
+{
+    int bufferPos = readPos;
+
+    if (framesInBuffer == 0) return false;
+
+    const uint16_t* payload = frameBuffer + bufferPos * DS_FRAME_SIZE / sizeof(uint16_t);
+    uint8_t* frameInfo = frameInfoBuffer + bufferPos * DS_INFO_SIZE;
+    int recoveredLines = decodeFrame(payload, frameBytesBuffer[bufferPos], frameInfo,
+                                     haveLastFrame ? lastFrame : NULL, outputBuffer);
+    if (recoveredLines < 0)
+    {
+        // Nothing good to patch it from yet
+        ++completeness.lost;
+        --framesInBuffer;
+        readPos = (bufferPos + 1) % DS_BUFFER_SIZE;
+        return false;
+    }
+    else if (recoveredLines == 0)
+    {
+        ++completeness.complete;
+    }
+    else
+    {
+        ++completeness.recovered;
+        completeness.recoveredLines += recoveredLines;
+        int received = DS_LCD_HEIGHT * 2 - recoveredLines;
+        ++completeness.buckets[received * DS_COMPLETENESS_BUCKETS / (DS_LCD_HEIGHT * 2 + 1)];
+    }
+
+    memcpy(lastFrame, outputBuffer, DS_LCD_WIDTH * DS_LCD_HEIGHT * 2 * sizeof(uint16_t));
+    haveLastFrame = true;
+
+    if (info)
+    {
+        info->captureTime = frameTimeBuffer[bufferPos];
+        info->grabTime = SDL_GetPerformanceCounter();
+        memcpy(info->lineMask, frameInfo, DS_LINE_MASK_SIZE);
+        info->recoveredLines = ( uint16_t) recoveredLines;
+    }
+
+    --framesInBuffer;
+    readPos = (bufferPos + 1) % DS_BUFFER_SIZE;
+    return true;
+}
+
+// A replay starts again from its first frame
+void DSCapture::startCapture()
+{
+    if (!ringMemory)
+    {
+        allocateRing();
+    }
+    if (replayFile)
+    {
+        replayFile->seekToFirstFrame();
+    }
+    haveLastFrame = false;
+
+    framesInBuffer = 0;
+    readPos = writePos = 0;
+    doCapture = true;
+    for (int i = 0; i < DS_THREADS; ++i)
+    {
+        captureThreads[i] = std::thread([this]() {
+            captureFrame();
+            signalFrames(); // Wakes anyone waiting for a frame that will never come
+        });
+    }
+}
+
+void DSCapture::endCapture()
+{
+    doCapture = false;
+    for (int i = 0; i < DS_THREADS; ++i)
+    {
+        captureThreads[i].join();
+    }
+}
+
+// Carves the capture ring out of a single slab, kept until the capture is destroyed
+void DSCapture::allocateRing()
+{
+    size_t payloadBytes = FrameSlab::align(DS_FRAME_SIZE * DS_BUFFER_SIZE);
+    size_t infoBytes = FrameSlab::align(DS_INFO_SIZE * DS_BUFFER_SIZE);
+    size_t timeBytes = FrameSlab::align(sizeof(uint64_t) * DS_BUFFER_SIZE);
+    size_t countBytes = FrameSlab::align(sizeof(int) * DS_BUFFER_SIZE);
+    size_t lastFrameBytes = FrameSlab::align(DS_LCD_WIDTH * DS_LCD_HEIGHT * 2 * sizeof(uint16_t));
+    ringMemory = new FrameSlab(payloadBytes + infoBytes + timeBytes + countBytes + lastFrameBytes);
+
+    uint8_t* p = ringMemory->data();
+    frameBuffer = ( uint16_t*) p;
+    p += payloadBytes;
+    frameInfoBuffer = p;
+    p += infoBytes;
+    frameTimeBuffer = ( uint64_t*) p;
+    p += timeBytes;
+    frameBytesBuffer = ( int*) p;
+    p += countBytes;
+    lastFrame = ( uint16_t*) p;
+}
+
+// Waits up to timeoutMs for grabFrame to have a frame.
+// Returns false on timeout, or once capture has stopped and no frames are left.
+bool DSCapture::waitForFrame(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                            [this]() { return framesInBuffer > 0 || !doCapture; });
+    return framesInBuffer > 0;
+}
+
+void DSCapture::signalFrames()
+{
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+    }
+    frameAvailable.notify_all();
+}
+
+// Returns false once a replay has run out of frames or the device was lost.
+bool DSCapture::isCapturing()
+{
+    return doCapture;
+}
+
+// Also streams every undecoded frame to recorder, from the capture thread.
+// Must be called before startCapture.
+void DSCapture::setRawRecorder(RawRecorder* recorder)
+{
+    rawRecorder = recorder;
+}
+
+// Cuts short the given percentage of replayed or synthetic frames at a random
+// point, as a marginal USB connection would, to exercise frame recovery.
+void DSCapture::setSourceTruncation(int percent)
+{
+    truncatePercent = percent;
+    truncateSeed = 1;
+}
+
+void DSCapture::reportCompleteness()
+{
+    uint64_t total = completeness.complete + completeness.recovered + completeness.lost;
+    if (total == 0) return;
+
+    printf("Frames complete: %llu, recovered: %llu, lost: %llu\n",
+           ( unsigned long long) completeness.complete,
+           ( unsigned long long) completeness.recovered,
+           ( unsigned long long) completeness.lost);
+    if (completeness.recovered == 0) return;
+
+    printf("Recovered frames averaged %.1f%% of half-lines received\n",
+           100.0 - 100.0 * completeness.recoveredLines / (completeness.recovered * DS_LCD_HEIGHT * 2));
+    for (int i = 0; i < DS_COMPLETENESS_BUCKETS; ++i)
+    {
+        printf("  %3d-%3d%% received: %llu\n", i * 100 / DS_COMPLETENESS_BUCKETS, (i + 1) * 100 / DS_COMPLETENESS_BUCKETS,
+               ( unsigned long long) completeness.buckets[i]);
+    }
+}
+
+void DSCapture::captureFrame()
+{
+    int& bufferPos = writePos;
+    int failures = 0;
+    const auto replayFrameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / DS_FRAME_RATE));
+    auto nextReplayFrame = std::chrono::steady_clock::now();
+
+    configureThread(ThreadCapture, "capture");
+
+    while (doCapture)
+    {
+        if (framesInBuffer >= DS_BUFFER_SIZE)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (replayFile || synthetic)
+        {
+            if (pacedSource)
+            {
+                // Only a thread that slept was waiting on the scheduler rather than on us
+                if (std::chrono::steady_clock::now() < nextReplayFrame)
+                {
+                    std::this_thread::sleep_until(nextReplayFrame);
+                    recordWakeDelay(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - nextReplayFrame).count());
+                }
+                nextReplayFrame += replayFrameTime;
+            }
+
+            uint64_t requestTime = SDL_GetPerformanceCounter();
+            int bytes = readSourceFrame(( uint8_t*) (frameBuffer + bufferPos * DS_FRAME_SIZE / sizeof(uint16_t)),
+                                        frameInfoBuffer + bufferPos * DS_INFO_SIZE);
+            if (bytes < 0)
+            {
+                doCapture = false;
+                return;
+            }
+            frameTimeBuffer[bufferPos] = SDL_GetPerformanceCounter();
+            frameBytesBuffer[bufferPos] = bytes;
+            recordRawFrame(bufferPos);
+            countFrame(requestTime, bytes);
+
+            ++framesInBuffer;
+            signalFrames();
+            bufferPos = (bufferPos + 1) % DS_BUFFER_SIZE;
+            continue;
+        }
+
+        uint64_t requestTime = SDL_GetPerformanceCounter();
+        uint8_t dummy;
+        if (!sendToDefaultEndpoint(DS_CMDOUT_CAPTURE_START, 0, 0, &dummy))
+        {
+            if (!readFailed(failures))
+                return;
+            continue;
+        }
+
+        ULONG transferred;
+        bool result;
+        int bytesIn = 0;
+        uint8_t* p = ( uint8_t*) (frameBuffer + bufferPos * DS_FRAME_SIZE / sizeof(uint16_t));
+        do
+        {
+            result = readFromBulk(p, DS_FRAME_SIZE - bytesIn, &transferred);
+            if (result)
+            {
+                bytesIn += transferred;
+                p += transferred;
+            }
+        } while (bytesIn < DS_FRAME_SIZE && result && transferred > 0);
+        frameTimeBuffer[bufferPos] = SDL_GetPerformanceCounter();
+        frameBytesBuffer[bufferPos] = bytesIn;
+
+        uint8_t* frameInfo = frameInfoBuffer + bufferPos * DS_INFO_SIZE;
+
+        // A short read still yields a frame as long as its info arrives; the
+        // missing lines are recovered in grabFrame
+        if (!recvFromDefaultEndpoint(DS_CMDIN_FRAMEINFO, DS_INFO_SIZE, frameInfo))
+        {
+            if (!readFailed(failures))
+                return;
+            continue;
+        }
+        if (result)
+            failures = 0;
+        recordRawFrame(bufferPos);
+        countFrame(requestTime, bytesIn);
+
+        ++framesInBuffer;
+        signalFrames();
+        if (framesInBuffer > 1)
+            printf("Frames in buffer: %d\n", (int) framesInBuffer);
+        bufferPos = (bufferPos + 1) % DS_BUFFER_SIZE;
+    }
+}
+
+void DSCapture::recordRawFrame(int bufferPos)
+{
+    if (rawRecorder)
+    {
+        rawRecorder->writeFrame(( const uint8_t*) (frameBuffer + bufferPos * DS_FRAME_SIZE / sizeof(uint16_t)),
+                                frameBytesBuffer[bufferPos], frameInfoBuffer + bufferPos * DS_INFO_SIZE,
+                                frameTimeBuffer[bufferPos]);
+    }
+}
+
+void DSCapture::countFrame(uint64_t requestTime, int bytes)
+{
+    captureMetrics.transferTime.record((SDL_GetPerformanceCounter() - requestTime) * 1000.0 / SDL_GetPerformanceFrequency());
+    captureMetrics.bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    captureMetrics.frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Counts a frame lost to a failed transfer.
+// Returns false once the device has failed too many times in a row to keep trying.
+bool DSCapture::readFailed(int& failures)
+{
+    ++completeness.lost;
+    if (++failures < DS_MAX_READ_FAILURES)
+        return true;
+
+    printf("Capture device stopped responding, %d frames in a row failed\n", failures);
+    doCapture = false;
+    return false;
+}
+
+// Reads the next frame from a replay or synthetic source.
+// Returns the number of payload bytes, or -1 when a replay runs out.
+int DSCapture::readSourceFrame(uint8_t* frame, uint8_t* frameInfo)
+{
+    int bytes;
+    if (synthetic)
+    {
+        bytes = synthetic->generate(frame, frameInfo);
+    }
+    else
+    {
+        bytes = replayFile->readFrame(frame, frameInfo);
+        if (bytes < 0)
+            return -1;
+    }
+
+    if (truncatePercent > 0)
+    {
+        truncateSeed = truncateSeed * 1103515245 + 12345;
+        if ((int) ((truncateSeed >> 16) % 100) < truncatePercent)
+        {
+            truncateSeed = truncateSeed * 1103515245 + 12345;
+            bytes = (int) ((truncateSeed >> 8) % (bytes + 1));
+        }
+    }
+    return bytes;
+}
+
+HRESULT DSCapture::openDevice()
+{
+    HRESULT hr = S_OK;
+
+    handlesOpen = false;
+    hr = retrieveDevicePath(devicePath, sizeof(devicePath));
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    deviceHandle = CreateFile(devicePath,
+                              GENERIC_WRITE | GENERIC_READ,
+                              FILE_SHARE_WRITE | FILE_SHARE_READ,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+                              NULL);
+
+    if (deviceHandle == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        return hr;
+    }
+
+    bool initialized = WinUsb_Initialize(deviceHandle, &winusbHandle);
+    if (initialized == false)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(deviceHandle);
+        return hr;
+    }
+
+    handlesOpen = true;
+    return hr;
+}
+
+void DSCapture::closeDevice()
+{
+    if (!handlesOpen)
+    {
+        return;
+    }
+
+    WinUsb_Free(winusbHandle);
+    CloseHandle(deviceHandle);
+    handlesOpen = false;
+}
+
+HRESULT DSCapture::retrieveDevicePath(char* path, ULONG bufLen)
+{
+    CONFIGRET cr = CR_SUCCESS;
+    HRESULT hr = S_OK;
+    PTSTR deviceInterfaceList = NULL;
+    ULONG deviceInterfaceListLength = 0;
+
+    do
+    {
+        cr = CM_Get_Device_Interface_List_Size(&deviceInterfaceListLength,
+                                               (LPGUID) &GUID_DSCapture,
+                                               NULL,
+                                               CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+
+        if (cr != CR_SUCCESS)
+        {
+            hr = HRESULT_FROM_WIN32(CM_MapCrToWin32Err(cr, ERROR_INVALID_DATA));
+            break;
+        }
+
+        deviceInterfaceList = (PTSTR)HeapAlloc(GetProcessHeap(),
+                                               HEAP_ZERO_MEMORY,
+                                               deviceInterfaceListLength * sizeof(TCHAR));
+
+        if (deviceInterfaceList == NULL)
+        {
+            hr = E_OUTOFMEMORY;
+            break;
+        }
+
+        cr = CM_Get_Device_Interface_List((LPGUID) &GUID_DSCapture,
+                                          NULL,
+                                          deviceInterfaceList,
+                                          deviceInterfaceListLength,
+                                          CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+
+        if (cr != CR_SUCCESS)
+        {
+            HeapFree(GetProcessHeap(), 0, deviceInterfaceList);
+
+            if (cr != CR_BUFFER_SMALL)
+            {
+                hr = HRESULT_FROM_WIN32(CM_MapCrToWin32Err(cr, ERROR_INVALID_DATA));
+            }
+        }
+    } while (cr == CR_BUFFER_SMALL);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // If list is empty, no devices were found
+    if (*deviceInterfaceList == TEXT('\0'))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        HeapFree(GetProcessHeap(), 0, deviceInterfaceList);
+        return hr;
+    }
+
+    hr = StringCbCopy(path, bufLen, deviceInterfaceList);
+    HeapFree(GetProcessHeap(), 0, deviceInterfaceList);
+    return hr;
+}
+
+bool DSCapture::queryDeviceEndpoints()
+{
+    if (winusbHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool result = true;
+
+    USB_INTERFACE_DESCRIPTOR interfaceDescriptor;
+    ZeroMemory(&interfaceDescriptor, sizeof(USB_INTERFACE_DESCRIPTOR));
+    WINUSB_PIPE_INFORMATION pipe;
+    ZeroMemory(&pipe, sizeof(WINUSB_PIPE_INFORMATION));
+
+    result = WinUsb_QueryInterfaceSettings(winusbHandle, 0, &interfaceDescriptor);
+    if (result)
+    {
+        for (int i = 0; i < interfaceDescriptor.bNumEndpoints; i++)
+        {
+            result = WinUsb_QueryPipe(winusbHandle, 0, i, &pipe);
+            if (result)
+            {
+                if (pipe.PipeType == UsbdPipeTypeBulk)
+                {
+                    if (USB_ENDPOINT_DIRECTION_IN(pipe.PipeId))
+                    {
+                        printf("Endpoint index: %d - Pipe type: Bulk - Pipe ID: 0x%x - Maximum packet size: %d\n", i, pipe.PipeId, pipe.MaximumPacketSize);
+                        bulkPipeInId = pipe.PipeId;
+                        maxPacketSize = pipe.MaximumPacketSize;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+bool DSCapture::sendToDefaultEndpoint(uint8_t request, uint16_t value, uint16_t length, uint8_t *buf)
+{
+    if (winusbHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool result = true;
+
+    UsbDeviceRequest usbRequest;
+    usbRequest.bits.recipient = 0;
+    usbRequest.bits.type = 2;
+    usbRequest.bits.dataDirection = 0;
+
+    WINUSB_SETUP_PACKET setupPacket;
+    ZeroMemory(&setupPacket, sizeof(WINUSB_SETUP_PACKET));
+    setupPacket.RequestType = usbRequest.requestType;
+    setupPacket.Request = request;
+    setupPacket.Value = value;
+    setupPacket.Index = 0;
+    setupPacket.Length = length;
+
+    unsigned long sent;
+    result = WinUsb_ControlTransfer(winusbHandle, setupPacket, buf, length, &sent, 0);
+    return result;
+}
+
+bool DSCapture::recvFromDefaultEndpoint(uint8_t request, uint16_t length, uint8_t* buf)
+{
+    if (winusbHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool result = true;
+
+    UsbDeviceRequest usbRequest;
+    usbRequest.bits.recipient = 0;
+    usbRequest.bits.type = 2;
+    usbRequest.bits.dataDirection = 1;
+
+    WINUSB_SETUP_PACKET setupPacket;
+    ZeroMemory(&setupPacket, sizeof(WINUSB_SETUP_PACKET));
+    setupPacket.RequestType = usbRequest.requestType;
+    setupPacket.Request = request;
+    setupPacket.Value = 0;
+    setupPacket.Index = 0;
+    setupPacket.Length = length;
+
+    unsigned long sent;
+    result = WinUsb_ControlTransfer(winusbHandle, setupPacket, buf, length, &sent, NULL);
+    return result;
+}
+
+bool DSCapture::readFromBulk(uint8_t* buf, int length, PULONG transferred)
+{
+    if (winusbHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    
+    bool result = true;
+    result = WinUsb_ReadPipe(winusbHandle, bulkPipeInId, buf, length, transferred, NULL);
+    return result;
+}
+
+bool DSCapture::getMaximumTransferSize(unsigned long* mts)
+{
+    unsigned long length = sizeof(unsigned long);
+
+    bool result = WinUsb_GetPipePolicy(winusbHandle, bulkPipeInId, 0x08, &length, mts);
+    if (!result)
+    {
+        printf("Couldn't get maximum transfer size: %d\n", GetLastError());
+    }
+
+    return result;
+}
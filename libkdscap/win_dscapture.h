@@ -0,0 +1,120 @@
+#pragma once
+#include <initguid.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <cstdio>
+#include <Windows.h>
+#include <strsafe.h>
+#include <winusb.h>
+#include <winnt.h>
+#include <cfgmgr32.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "dsframe.h"
+#include "framememory.h"
+#include "metrics.h"
+#include "rawfile.h"
+#include "rawrecorder.h"
+#include "syntheticsource.h"
+
+DEFINE_GUID(GUID_DSCapture,
+            0xa0b880f6,0xd6a5,0x4700,0xa8,0xea,0x22,0x28,0x2a,0xca,0x55,0x87);
+
+#define DS_CMDIN_STATUS 0x31
+#define DS_CMDIN_FRAMEINFO 0x30
+#define DS_CMDOUT_CAPTURE_START 0x30
+#define DS_CMDOUT_CAPTURE_STOP 0x31
+#define DS_BUFFER_SIZE 8
+#define DS_THREADS 1
+#define DS_MAX_READ_FAILURES 60 // Consecutive failed frames before the device is given up on
+#define DS_COMPLETENESS_BUCKETS 10
+
+// How much of each frame arrived from the device
+struct FrameCompleteness
+{
+    uint64_t complete = 0;           // Frames that arrived whole
+    uint64_t recovered = 0;          // Frames patched with half-lines from the previous frame
+    uint64_t recoveredLines = 0;     // Half-lines patched in, over all recovered frames
+    std::atomic<uint64_t> lost = {0}; // Frames that never arrived, e.g. no frame info
+    uint64_t buckets[DS_COMPLETENESS_BUCKETS] = {}; // Recovered frames by tenths of the frame received
+};
+
+// Kept by the capture thread for a metrics scrape; never locked
+struct CaptureMetrics
+{
+    std::atomic<uint64_t> frames = {0};    // Frames queued for grabFrame
+    std::atomic<uint64_t> bytesRead = {0}; // Payload bytes read from the source
+    MetricHistogram transferTime;          // From requesting a frame until its info arrived
+};
+
+class DSCapture
+{
+public:
+    DSCapture();
+    DSCapture(const char* replayPath);
+    DSCapture(synthetic_scene scene, bool paced = true);
+    ~DSCapture();
+    bool grabFrame(uint16_t* frameBuffer, DSFrameInfo* info = NULL);
+    bool waitForFrame(int timeoutMs);
+    void startCapture();
+    void endCapture();
+    bool isCapturing();
+    void setRawRecorder(RawRecorder* recorder);
+    void setSourceTruncation(int percent);
+    void reportCompleteness();
+
+    const CaptureMetrics& metrics() { return captureMetrics; }
+    int framesQueued() { return framesInBuffer; }
+    uint64_t framesLost() { return completeness.lost; }
+
+private:
+    bool handlesOpen;
+    WINUSB_INTERFACE_HANDLE winusbHandle;
+    HANDLE deviceHandle;
+    char devicePath[260];
+    unsigned char bulkPipeInId;
+    unsigned short maxPacketSize;
+
+    RawFileReader* replayFile;
+    RawRecorder* rawRecorder;
+    SyntheticSource* synthetic;
+    bool pacedSource;
+    int truncatePercent;
+    uint32_t truncateSeed;
+
+    FrameSlab* ringMemory;
+    uint16_t* frameBuffer;
+    uint8_t* frameInfoBuffer;
+    uint64_t* frameTimeBuffer;
+    int* frameBytesBuffer;
+    uint16_t* lastFrame;
+    bool haveLastFrame;
+    FrameCompleteness completeness;
+    CaptureMetrics captureMetrics;
+
+    std::atomic_bool doCapture;
+    std::atomic_int framesInBuffer;
+    int readPos;
+    int writePos;
+    std::thread captureThreads[DS_THREADS];
+    std::mutex frameMutex;
+    std::condition_variable frameAvailable;
+
+    HRESULT openDevice();
+    void closeDevice();
+    void allocateRing();
+    void captureFrame();
+    void signalFrames();
+    int readSourceFrame(uint8_t* frame, uint8_t* frameInfo);
+    void recordRawFrame(int bufferPos);
+    void countFrame(uint64_t requestTime, int bytes);
+    bool readFailed(int& failures);
+    HRESULT retrieveDevicePath(char* path, ULONG buflen);
+    bool queryDeviceEndpoints();
+    bool sendToDefaultEndpoint(uint8_t request, uint16_t value, uint16_t length, uint8_t* buf);
+    bool recvFromDefaultEndpoint(uint8_t request, uint16_t length, uint8_t* buf);
+    bool readFromBulk(uint8_t* buf, int length, PULONG transferred);
+    bool getMaximumTransferSize(unsigned long* mts);
+};